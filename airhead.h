@@ -1,13 +1,9 @@
 /* License at end of file */
 /* TODO:
  * - add compile-time option for bounds-checking with custom behaviour on fail
- * - refcounting
- * - thread-safe/atomic versions
- * - alignment for SIMD
  * - minimize repeated arguments where possible
  *     - move to functions?
  * - consider adding a temp/register at a[-1]
- * - add flags to top capacity bits
  */
 
 /*
@@ -21,8 +17,12 @@
 | PASS | add(a,n)                  | add space for `n` more items on the array, growing (or creating) if needed. The items are considered used (in len)       |
 | PASS | insert(a, i, v)           | inserts value into the array at existing index i, moving elements from position i upwards along 1 to make space          |
 |      |                           |                                                                                                                          |
-| TODO | changecap(a,n)            | change space to allow for `n` items on the array, growing (or creating) if needed                                        |
-| TODO | expand(a,n)               | add space to allow for `n` items on the array, growing (or creating) if needed                                           |
+| PASS | changecap(a,n)            | change space to allow for exactly `n` items on the array, growing (or creating) if needed. len is cut to fit             |
+| PASS | expand(a,n)               | add space to allow for `n` more items on the array, growing (or creating) if needed                                      |
+| PASS | reserve(a,n)              | make space for at least `n` items in total, growing (or creating) to exactly `n` if needed                               |
+| PASS | shrink(a)                 | release unused capacity (cap = len)                                                                                      |
+| PASS | _push(a,v)                | push without checking capacity: for filling an array after reserving space for all of it                                 |
+| PASS | push_ts(a,v)              | push from several threads at once (header needs an ahd_t(ts)). A statement; other operations are not thread-safe         |
 |      |                           |                                                                                                                          |
 | PASS | pusharr(a,b)              | appends the values from b to the end of a                                                                                |
 | PASS | pushptr(a,ptr,n)          | appends n elements from ptr to the end of a                                                                              |
@@ -40,6 +40,7 @@
 | NONE | remove(a, i, n)           | removes the element at index i, shifting the higher elements down into its place TODO: this should have n                |
 | NONE | pull(a,i)                 | remove 1 and return the value. This fails if wrapped in parens: `x = (pull(vals, i))`                                    |
 | PASS | pop(a)                    | removes and returns the last element of the array                                                                        |
+| PASS | pop_ts(a,out)             | thread-safe pop into *out, alongside push_ts. Returns 0 if there was nothing to pop                                      |
 | NONE | shift(a)                  | removes and returns the first element of the array, shifting the other elements down into its place                      |
 |      |                           |                                                                                                                          |
 | PASS | clear(a)                  | set the length of array to 0                                                                                             |
@@ -49,9 +50,15 @@
 | PASS | resetlen(a,n)             | set length to a given value                                                                                              |
 |      |                           |                                                                                                                          |
 | PASS | free(a)                   | frees the array contents; also sets the array ptr back to NULL, causing access to fail. The array can be pushed to again |
+| PASS | free_ts(a)                | as free, for arrays used with push_ts (which keeps the blocks it grew from until then)                                   |
 | NONE | free2d(a)                 | frees 2d/jagged arrays - all of the subarrays are freed, then the containing array                                       |
 | NONE | free2dt(ht2, a)           | as above, but for when the inner arrays have a different header type                                                     |
 |      |                           |                                                                                                                          |
+| PASS | retain(a)                 | (header with an ahd_t(rc)) atomically adds a reference to a and returns it, to share it rather than copy it              |
+| PASS | release(a)                | drops a reference and sets a to NULL; the last one frees the array (or calls rc.free with it, if set)                    |
+| PASS | cow(a)                    | copy-on-write: if a is shared, replaces this reference with a copy, so that it can be modified                           |
+| PASS | refs(a)                   | the number of references to a (1 for a new array)                                                                        |
+|      |                           |                                                                                                                          |
 |      |                           |                                                                                                                          |
 |      | / Accessing elements /    |                                                                                                                          |
 | ---- | ------------------------- | ------------------------------------------------------------------------------------------------------------------------ |
@@ -69,6 +76,23 @@
 | PASS | _len(a)                   | number of elements in the array. Not safe to pass `NULL`.                                                                |
 | PASS | _cap(a)                   | number of possible elements in the array before it needs to grow. Not safe to pass `NULL`.                               |
 |      |                           |                                                                                                                          |
+| PASS | setgrowth(a,g)            | use ahd_growth policy g (factor, minimum bytes, rounding) for a. The header needs ahd_t(policy) directly after ahd_t(arr) |
+|      |                           | Other arrays use ahd_growth_default (set from AHD_GROW_NUM/DEN/MIN_BYTES/ROUND). Count reallocs with AHD_GROW_STATS.     |
+| PASS | setalloc(a,alloc)         | allocate a (growing, dup, sub, free) through the ahd_allocator vtable alloc. Needs ahd_t(policy) as above                |
+| PASS | AHD_ALIGNAS(n) ahd_t(arr) | as the first member of a header type: the elements of its arrays are aligned to n bytes (up to 256), through growth etc.  |
+| PASS | setarena(a,arena)         | allocate a from an ahd_arena (bump allocator; ahd_arena_reset frees everything in it). Needs ahd_t(policy) as above      |
+| PASS | mapopen(a,mf,path)        | (define AHD_MMAP) a is the array in the file at path, created if empty; grows the file. Needs ahd_t(policy) as above     |
+|      |                           | mapclose(a,mf) unmaps it, keeping the contents, and ahd_mapsync(mf) flushes it; reopening gives the array back in O(1)   |
+| PASS | setspill(a,spill)         | hold at most spill->threshold bytes, writing them to spill->file (one fwrite, optionally on a background thread) and     |
+|      |                           | starting again when full. flush(a) writes out the rest; setspill(a,0) flushes and detaches. Needs ahd_t(policy)         |
+| PASS | save(a,f)/load(a,f)       | write a to the FILE f as an ahd_blob plus its elements, in one fwrite; load appends the array read from f to a           |
+| PASS | save2d(a,f)/load2d(a,f)   | the same for arrays of arrays, with an offsets table; the inner arrays load in one read, into one allocation            |
+|      | save2dt/load2dt(ht2,a,f)  | (ahd_PACKED: growing one copies it out; free with free2d as usual). ..2dt for inner arrays with another header type     |
+| PASS | inline(t,n)               | storage for a small array of up to n elements, in a struct or on the stack: inlineinit(a,&buf) makes a an empty array   |
+|      | inlineinit(a,buf)         | in it, which is copied to the heap if it grows past n. No allocation for small arrays; free works as usual              |
+| PASS | debug_dump(f,csv)         | (define AHD_DEBUG) per-callsite allocs, bytes allocated and moved, peak capacity, live arrays; as a table or CSV.         |
+|      |                           | ahd_debug_dump_at_exit(csv) dumps to stderr at exit; ahd_debug_reset() zeroes the counters between phases               |
+|      |                           |                                                                                                                          |
 | PASS | size(a)                   | number of bytes in the array (excluding the header) for `len` elements                                                   |
 | PASS | totalsize(a)              | number of bytes in the array (including the header)                                                                      |
 | NONE | capsize(a)                | number of bytes in the array (excluding the header) for `cap` elements                                                   |
@@ -79,15 +103,17 @@
 | ---- | ------------------------- | ------------------------------------------------------------------------------------------------------------------------ |
 | PASS | dup(a)                    | duplicate the array                                                                                                      |
 | PASS | sub(a,f,n)                | duplicate subset of the array                                                                                            |
-| TODO | slice()                   | window into array (elements will update along with original)                                                             |
+| PASS | slice(a,f,n)              | window into array (elements will update along with original), without allocating. See ahd_slice_* for use                |
+| PASS | slicedup(s)               | makes a new array from a slice                                                                                           |
 |      |                           |                                                                                                                          |
-| TODO | unique()                  |                                                                                                                          |
-| TODO | uniqueadj()               | linear time simplification of above - only excludes adjacent elements: {a,b,b,c,b} -> {a,b,c,b}                          |
+| PASS | unique(a)                 | the distinct elements of a, in order of first appearance. Hashed (O(n)), or merged if a is sorted                        |
+| PASS | uniqueadj(a)              | linear time simplification of above - only excludes adjacent elements: {a,b,b,c,b} -> {a,b,c,b}                          |
 |      |                           |                                                                                                                          |
-| TODO | union(a,b)                |                                                                                                                          |
-| TODO | intersection(a,b)         |                                                                                                                          |
-| TODO | difference(a,b)           |                                                                                                                          |
-| TODO | symdiff(a,b)              |                                                                                                                          |
+| PASS | union(a,b)                | distinct elements in a or b                                                                                              |
+| PASS | intersection(a,b)         | distinct elements in both a and b                                                                                        |
+| PASS | difference(a,b)           | distinct elements in a that are not in b                                                                                 |
+| PASS | symdiff(a,b)              | distinct elements in a or b but not both                                                                                 |
+| PASS | ...by(a,[b,]mem)          | as the above, comparing only the member at mem (its address in a's first element) rather than whole elements             |
 |      |                           |                                                                                                                          |
 | TODO | shuffle(a)                |                                                                                                                          |
 | TODO | sample(a,n)               |                                                                                                                          |
@@ -98,8 +124,18 @@
 | PASS | sorts(a,mem,dir)          | Sort a in dir direction based on a signed integer member of each element (mem is the address of that)                    |
 | PASS | sorti(a,mem,dir)          | Sort a in dir direction based on any integer member of each element (mem is the address of that)                         |
 | PASS | sortf(a,mem,dir)          | Sort a in dir direction based on a floating point member of each element (mem is the address of that)                    |
-| TODO | sortstr(a,mem,dir)        | Sort a in dir direction based on a string pointer member of each element (mem is the address of that)                    |
-| TODO | sortchr(a,t,dir)          | Sort a in dir direction based on a character array member of each element (mem is the address of that)                   |
+| PASS | radixu/radixi/radixint/   | As the matching sort, but always using a (stable) LSD radix sort. Needs a temporary copy of the array.                   |
+|      | radixf(a,mem,dir)         | The sorts above use this automatically from AHD_SORT_RADIX_MIN elements.                                                 |
+| PASS | sortidx{u,i,int,f}        | Returns a permutation array (ahd_arr of ahd_int) that would sort a by mem, without modifying a                           |
+|      |   (a,mem,dir)             |                                                                                                                          |
+| PASS | sortidx{str,chr}(a,mem,dir) | As above, for string members                                                                                           |
+| PASS | permute(a,perm)           | Rearrange a in place so that a[i] = (old a)[perm[i]]. Each element is moved once.                                        |
+| PASS | stablesort{u,i,int,f}     | Stable sort by mem. Sorts keys & indices, then permutes, so it is suitable for large elements.                           |
+|      |   (a,mem,dir)             |                                                                                                                          |
+| PASS | psort{u,i,int,f}          | As the matching sort, but on multiple threads (define AHD_THREADS) for arrays of at least AHD_PSORT_MIN elements.        |
+|      |   (a,mem,dir)             | Sorts a run per thread then merges them. Set the thread count with ahd_psort_threads (<= 0 for 1 per core).              |
+| PASS | sortstr(a,mem,dir)        | Sort a in dir direction based on a string pointer member of each element (mem is the address of that)                    |
+| PASS | sortchr(a,mem,dir)        | Sort a in dir direction based on a character array member of each element (mem is the address of that)                   |
 | PASS | reverse(a)                | reverse the order of the elements in the array                                                                           |
 | PASS | rotr(a,n)                 | move each element to the next index. The last element moves to the first position                                        |
 | TODO | rotl(a,n)                 | move each element to the previous index. The first element moves to the last position                                    |
@@ -114,6 +150,13 @@
 | NONE | reduce(a,ex)              |                                                                                                                          |
 | NONE | reducefn(fn,a,acc,udata)  |                                                                                                                          |
 |      |                           |                                                                                                                          |
+| PASS | filterfn(fn,a,b,udata)    | copies the elements of a for which fn is nonzero into b (may be a), in order; returns the number kept. Branchless        |
+|      |                           |                                                                                                                          |
+| PASS | pmapfn(fn,a,b,udata)      | as mapfn, on ahd_ploop_threads threads from AHD_PLOOP_MIN elements, a chunk of the array each                            |
+| PASS | preducefn(fn,combine,a,   | as reducefn, into a copy of *acc per chunk; the copies are then folded into acc with combine                             |
+|      |   acc,udata)              |                                                                                                                          |
+| PASS | pfilterfn(fn,a,b,udata)   | as filterfn, in parallel                                                                                                 |
+|      |                           |                                                                                                                          |
 | NONE | filter(i,t,v,a,b,tr)      |                                                                                                                          |
 | NONE | reject(i,t,v,a,b,tr)      |                                                                                                                          |
 | NONE | count(i,t,v,a,b,tr)       |                                                                                                                          |
@@ -123,6 +166,35 @@
 | NONE | findi(a,i,t,v,tr)         |                                                                                                                          |
 | NONE | findv(a,t,v,fnd,tr)       |                                                                                                                          |
 |      |                           |                                                                                                                          |
+| PASS | findeq{i,u,int,f}(a,x)    | index of the first element of a (an array of numbers) equal to x, or len(a). Uses SSE2/AVX2 if the compiler targets them |
+| PASS | findgt{i,u,int,f}(a,x)    | index of the first element greater than x, or len(a)                                                                     |
+| PASS | counteq{i,u,int,f}(a,x)   | number of elements equal to x                                                                                            |
+| PASS | countrange{i,u,int,f}     | number of elements from lo to hi (inclusive)                                                                             |
+|      |   (a,lo,hi)               |                                                                                                                          |
+|      |                           |                                                                                                                          |
+| PASS | sum{i,u,int,f}(a,mem)     | sum of the member mem (as for the sorts; a itself for arrays of numbers). Integers wrap; floats add up in doubles        |
+| PASS | ksumf(a,mem)              | as sumf, with Kahan (compensated) summation                                                                              |
+| PASS | min{i,u,int,f}(a,mem)     | smallest value of the member (0 if a is empty; floats skip NaNs)                                                         |
+| PASS | max{i,u,int,f}(a,mem)     | largest value of the member                                                                                              |
+| PASS | argmin{i,u,int,f}(a,mem)  | index of the first smallest element, or len(a) if there isn't one                                                        |
+| PASS | argmax{i,u,int,f}(a,mem)  | index of the first largest element, or len(a) if there isn't one                                                         |
+| PASS | dot{i,u,int,f}            | sum of the products of ma in a and mb in b, up to the shorter length                                                     |
+|      |   (a,ma,b,mb)             |                                                                                                                          |
+|      |                           |                                                                                                                          |
+|      | / Hash maps /             | Headers with an ahd_t(map); the elements are the entries, with `key` (and `value`) members                               |
+| ---- | ------------------------- | ------------------------------------------------------------------------------------------------------------------------ |
+| PASS | map_put(a,k,v)            | sets the value for key k, adding an entry if there isn't one (expected O(1): Robin Hood hashing of the key's bytes)      |
+| PASS | map_at(a,k)               | pointer to the entry for k, adding a zeroed one if there isn't one                                                       |
+| PASS | map_get(a,k)              | pointer to the entry for k, or NULL                                                                                      |
+| PASS | map_geti(a,k)             | index of the entry for k, or len(a)                                                                                      |
+| PASS | map_getp(a,kp)            | as map_geti, with a pointer to the key. Doesn't modify a, so several threads can look up at once                         |
+| PASS | map_del(a,k)              | removes the entry for k (the last entry moves into its place); returns whether there was one                             |
+| PASS | map_clear(a)              | removes all entries, keeping the memory                                                                                  |
+| PASS | map_free(a)               | frees the array and its index                                                                                            |
+| PASS | map_dup(a)                | copies the array and its index                                                                                           |
+| PASS | map_release(a)            | as release/cow, for maps with an ahd_t(rc) as well                                                                       |
+| PASS | map_cow(a)                |                                                                                                                          |
+|      |                           |                                                                                                                          |
 |      | / Scoped memory /         |                                                                                                                          |
 | ---- | ------------------------- | ------------------------------------------------------------------------------------------------------------------------ |
 | PASS | exitscope                 |                                                                                                                          |
@@ -148,6 +220,7 @@ extern "C" {
 #include <string.h>
 #define AHD_MEMCPY memcpy
 #define AHD_MEMCMP memcmp
+#define AHD_MEMSET memset
 #define AHD_MEMMOVE memmove
 #endif/*stdlib*/
 
@@ -159,6 +232,8 @@ extern "C" {
 typedef unsigned long long ahd_int;
 #endif
 
+#include <stddef.h> /* offsetof */
+
 #ifndef ahd_enum
 typedef int ahd_enum;
 #endif
@@ -167,14 +242,56 @@ typedef int ahd_enum;
 //       v
 // |-hdr-|------------------------|
 typedef struct ahd_arr {
-	ahd_int cap;
+	ahd_int cap; /* the top AHD_FLAG_BITS bits are flags (ahd_flag), not capacity */
 	ahd_int len;
 } ahd_arr;
 
-// TODO:
+#define AHD_FLAG_BITS 8
+#define AHD_CAP_MASK  (~0ull >> AHD_FLAG_BITS)
+typedef enum ahd_flag {
+	ahd_POLICY = 1,      /* the header has an ahd_t(policy) directly after ahd_t(arr) */
+	ahd_ALIGN  = 7 << 1, /* log2(data alignment / 16), for header types aligned to more than 16 */
+	ahd_PACKED = 1 << 4, /* in a block shared with other arrays (from ahd_load2d): copied out to grow */
+	ahd_INLINE = 1 << 5, /* in storage it doesn't own (from ahd_inlineinit): copied out to grow, never freed */
+} ahd_flag;
+#define ahd_ALIGNSHIFT 1
+#define ahd__flags(ht,a)  ((int)(ahd__arr(ht,a)->cap >> (64 - AHD_FLAG_BITS)))
+#define ahd__flag(f)      ((ahd_int)(f) << (64 - AHD_FLAG_BITS))
+#define AHD__BORROWED       (ahd__flag(ahd_PACKED) | ahd__flag(ahd_INLINE)) /* not an allocation of its own */
+#define ahd__copyflags(cap) ((cap) & ~AHD_CAP_MASK & ~AHD__BORROWED)        /* for a copy with its own allocation */
+
+/* How capacity grows when an array runs out: cap' = cap * num/den, at least
+ * enough for min_bytes and for the new elements. If round is set, the
+ * allocation (header included) is rounded up to a power of 2 when smaller than
+ * round (matching malloc size classes) and to a multiple of round otherwise
+ * (e.g. 4096 for whole pages); the extra space is added to the capacity.
+ */
+typedef struct ahd_growth {
+	ahd_int num, den;
+	ahd_int min_bytes;
+	ahd_int round;
+} ahd_growth;
+
+/* Where an array's memory comes from, in place of AHD_REALLOC/AHD_FREE.
+ * realloc is given the old size of ptr (0 if ptr is 0); data is passed to each.
+ */
+typedef struct ahd_allocator {
+	void *(*realloc)(void *data, void *ptr, ahd_int old_size, ahd_int size);
+	void  (*free)(void *data, void *ptr);
+	void *data;
+} ahd_allocator;
+
+// per-array growth and allocation, set with ahd_setgrowth/ahd_setalloc; must directly follow ahd_t(arr)
+typedef struct ahd_policy {
+	ahd_growth const *growth;
+	ahd_allocator const *alloc;
+	struct ahd_spill *spill; /* set with ahd_setspill: writes the elements out when full, instead of growing */
+} ahd_policy;
+
+// for ahd_retain/ahd_release/ahd_cow
 typedef struct ahd_rc {
-	ahd_int rc;
-	void (*free)(void*);
+	ahd_int rc;          /* references - 1 */
+	void (*free)(void*); /* called with the array on the last release, in place of freeing it */
 } ahd_rc;
 
 // for use with enums
@@ -182,19 +299,48 @@ typedef struct ahd_kind {
 	ahd_enum kind;
 } ahd_kind;
 
+// for ahd_push_ts/ahd_pop_ts from several threads at once
 typedef struct ahd_ts {
-	ahd_int lock;
-	// TODO: anything else? signals?
-} ahd_ts; // or mtx?
+	ahd_int written; /* slots that have had their value written (len counts those claimed) */
+	void *retired;   /* the header this array grew from, freed with it by ahd_free_ts */
+} ahd_ts;
+
+// for the ahd_map_* operations: an index from the elements' keys to their positions
+typedef struct ahd_map {
+	struct ahd__mapslot *slots; /* Robin Hood hash table; 0 until the first put */
+	ahd_int mask;               /* number of slots - 1 */
+} ahd_map;
 
 #define ahd_t(t) ahd_## t t
 
+/* Element data is aligned to the alignment of the header type (up to 256):
+ * typedef struct simd_arr { AHD_ALIGNAS(64) ahd_t(arr); } simd_arr;
+ * float *xs = 0; ahd_push(simd_arr, xs, 1.f); // xs is 64-byte aligned
+ */
+#ifndef AHD_ALIGNAS
+# if defined(__cplusplus)
+#  define AHD_ALIGNAS(n) alignas(n)
+#  define AHD_ALIGNOF(t) alignof(t)
+# elif defined(_MSC_VER)
+#  define AHD_ALIGNAS(n) __declspec(align(n))
+#  define AHD_ALIGNOF(t) __alignof(t)
+# else
+#  define AHD_ALIGNAS(n) _Alignas(n)
+#  define AHD_ALIGNOF(t) _Alignof(t)
+# endif
+#endif/*AHD_ALIGNAS*/
+
 /* Usage: creating a custom header
  * typedef struct typesafe_refcounted_array { ahd_t(arr); ahd_t(rc); int my_custom_int; ahd_t(ts); } typesafe_refcounted_array;
  * int *Nums = 0;
  * ahd_push(typesafe_refcounted_array, Nums, 3);
  * #define tsrc_push(a,v) ahd_push(typesafe_refcounted_array, a, v)
  * tsrc_push(Nums, 62);
+ *
+ * Per-array growth policy:
+ * typedef struct record_array { ahd_t(arr); ahd_t(policy); } record_array;
+ * static ahd_growth const record_growth = { 3, 2, 4096, 4096 };
+ * ahd_setgrowth(record_array, Records, &record_growth);
  */
 
 #ifndef AHD_NO_DEFAULT_ARR /***************************************************/
@@ -202,6 +348,11 @@ typedef struct ahd_ts {
 #define arr_push(a,v)               ahd_push(ahd_arr,a,v)
 #define arr_add(a,n)                ahd_add(ahd_arr,a,n)
 #define arr_insert(a,i,v)           ahd_insert(ahd_arr,a,i,v)
+#define arr_changecap(a,n)          ahd_changecap(ahd_arr,a,n)
+#define arr_expand(a,n)             ahd_expand(ahd_arr,a,n)
+#define arr_reserve(a,n)            ahd_reserve(ahd_arr,a,n)
+#define arr_shrink(a)               ahd_shrink(ahd_arr,a)
+#define arr__push(a,v)              ahd__push(ahd_arr,a,v)
 
 #define arr_append(a,src,len,size)  ahd_append(ahd_arr,a,src,len,size)
 #define arr_concat(a,b)             ahd_concat(ahd_arr,a,b)
@@ -226,6 +377,14 @@ typedef struct ahd_ts {
 #define arr_free(a)                 ahd_free(ahd_arr,a)
 #define arr_free2dt(ht2,a)          ahd_free2dt(ahd_arr,ht2,a)
 #define arr_free2d(a)               ahd_free2d(ahd_arr,a)
+#define arr_inline(t,n)             ahd_inline(ahd_arr,t,n)
+#define arr_inlineinit(a,buf)       ahd_inlineinit(ahd_arr,a,buf)
+#define arr_save(a,f)               ahd_save(ahd_arr,a,f)
+#define arr_load(a,f)               ahd_load(ahd_arr,a,f)
+#define arr_save2d(a,f)             ahd_save2d(ahd_arr,a,f)
+#define arr_load2d(a,f)             ahd_load2d(ahd_arr,a,f)
+#define arr_save2dt(ht2,a,f)        ahd_save2dt(ahd_arr,ht2,a,f)
+#define arr_load2dt(ht2,a,f)        ahd_load2dt(ahd_arr,ht2,a,f)
 
 
 /* Accessing elements */
@@ -256,12 +415,22 @@ typedef struct ahd_ts {
 /* Extracting array subsets */
 #define arr_dup(a)                  ahd_dup(ahd_arr,a)
 #define arr_sub(a,f,n)              ahd_sub(ahd_arr,a,f,n)
-#define arr_slice()                 ahd_slice()
+#define arr_slice(a,f,n)            ahd_sliceof(ahd_arr,a,f,n)
+#define arr_slicedup(s)             ahd_slice_dup(ahd_arr,s)
 
 #define arr_unique(a)               ahd_unique(ahd_arr,a)
+#define arr_uniqueadj(a)            ahd_uniqueadj(ahd_arr,a)
+#define arr_uniqueby(a,mem)         ahd_uniqueby(ahd_arr,a,mem)
+#define arr_uniqueadjby(a,mem)      ahd_uniqueadjby(ahd_arr,a,mem)
 
 #define arr_union(a,b)              ahd_union(ahd_arr,a,b)
 #define arr_intersection(a,b)       ahd_intersection(ahd_arr,a,b)
+#define arr_difference(a,b)         ahd_difference(ahd_arr,a,b)
+#define arr_symdiff(a,b)            ahd_symdiff(ahd_arr,a,b)
+#define arr_unionby(a,b,mem)        ahd_unionby(ahd_arr,a,b,mem)
+#define arr_intersectionby(a,b,mem) ahd_intersectionby(ahd_arr,a,b,mem)
+#define arr_differenceby(a,b,mem)   ahd_differenceby(ahd_arr,a,b,mem)
+#define arr_symdiffby(a,b,mem)      ahd_symdiffby(ahd_arr,a,b,mem)
 
 
 /* Rearranging array */
@@ -269,6 +438,27 @@ typedef struct ahd_ts {
 #define arr_sortu(a,mem,dir)        ahd_sortu(ahd_arr,a,mem,dir)
 #define arr_sortint(a,mem,dir)      ahd_sortint(ahd_arr,a,mem,dir)
 #define arr_sortf(a,mem,dir)        ahd_sortf(ahd_arr,a,mem,dir)
+#define arr_sortstr(a,mem,dir)      ahd_sortstr(ahd_arr,a,mem,dir)
+#define arr_sortchr(a,mem,dir)      ahd_sortchr(ahd_arr,a,mem,dir)
+#define arr_radixi(a,mem,dir)       ahd_radixi(ahd_arr,a,mem,dir)
+#define arr_radixu(a,mem,dir)       ahd_radixu(ahd_arr,a,mem,dir)
+#define arr_radixint(a,mem,dir)     ahd_radixint(ahd_arr,a,mem,dir)
+#define arr_radixf(a,mem,dir)       ahd_radixf(ahd_arr,a,mem,dir)
+#define arr_sortidxi(a,mem,dir)     ahd_sortidxi(ahd_arr,a,mem,dir)
+#define arr_sortidxu(a,mem,dir)     ahd_sortidxu(ahd_arr,a,mem,dir)
+#define arr_sortidxint(a,mem,dir)   ahd_sortidxint(ahd_arr,a,mem,dir)
+#define arr_sortidxf(a,mem,dir)     ahd_sortidxf(ahd_arr,a,mem,dir)
+#define arr_sortidxstr(a,mem,dir)   ahd_sortidxstr(ahd_arr,a,mem,dir)
+#define arr_sortidxchr(a,mem,dir)   ahd_sortidxchr(ahd_arr,a,mem,dir)
+#define arr_permute(a,perm)         ahd_permute(ahd_arr,a,perm)
+#define arr_stablesorti(a,mem,dir)  ahd_stablesorti(ahd_arr,a,mem,dir)
+#define arr_stablesortu(a,mem,dir)  ahd_stablesortu(ahd_arr,a,mem,dir)
+#define arr_stablesortint(a,mem,dir) ahd_stablesortint(ahd_arr,a,mem,dir)
+#define arr_stablesortf(a,mem,dir)  ahd_stablesortf(ahd_arr,a,mem,dir)
+#define arr_psorti(a,mem,dir)       ahd_psorti(ahd_arr,a,mem,dir)
+#define arr_psortu(a,mem,dir)       ahd_psortu(ahd_arr,a,mem,dir)
+#define arr_psortint(a,mem,dir)     ahd_psortint(ahd_arr,a,mem,dir)
+#define arr_psortf(a,mem,dir)       ahd_psortf(ahd_arr,a,mem,dir)
 #define arr_reverse(a)              ahd_reverse(ahd_arr,a)
 #define arr_rotr(a, n)              ahd_rotr(ahd_arr,a,n)
 #define arr_rotl(a, n)              ahd_rotl(ahd_arr,a,n)
@@ -295,6 +485,12 @@ typedef struct ahd_ts {
 #define arr_reduce(a,ex)               ahd_reduce(ahd_arr,a,ex)
 #define arr_reducefn(fn,a,acc,udata)   ahd_reducefn(ahd_arr,fn,a,acc,udata)
 
+#define arr_filterfn(fn,a,b,udata)     ahd_filterfn(ahd_arr,fn,a,b,udata)
+
+#define arr_pmapfn(fn,a,b,udata)       ahd_pmapfn(ahd_arr,fn,a,b,udata)
+#define arr_preducefn(fn,combine,a,acc,udata) ahd_preducefn(ahd_arr,fn,combine,a,acc,udata)
+#define arr_pfilterfn(fn,a,b,udata)    ahd_pfilterfn(ahd_arr,fn,a,b,udata)
+
 #define arr_filter(i,t,v,a,b,tr)       ahd_filter(ahd_arr,i,t,v,a,b,tr)
 #define arr_count(i,t,v,a,b,tr)        ahd_count(ahd_arr,i,t,v,a,b,tr)
 #define arr_countx(a,i,x,tr)           ahd_countx(ahd_arr,a,i,x,tr)
@@ -303,6 +499,49 @@ typedef struct ahd_ts {
 #define arr_findi(a,i,t,v,tr)          ahd_findi(ahd_arr,a,i,t,v,tr)
 #define arr_findv(a,t,v,fnd,tr)        ahd_findv(ahd_arr,a,t,v,fnd,tr)
 
+#define arr_findeqi(a,x)               ahd_findeqi(ahd_arr,a,x)
+#define arr_findequ(a,x)               ahd_findequ(ahd_arr,a,x)
+#define arr_findeqint(a,x)             ahd_findeqint(ahd_arr,a,x)
+#define arr_findeqf(a,x)               ahd_findeqf(ahd_arr,a,x)
+#define arr_findgti(a,x)               ahd_findgti(ahd_arr,a,x)
+#define arr_findgtu(a,x)               ahd_findgtu(ahd_arr,a,x)
+#define arr_findgtint(a,x)             ahd_findgtint(ahd_arr,a,x)
+#define arr_findgtf(a,x)               ahd_findgtf(ahd_arr,a,x)
+#define arr_counteqi(a,x)              ahd_counteqi(ahd_arr,a,x)
+#define arr_countequ(a,x)              ahd_countequ(ahd_arr,a,x)
+#define arr_counteqint(a,x)            ahd_counteqint(ahd_arr,a,x)
+#define arr_counteqf(a,x)              ahd_counteqf(ahd_arr,a,x)
+#define arr_countrangei(a,lo,hi)       ahd_countrangei(ahd_arr,a,lo,hi)
+#define arr_countrangeu(a,lo,hi)       ahd_countrangeu(ahd_arr,a,lo,hi)
+#define arr_countrangeint(a,lo,hi)     ahd_countrangeint(ahd_arr,a,lo,hi)
+#define arr_countrangef(a,lo,hi)       ahd_countrangef(ahd_arr,a,lo,hi)
+
+#define arr_sumi(a,mem)                ahd_sumi(ahd_arr,a,mem)
+#define arr_sumu(a,mem)                ahd_sumu(ahd_arr,a,mem)
+#define arr_sumint(a,mem)              ahd_sumint(ahd_arr,a,mem)
+#define arr_sumf(a,mem)                ahd_sumf(ahd_arr,a,mem)
+#define arr_ksumf(a,mem)               ahd_ksumf(ahd_arr,a,mem)
+#define arr_mini(a,mem)                ahd_mini(ahd_arr,a,mem)
+#define arr_minu(a,mem)                ahd_minu(ahd_arr,a,mem)
+#define arr_minint(a,mem)              ahd_minint(ahd_arr,a,mem)
+#define arr_minf(a,mem)                ahd_minf(ahd_arr,a,mem)
+#define arr_maxi(a,mem)                ahd_maxi(ahd_arr,a,mem)
+#define arr_maxu(a,mem)                ahd_maxu(ahd_arr,a,mem)
+#define arr_maxint(a,mem)              ahd_maxint(ahd_arr,a,mem)
+#define arr_maxf(a,mem)                ahd_maxf(ahd_arr,a,mem)
+#define arr_argmini(a,mem)             ahd_argmini(ahd_arr,a,mem)
+#define arr_argminu(a,mem)             ahd_argminu(ahd_arr,a,mem)
+#define arr_argminint(a,mem)           ahd_argminint(ahd_arr,a,mem)
+#define arr_argminf(a,mem)             ahd_argminf(ahd_arr,a,mem)
+#define arr_argmaxi(a,mem)             ahd_argmaxi(ahd_arr,a,mem)
+#define arr_argmaxu(a,mem)             ahd_argmaxu(ahd_arr,a,mem)
+#define arr_argmaxint(a,mem)           ahd_argmaxint(ahd_arr,a,mem)
+#define arr_argmaxf(a,mem)             ahd_argmaxf(ahd_arr,a,mem)
+#define arr_doti(a,ma,b,mb)            ahd_doti(ahd_arr,a,ma,b,mb)
+#define arr_dotu(a,ma,b,mb)            ahd_dotu(ahd_arr,a,ma,b,mb)
+#define arr_dotint(a,ma,b,mb)          ahd_dotint(ahd_arr,a,ma,b,mb)
+#define arr_dotf(a,ma,b,mb)            ahd_dotf(ahd_arr,a,ma,b,mb)
+
 /* Scoped memory */
 #define arr_exitscope                  ahd_exitscope
 #define arr_scoped(t,a)                ahd_scoped(ahd_arr,t,a)
@@ -334,13 +573,430 @@ typedef struct ahd_ts {
 
 #define ahd_if(a,v)           ((a) ? (v) : 0)
 
+#define ahd__max(a,b) ((a) >= (b) ? (a) : (b))
+#define ahd__min(a,b) ((a) <  (b) ? (a) : (b))
+
 #define ahd__data(ht,a) (a), sizeof(ht), sizeof(*(a))
 
+/******************************************************************************/
+/* Allocation *****************************************************************/
+/******************************************************************************/
+/* Arena: a bump allocator for arrays that all die together (e.g. per-request
+ * scratch). Arrays are carved from blocks of block_size bytes; the most recent
+ * allocation can grow in place, and freeing it gives the space back. Other
+ * frees do nothing: ahd_arena_reset makes all of the space available again at
+ * once. A zeroed ahd_arena is ready to use.
+ * Arena arrays need an ahd_t(policy) header component and are made with
+ * ahd_setarena; they can coexist with heap arrays of the same header type.
+ * ahd_arena_allocator gives the arena as an ahd_allocator for ahd_setalloc.
+ */
+#ifndef  AHD_ARENA_BLOCK_SIZE
+# define AHD_ARENA_BLOCK_SIZE (64 * 1024)
+#endif// AHD_ARENA_BLOCK_SIZE
+#define AHD_ARENA_ALIGN 16
+
+typedef struct ahd_arena_block {
+	struct ahd_arena_block *next; /* older block */
+	ahd_int size, used;
+	ahd_int pad;                  /* keeps the data that follows AHD_ARENA_ALIGN aligned */
+} ahd_arena_block;
+
+typedef struct ahd_arena {
+	ahd_arena_block *block; /* newest block */
+	ahd_int block_size;     /* 0 for AHD_ARENA_BLOCK_SIZE */
+	char *last;             /* the most recent allocation */
+	ahd_allocator alloc;    /* filled by ahd_arena_allocator */
+} ahd_arena;
+
+#define ahd__arena_round(n) (((n) + AHD_ARENA_ALIGN - 1) & ~(ahd_int)(AHD_ARENA_ALIGN - 1))
+
+static void *
+ahd_arena_realloc(ahd_arena *arena, void *ptr, ahd_int old_size, ahd_int size)
+{
+	ahd_arena_block *block = arena->block;
+	char *mem;
+	if(ptr && ptr == arena->last) { /* resize in place if it's still the last allocation */
+		ahd_int at = (ahd_int)((char *)ptr - (char *)(block + 1));
+		if(at + ahd__arena_round(size) <= block->size) {
+			block->used = at + ahd__arena_round(size);
+			return ptr;
+		}
+	}
+	else if(ptr && size <= old_size)
+	{ return ptr; }
+
+	if(! block || block->used + ahd__arena_round(size) > block->size) {
+		ahd_int block_size = ahd__max(arena->block_size ? arena->block_size : AHD_ARENA_BLOCK_SIZE,
+		                              ahd__arena_round(size));
+		ahd_arena_block *new_block = (ahd_arena_block *)AHD_REALLOC(0, sizeof(*new_block) + block_size);
+		if(! new_block)
+		{ return 0; }
+		new_block->next = block;
+		new_block->size = block_size;
+		new_block->used = 0;
+		arena->block = block = new_block;
+	}
+
+	mem = (char *)(block + 1) + block->used;
+	block->used += ahd__arena_round(size);
+	if(ptr)
+	{ AHD_MEMCPY(mem, ptr, ahd__min(old_size, size)); }
+	arena->last = mem;
+	return mem;
+}
+
+static void
+ahd_arena_dealloc(ahd_arena *arena, void *ptr)
+{
+	if(ptr && ptr == arena->last) {
+		arena->block->used = (ahd_int)((char *)ptr - (char *)(arena->block + 1));
+		arena->last = 0;
+	}
+}
+
+/* all allocations from the arena are invalidated; keeps the newest block for reuse */
+static void
+ahd_arena_reset(ahd_arena *arena)
+{
+	ahd_arena_block *block = arena->block;
+	if(block) {
+		while(block->next) {
+			ahd_arena_block *next = block->next->next;
+			AHD_FREE(block->next);
+			block->next = next;
+		}
+		block->used = 0;
+	}
+	arena->last = 0;
+}
+
+static void
+ahd_arena_free(ahd_arena *arena)
+{
+	while(arena->block) {
+		ahd_arena_block *next = arena->block->next;
+		AHD_FREE(arena->block);
+		arena->block = next;
+	}
+	arena->last = 0;
+}
+
+static void *ahd__arena_realloc(void *arena, void *ptr, ahd_int old_size, ahd_int size)
+{ return ahd_arena_realloc((ahd_arena *)arena, ptr, old_size, size); }
+static void ahd__arena_free(void *arena, void *ptr)
+{ ahd_arena_dealloc((ahd_arena *)arena, ptr); }
+
+static ahd_allocator const *
+ahd_arena_allocator(ahd_arena *arena)
+{
+	if(! arena)
+	{ return 0; }
+	arena->alloc.realloc = ahd__arena_realloc;
+	arena->alloc.free    = ahd__arena_free;
+	arena->alloc.data    = arena;
+	return &arena->alloc;
+}
+
+// the allocator for the array with this header (0 for AHD_REALLOC/AHD_FREE)
+#define ahd__allocof(head) (((head)->cap & ahd__flag(ahd_POLICY)) ? ((ahd_policy *)((head) + 1))->alloc : 0)
+
+static void *
+ahd__allocrealloc(ahd_allocator const *alloc, void *ptr, ahd_int old_size, ahd_int size)
+{ return alloc ? alloc->realloc(alloc->data, ptr, old_size, size) : AHD_REALLOC(ptr, size); }
+
+/* Aligned arrays: the allocation has `align` bytes spare, and the header is
+ * placed in it so that the elements after it are aligned. How far along it is
+ * (the pad, 1 to align bytes) is kept in the byte before the header.
+ */
+static ahd_int
+ahd__alignflags(ahd_int align)
+{
+	ahd_int shift = 0;
+	while((ahd_int)16 << shift < align && shift < 4) { ++shift; }
+	return ahd__flag(shift << ahd_ALIGNSHIFT);
+}
+#define ahd__alignof(cap) (((cap) & ahd__flag(ahd_ALIGN)) \
+                           ? (ahd_int)16 << (((cap) >> (64 - AHD_FLAG_BITS + ahd_ALIGNSHIFT)) & 7) : 0)
+#define ahd__padof(head)  (ahd__alignof((head)->cap) ? ((unsigned char *)(head))[-1] + (ahd_int)1 : 0)
+
+/* places the header in raw, moving the size bytes of contents that are at raw + old_pad */
+static ahd_arr *
+ahd__align(char *raw, ahd_int old_pad, ahd_int size, ahd_int hdr_size, ahd_int align)
+{
+	ahd_int pad;
+	if(! align)
+	{ return (ahd_arr *)raw; }
+	pad = align - ((uintptr_t)(raw + hdr_size) & (align - 1));
+	if(pad != old_pad && size)
+	{ AHD_MEMMOVE(raw + pad, raw + old_pad, size); }
+	raw[pad - 1] = (char)(pad - 1);
+	return (ahd_arr *)(raw + pad);
+}
+
+/* a new zeroed header (with flags in cap) in an allocation of size bytes, header included */
+static ahd_arr *
+ahd__hdralloc(ahd_allocator const *alloc, ahd_int flags, ahd_int size, ahd_int hdr_size)
+{
+	ahd_int align = ahd__alignof(flags);
+	char *raw = (char *)ahd__allocrealloc(alloc, 0, 0, size + align), *hdr_bytes, *hdr_guard;
+	ahd_arr *head;
+	if(! raw)
+	{ return 0; }
+	head = ahd__align(raw, 0, 0, hdr_size, align);
+	for(hdr_bytes = (char *)head, hdr_guard = hdr_bytes + hdr_size; hdr_bytes < hdr_guard; ++hdr_bytes)
+	{ *hdr_bytes = 0; } /* zero init for any size header */
+	head->cap = flags;
+	return head;
+}
+
+/* resizes the allocation of head from old_size to size bytes, header included */
+static ahd_arr *
+ahd__hdrrealloc(ahd_arr *head, ahd_int old_size, ahd_int size, ahd_int hdr_size)
+{
+	ahd_int align = ahd__alignof(head->cap), pad = ahd__padof(head);
+	char *raw = (char *)ahd__allocrealloc(ahd__allocof(head), (char *)head - pad, old_size + align, size + align);
+	return raw ? ahd__align(raw, pad, ahd__min(old_size, size), hdr_size, align) : 0;
+}
+
+#if AHD_DEBUG
+/* Callsite profiling: with AHD_DEBUG, every grow/setcap/dup is counted against
+ * the line that made it (for ahd_push etc., the line in your code), and arrays
+ * are tracked from there until freed. Dump with ahd_debug_dump, or at exit with
+ * ahd_debug_dump_at_exit. The tables are per translation unit, like
+ * ahd_grow_stats, and are not thread-safe: grow from one thread at a time.
+ */
+#include <stdio.h>
+
+#ifndef  AHD_DEBUG_SITES
+# define AHD_DEBUG_SITES 1024 /* callsites tracked; any beyond that are counted together */
+#endif// AHD_DEBUG_SITES
+
+typedef struct ahd_callsite {
+	char const *file, *func, *call;
+	int         line;
+	ahd_int     allocs;      /* allocations and reallocations made here */
+	ahd_int     bytes_alloc; /* bytes asked for by them, headers included */
+	ahd_int     moves;       /* reallocations that moved the array */
+	ahd_int     bytes_moved; /* bytes copied by those moves */
+	ahd_int     peak_cap;    /* largest capacity given to an array here, in bytes */
+	ahd_int     live;        /* arrays created here and not yet freed */
+	ahd_int     peak_live;
+} ahd_callsite;
+
+static ahd_callsite ahd_debug_sites[AHD_DEBUG_SITES];
+
+/* the last slot is shared by any callsites that don't fit */
+static int
+ahd__dbg_site(int line, char const *file, char const *func, char const *call)
+{
+	ahd_int n = AHD_DEBUG_SITES - 1, i = ((ahd_int)line * 0x9E3779B97F4A7C15ull ^ (uintptr_t)call) % n, probes;
+	for(probes = 0; probes < n; ++probes, i = (i + 1) % n) {
+		ahd_callsite *site = &ahd_debug_sites[i];
+		if(! site->file) {
+			site->file = file, site->func = func, site->call = call, site->line = line;
+			return (int)i;
+		}
+		if(site->line == line && site->call == call && site->file == file)
+		{ return (int)i; }
+	}
+	if(! ahd_debug_sites[n].file) {
+		ahd_debug_sites[n].file = "(other)", ahd_debug_sites[n].func = "";
+		ahd_debug_sites[n].call = "";
+	}
+	return (int)n;
+}
+
+/* which callsite created each live array, by header address:
+ * linear probing, with backward-shift deletion so there are no tombstones */
+typedef struct ahd__dbg_owner { void *head; int site; } ahd__dbg_owner;
+static ahd__dbg_owner *ahd__dbg_owners;
+static ahd_int ahd__dbg_owners_cap, ahd__dbg_owners_len;
+
+#define ahd__dbg_slot(head) ((ahd_int)(((uintptr_t)(head) >> 4) * 0x9E3779B97F4A7C15ull >> 17) & (ahd__dbg_owners_cap - 1))
+
+static void
+ahd__dbg_own(void *head, int site)
+{
+	ahd_int i;
+	if(2 * (ahd__dbg_owners_len + 1) > ahd__dbg_owners_cap) {
+		ahd__dbg_owner *old = ahd__dbg_owners;
+		ahd_int old_cap = ahd__dbg_owners_cap, j;
+		ahd__dbg_owner *owners = (ahd__dbg_owner *)AHD_REALLOC(0, (old_cap ? 2 * old_cap : 256) * sizeof(*owners));
+		if(! owners)
+		{ return; }
+		ahd__dbg_owners_cap = old_cap ? 2 * old_cap : 256;
+		AHD_MEMSET(owners, 0, ahd__dbg_owners_cap * sizeof(*owners));
+		ahd__dbg_owners = owners;
+		for(j = 0; j < old_cap; ++j) {
+			if(! old[j].head)
+			{ continue; }
+			for(i = ahd__dbg_slot(old[j].head); owners[i].head; i = (i + 1) & (ahd__dbg_owners_cap - 1)) {}
+			owners[i] = old[j];
+		}
+		AHD_FREE(old);
+	}
+	for(i = ahd__dbg_slot(head); ahd__dbg_owners[i].head; i = (i + 1) & (ahd__dbg_owners_cap - 1)) {}
+	ahd__dbg_owners[i].head = head, ahd__dbg_owners[i].site = site;
+	++ahd__dbg_owners_len;
+}
+
+/* returns the site that created head, or -1 if it wasn't tracked */
+static int
+ahd__dbg_disown(void *head)
+{
+	ahd_int mask = ahd__dbg_owners_cap - 1, i, j;
+	int site;
+	if(! ahd__dbg_owners_cap)
+	{ return -1; }
+	for(i = ahd__dbg_slot(head); ahd__dbg_owners[i].head != head; i = (i + 1) & mask)
+	{ if(! ahd__dbg_owners[i].head) { return -1; } }
+	site = ahd__dbg_owners[i].site;
+	for(j = (i + 1) & mask; ahd__dbg_owners[j].head; j = (j + 1) & mask) {
+		/* move back any entry whose probe run passes through the hole at i */
+		ahd_int home = ahd__dbg_slot(ahd__dbg_owners[j].head);
+		if(((j - home) & mask) >= ((j - i) & mask))
+		{ ahd__dbg_owners[i] = ahd__dbg_owners[j], i = j; }
+	}
+	ahd__dbg_owners[i].head = 0;
+	--ahd__dbg_owners_len;
+	return site;
+}
+
+/* a new array from site: size is the allocation, cap_bytes the space for elements */
+static void
+ahd__dbg_created(int site_i, void *head, ahd_int size, ahd_int cap_bytes)
+{
+	ahd_callsite *site = &ahd_debug_sites[site_i];
+	site->allocs      += 1;
+	site->bytes_alloc += size;
+	site->peak_cap     = ahd__max(site->peak_cap, cap_bytes);
+	site->live        += 1;
+	site->peak_live    = ahd__max(site->peak_live, site->live);
+	ahd__dbg_own(head, site_i);
+}
+
+/* the array at old_head is now at new_head (it was reallocated or moved to another allocator) */
+static void
+ahd__dbg_moved(void *old_head, void *new_head)
+{
+	int site = ahd__dbg_disown(old_head);
+	if(site >= 0)
+	{ ahd__dbg_own(new_head, site); }
+}
+
+static void
+ahd__dbg_freed(void *head)
+{
+	int site = ahd__dbg_disown(head);
+	if(site >= 0)
+	{ --ahd_debug_sites[site].live; }
+}
+
+/* zeroes the counters (other than the live arrays), e.g. to profile one phase of a program */
+static void
+ahd_debug_reset(void)
+{
+	int i;
+	for(i = 0; i < AHD_DEBUG_SITES; ++i) {
+		ahd_callsite *site = &ahd_debug_sites[i];
+		site->allocs = site->bytes_alloc = site->moves = site->bytes_moved = site->peak_cap = 0;
+		site->peak_live = site->live;
+	}
+}
+
+/* writes the callsites to f (stderr if 0), most bytes allocated first,
+ * as a table or, if csv is nonzero, as CSV with a header row */
+static void
+ahd_debug_dump(FILE *f, int csv)
+{
+	int order[AHD_DEBUG_SITES], n = 0, i, j;
+	if(! f)
+	{ f = stderr; }
+	for(i = 0; i < AHD_DEBUG_SITES; ++i) {
+		if(! ahd_debug_sites[i].file)
+		{ continue; }
+		for(j = n++; j > 0 && ahd_debug_sites[order[j-1]].bytes_alloc < ahd_debug_sites[i].bytes_alloc; --j)
+		{ order[j] = order[j-1]; }
+		order[j] = i;
+	}
+
+	if(csv) { fprintf(f, "file,line,func,allocs,bytes_alloc,moves,bytes_moved,peak_cap,live,peak_live,call\n"); }
+	else    { fprintf(f, "%-32s %-20s %10s %14s %8s %14s %12s %8s %9s  %s\n", "callsite", "func",
+	                  "allocs", "bytes_alloc", "moves", "bytes_moved", "peak_cap", "live", "peak_live", "call"); }
+	for(i = 0; i < n; ++i) {
+		ahd_callsite const *site = &ahd_debug_sites[order[i]];
+		if(csv) {
+			char const *c;
+			fprintf(f, "%s,%d,%s,%llu,%llu,%llu,%llu,%llu,%llu,%llu,\"", site->file, site->line, site->func,
+			        site->allocs, site->bytes_alloc, site->moves, site->bytes_moved, site->peak_cap,
+			        site->live, site->peak_live);
+			for(c = site->call; *c; ++c) { /* double any quotes in the call text */
+				if(*c == '"') { fputc('"', f); }
+				fputc(*c, f);
+			}
+			fprintf(f, "\"\n");
+		}
+		else {
+			char where[512];
+			snprintf(where, sizeof(where), "%s:%d", site->file, site->line);
+			fprintf(f, "%-32s %-20s %10llu %14llu %8llu %14llu %12llu %8llu %9llu  %s\n", where, site->func,
+			        site->allocs, site->bytes_alloc, site->moves, site->bytes_moved, site->peak_cap,
+			        site->live, site->peak_live, site->call);
+		}
+	}
+}
+
+static int ahd__dbg_dump_csv = -1;
+static void ahd__dbg_dump_exit(void) { ahd_debug_dump(0, ahd__dbg_dump_csv); }
+
+/* dump to stderr when the program exits (once, however many times this is called) */
+static void
+ahd_debug_dump_at_exit(int csv)
+{
+	if(ahd__dbg_dump_csv < 0)
+	{ atexit(ahd__dbg_dump_exit); }
+	ahd__dbg_dump_csv = !! csv;
+}
+#endif//AHD_DEBUG
+
+/* Packed arrays (ahd_PACKED) share one allocation, which starts with this and
+ * is freed with the last of them. Each has a pointer to it just before its header.
+ */
+typedef struct ahd__packblock {
+	void   *raw; /* the allocation, for AHD_FREE */
+	ahd_int refs;
+} ahd__packblock;
+#define ahd__packblockof(head) (((ahd__packblock **)(head))[-1])
+
+static void
+ahd__free(void *ptr)
+{
+	ahd_arr *head = (ahd_arr *)ptr;
+	ahd_allocator const *alloc;
+	char *raw;
+	if(! head || (head->cap & ahd__flag(ahd_INLINE)))
+	{ return; }
+#if AHD_DEBUG
+	ahd__dbg_freed(head);
+#endif//AHD_DEBUG
+	if(head->cap & ahd__flag(ahd_PACKED)) {
+		ahd__packblock *block = ahd__packblockof(head);
+		if(! --block->refs)
+		{ AHD_FREE(block->raw); }
+		return;
+	}
+	alloc = ahd__allocof(head);
+	raw   = (char *)head - ahd__padof(head);
+	if(alloc) { alloc->free(alloc->data, raw); }
+	else      { AHD_FREE(raw); }
+}
+
+
 /******************************************************************************/
 /* Adding elements ************************************************************/
 /******************************************************************************/
-#define ahd_push(ht,a,v)      (ahd_maybegrow(ht,a,1), (a)[ahd__len(ht,a)++] = (v), ahd__len(ht,a)-1)
-#define ahd_add(ht,a,n)       ((ahd_maybegrow(ht,a,n), ahd__len(ht,a)+=(n)) - (n))
+#define ahd_push(ht,a,v)      (ahd__maybeappend(ht,a,1), (a)[ahd__len(ht,a)++] = (v), ahd__len(ht,a)-1)
+#define ahd_add(ht,a,n)       ((ahd__maybeappend(ht,a,n), ahd__len(ht,a)+=(n)) - (n))
 #define ahd_concat(ht,a,b)        ahd__pushsize(ht, a, b,   ahd_len(ht, b),             ahd_size(ht,b))
 #define ahd_pusharr(ht,a,arr,els) ahd__pushsize(ht, a, arr, els,                        (els)*sizeof(*(a)) )
 #define ahd_pushptr(ht,a,ptr,els) ahd__pushsize(ht, a, ptr, els,                        (els)*sizeof(*(a)) )
@@ -351,52 +1007,168 @@ typedef struct ahd_ts {
 
 #define ahd__pushsize(ht,a,src,len,size) (AHD_MEMMOVE((a)+ahd_add(ht,a,len), (src), (size)), ahd__len(ht,a)-(len))
 
-#define ahd_insert(ht,a,i,v)  (ahd_add(ht,a,1),\
+#define ahd_insert(ht,a,i,v)  (ahd_maybegrow(ht,a,1), ++ahd__len(ht,a),\
 	                           AHD_MEMMOVE((a)+(i)+1, (a)+(i), (ahd__len(ht,a)-(i)-1) * sizeof(*(a)) ),\
 	                           (a)[(i)] = (v), (i) )
 
-/*TODO: #define ahd_push_ts(ht,a,v)   do{ \
-	(ahd_maybegrow(ht,a,1), (a)[ahd__len(ht,a)++] = (v), ahd__len(ht,a)-1)} while(0)*/
+/* Thread-safe push, for a header with an ahd_t(ts), from any number of threads.
+ * Pushers claim slots with an atomic add on len while there is capacity; the
+ * thread that claims the first slot past it grows the array into a new block
+ * once the others have written their values. Old blocks are kept until
+ * ahd_free_ts, as other threads may still be looking at them.
+ * While shared, use only the _ts operations; build the array with them from
+ * empty (or ahd_reserve), as ts.written has to match len.
+ */
+#define ahd_push_ts(ht,a,v)   do { \
+		ahd_int ahd_i_ln = ahd__claim_ts((void **)&(a), sizeof(ht), sizeof(*(a)), AHD_ALIGNOF(ht), offsetof(ht, ts)); \
+		(a)[ahd_i_ln] = (v); \
+		ahd__atomic_add(&ahd_hdr(ht,a)->ts.written, (ahd_int)1); \
+	} while(0)
+
+// exact capacity changes: these never allocate more than asked for
+#define ahd_changecap(ht,a,n) (*((void **)&(a)) = ahd__setcap(ahd_if(a, ahd_hdr(ht,a)), (n), \
+			                  sizeof(*(a)), sizeof(ht), AHD_ALIGNOF(ht)))
+#define ahd_reserve(ht,a,n)   ahd_if((a)==0 || ahd__cap(ht,a) < (n), ahd_changecap(ht,a,n))
+#define ahd_expand(ht,a,n)    ahd_reserve(ht,a,ahd_len(ht,a)+(n))
+#define ahd_shrink(ht,a)      ahd_if(a, ahd_changecap(ht,a,ahd__len(ht,a)))
+
+// batch building: once there is space for them (e.g. from ahd_reserve), push without checking for growth
+#define ahd__push(ht,a,v)     ((a)[ahd__bc(ahd__cap(ht,a), ahd__len(ht,a))] = (v), ahd__len(ht,a)++)
 
 #define ahd_needgrow(ht,a,n)  ((a)==0 || ahd__len(ht,a)+(n) > ahd__cap(ht,a))
 #define ahd_maybegrow(ht,a,n) ahd_if(ahd_needgrow(ht,a,(n)), ahd_grow(ht,a,n))
 #define ahd_grow(ht,a,n)      (*((void **)&(a)) = ahd__grow(ahd_if(a, ahd_hdr(ht,a)), (n), \
-			                  sizeof(*(a)), sizeof(ht)))
+			                  sizeof(*(a)), sizeof(ht), AHD_ALIGNOF(ht)))
+// growth for appending (push/add): the only growth that spills (see ahd_setspill)
+#define ahd__maybeappend(ht,a,n) ahd_if(ahd_needgrow(ht,a,(n)), \
+	(*((void **)&(a)) = ahd__append(ahd_if(a, ahd_hdr(ht,a)), (n), sizeof(*(a)), sizeof(ht), AHD_ALIGNOF(ht))))
+
+// uses policy for this array, which must have an ahd_t(policy) directly after its ahd_t(arr)
+#define ahd_setgrowth(ht,a,g) \
+	((void)sizeof(char[offsetof(ht, policy) == sizeof(ahd_arr) ? 1 : -1]), \
+	 ahd__setgrowth((void **)&(a), sizeof(ht), sizeof(*(a)), AHD_ALIGNOF(ht), g))
+// moves a to memory from alloc (creating it if NULL); 0 moves it back to AHD_REALLOC
+#define ahd_setalloc(ht,a,alloc) \
+	((void)sizeof(char[offsetof(ht, policy) == sizeof(ahd_arr) ? 1 : -1]), \
+	 ahd__setalloc((void **)&(a), sizeof(ht), sizeof(*(a)), AHD_ALIGNOF(ht), alloc))
+#define ahd_setarena(ht,a,arena) ahd_setalloc(ht,a,ahd_arena_allocator(arena))
+
+/* Small-buffer arrays: storage for a header and n elements, to embed in a
+ * struct or put on the stack, so that small arrays need no allocation at all.
+ * ahd_inlineinit makes a an empty array in it (flagged ahd_INLINE); it's then
+ * used like any other, until it needs more than n elements (or its capacity is
+ * changed) and is copied out to the heap (or its policy's allocator), policy
+ * and all. Freeing it only frees the heap copy, if there is one. The storage mustn't move (or go out of scope) while a is
+ * still in it.
+ *
+ * typedef struct node {
+ *     struct node **children;
+ *     ahd_inline(ahd_arr, struct node *, 8) children_buf;
+ * } node;
+ * ahd_inlineinit(ahd_arr, n->children, &n->children_buf);
+ * arr_push(n->children, child);
+ */
+#define ahd_inline(ht,t,n)       struct { ht ahd_inline_hdr; t ahd_inline_els[n]; }
+#define ahd_inlineinit(ht,a,buf) (*((void **)&(a)) = ahd__inlineinit((buf)->ahd_inline_els, sizeof(ht), \
+                                  AHD_ALIGNOF(ht), sizeof((buf)->ahd_inline_els) / sizeof(*(a))))
+
+#ifndef  AHD_GROW_NUM
+# define AHD_GROW_NUM       2
+#endif// AHD_GROW_NUM
+#ifndef  AHD_GROW_DEN
+# define AHD_GROW_DEN       1
+#endif// AHD_GROW_DEN
+#ifndef  AHD_GROW_MIN_BYTES
+# define AHD_GROW_MIN_BYTES 64
+#endif// AHD_GROW_MIN_BYTES
+#ifndef  AHD_GROW_ROUND
+# define AHD_GROW_ROUND     0
+#endif// AHD_GROW_ROUND
+
+/* used by arrays without their own policy; can be changed at runtime */
+static ahd_growth ahd_growth_default = { AHD_GROW_NUM, AHD_GROW_DEN, AHD_GROW_MIN_BYTES, AHD_GROW_ROUND };
+
+#ifdef AHD_GROW_STATS
+typedef struct ahd_growstats {
+	ahd_int reallocs;    /* reallocations by ahd__grow/ahd__setcap */
+	ahd_int bytes_moved; /* bytes in use when growing: what realloc may have to copy */
+	ahd_int bytes_spare; /* bytes beyond what was needed, summed over each grow */
+} ahd_growstats;
+static ahd_growstats ahd_grow_stats;
+#endif/*AHD_GROW_STATS*/
+
+// the growth policy for the array with this header
+#define ahd__growthof(head) (((head)->cap & ahd__flag(ahd_POLICY)) && ((ahd_policy *)((head) + 1))->growth \
+                             ? ((ahd_policy *)((head) + 1))->growth : &ahd_growth_default)
+
+static ahd_int
+ahd__growcap(ahd_growth const *g, ahd_int cap, ahd_int needed, ahd_int el_size, ahd_int hdr_size)
+{
+	ahd_int new_cap = cap / g->den * g->num + cap % g->den * g->num / g->den;
+	ahd_int min_cap = el_size ? (g->min_bytes + el_size - 1) / el_size : 0;
+	new_cap = ahd__max(new_cap, ahd__max(needed, min_cap));
+	if(g->round && el_size) {
+		ahd_int bytes = hdr_size + new_cap * el_size, rounded = 1;
+		if(bytes < g->round)
+		{ while(rounded < bytes) { rounded <<= 1; } }
+		else
+		{ rounded = (bytes + g->round - 1) / g->round * g->round; }
+		new_cap = (rounded - hdr_size) / el_size;
+	}
+	return new_cap;
+}
 
 #if AHD_DEBUG // control whether callsite is recorded
 # define AHD_DBG(fn, ...) fn##_dbg(__VA_ARGS__, int line, char const *file, char const *func, char const *call)
 
 # define ahd__grow(...) ahd__grow_dbg(__VA_ARGS__, __LINE__, __FILE__, __func__, "ahd__grow("#__VA_ARGS__")")
-
-# define AHD_DBG_UNUSED (void)line, (void)file, (void)func, (void)call
+# define ahd__append(...) ahd__append_dbg(__VA_ARGS__, __LINE__, __FILE__, __func__, "ahd__append("#__VA_ARGS__")")
+# define ahd__setcap(...) ahd__setcap_dbg(__VA_ARGS__, __LINE__, __FILE__, __func__, "ahd__setcap("#__VA_ARGS__")")
+# define ahd__dup(...) ahd__dup_dbg(__VA_ARGS__, __LINE__, __FILE__, __func__, "ahd__dup("#__VA_ARGS__")")
+
+// resize, counting it against the callsite passed to the _dbg function it's used in
+# define AHD_DBG_RESIZE(...) ahd__dbg_resize(__VA_ARGS__, line, file, func, call)
+# define AHD_DBG_GROW(...) ahd__grow_dbg(__VA_ARGS__, line, file, func, call)
+# define AHD_DBG_SITE ahd__dbg_site(line, file, func, call)
 #else //AHD_DEBUG
 # define AHD_DBG(fn, ...) fn(__VA_ARGS__)
 
 # define ahd__grow(...) ahd__grow(__VA_ARGS__)
+# define ahd__append(...) ahd__append(__VA_ARGS__)
+# define ahd__setcap(...) ahd__setcap(__VA_ARGS__)
+# define ahd__dup(...) ahd__dup(__VA_ARGS__)
 
-# define AHD_DBG_UNUSED
+# define AHD_DBG_RESIZE(...) ahd__resize(__VA_ARGS__)
+# define AHD_DBG_GROW(...) ahd__grow(__VA_ARGS__)
 #endif//AHD_DEBUG
 
-// TODO: should this be arr ptr, rather than base?
+/* reallocates the array with header ptr (or a new one with these flags if NULL) to hold
+ * exactly cap items, keeping its flags; returns the new array */
 static void *
-AHD_DBG(ahd__grow, void *ptr, ahd_int inc, ahd_int itemsize, ahd_int headersize)//, int cap, int len)
-// TODO: static int ahd__grow(void **ptr, ahd_int inc, ahd_int itemsize, ahd_int headersize)//, int cap, int len)
+ahd__resize(void *ptr, ahd_int flags, ahd_int cap, ahd_int itemsize, ahd_int headersize)
 {
-    AHD_DBG_UNUSED;
-	ahd_arr *head      = (ahd_arr *)ptr;
-	ahd_int dbl_cap    = ahd_if(ptr, head->cap  * 2);
-	ahd_int min_needed = ahd_if(ptr, head->len) + inc;
-	min_needed         = (min_needed > 64) ? min_needed : 64;
-	ahd_int new_cap    = (dbl_cap > min_needed) ? dbl_cap   : min_needed; // could round to next highest pow2?
-	head               = (ahd_arr *) AHD_REALLOC(ptr, itemsize * new_cap + headersize);
-	if (head) {
-		if (!ptr) {
-			char *hdr_bytes = ((char *)&head->len) - 1,
-				 *hdr_guard = ((char *)head) + headersize;
-			while(++hdr_bytes < hdr_guard)
-			{ *hdr_bytes = 0; } /* zero init for any size header */
+	ahd_arr *head = (ahd_arr *)ptr;
+#ifdef AHD_GROW_STATS
+	ahd_grow_stats.reallocs    += 1;
+	ahd_grow_stats.bytes_moved += ahd_if(ptr, head->len) * itemsize;
+#endif/*AHD_GROW_STATS*/
+	if(ptr && (head->cap & AHD__BORROWED)) { /* not ours to realloc: copy it out, keeping its policy */
+		ahd_arr *packed = head;
+		head = ahd__hdralloc(ahd__allocof(packed), ahd__copyflags(packed->cap), itemsize * cap + headersize, headersize);
+		if(head) {
+			AHD_MEMCPY(head + 1, packed + 1, headersize - sizeof(ahd_arr) + itemsize * ahd__min(packed->len, cap));
+			head->len = packed->len;
+			ahd__free(packed);
 		}
-		head->cap = new_cap;
+	}
+	else {
+		head = ptr ? ahd__hdrrealloc(head, itemsize * (head->cap & AHD_CAP_MASK) + headersize, itemsize * cap + headersize, headersize)
+		           : ahd__hdralloc(0, flags, itemsize * cap + headersize, headersize);
+	}
+	if (head) {
+		head->cap = cap | (head->cap & ~AHD_CAP_MASK);
+		if(head->len > cap)
+		{ head->len = cap; }
 		return (char *)head + headersize;
 	}
 	else {
@@ -407,6 +1179,361 @@ AHD_DBG(ahd__grow, void *ptr, ahd_int inc, ahd_int itemsize, ahd_int headersize)
 	}
 }
 
+#if AHD_DEBUG
+static void *
+ahd__dbg_resize(void *ptr, ahd_int flags, ahd_int cap, ahd_int itemsize, ahd_int headersize,
+                int line, char const *file, char const *func, char const *call)
+{
+	ahd_arr *head     = (ahd_arr *)ptr;
+	ahd_int old_size  = ptr ? (head->cap & AHD_CAP_MASK) * itemsize + headersize : 0,
+	        new_size  = cap * itemsize + headersize;
+	int site_i        = ahd__dbg_site(line, file, func, call);
+	char *arr         = (char *)ahd__resize(ptr, flags, cap, itemsize, headersize);
+	ahd_callsite *site = &ahd_debug_sites[site_i];
+	if((uintptr_t)arr == (uintptr_t)headersize)
+	{ return arr; } /* out of memory; ptr is unchanged */
+
+	if(! ptr)
+	{ ahd__dbg_created(site_i, arr - headersize, new_size, new_size - headersize); }
+	else {
+		site->allocs      += 1;
+		site->bytes_alloc += new_size;
+		site->peak_cap     = ahd__max(site->peak_cap, new_size - headersize);
+		if(arr - headersize != (char *)ptr) {
+			site->moves       += 1;
+			site->bytes_moved += ahd__min(old_size, new_size);
+			ahd__dbg_moved(ptr, arr - headersize);
+		}
+	}
+	return arr;
+}
+#endif//AHD_DEBUG
+
+// the spill for the array with this header, if it has one
+#define ahd__spillof(head) (((head)->cap & ahd__flag(ahd_POLICY)) ? ((ahd_policy *)((head) + 1))->spill : 0)
+static void *ahd__spill(ahd_arr *head, ahd_int itemsize, ahd_int headersize);
+
+// TODO: should this be arr ptr, rather than base?
+// align: of the header type, used when creating the array
+static void *
+AHD_DBG(ahd__grow, void *ptr, ahd_int inc, ahd_int itemsize, ahd_int headersize, ahd_int align)//, int cap, int len)
+// TODO: static int ahd__grow(void **ptr, ahd_int inc, ahd_int itemsize, ahd_int headersize)//, int cap, int len)
+{
+	ahd_arr *head      = (ahd_arr *)ptr;
+	ahd_growth const *growth;
+	ahd_int min_needed, new_cap;
+	growth     = ptr ? ahd__growthof(head) : &ahd_growth_default;
+	min_needed = ahd_if(ptr, head->len) + inc;
+	new_cap    = ahd__growcap(growth, ahd_if(ptr, head->cap & AHD_CAP_MASK), min_needed, itemsize, headersize);
+#ifdef AHD_GROW_STATS
+	ahd_grow_stats.bytes_spare += (new_cap - min_needed) * itemsize;
+#endif/*AHD_GROW_STATS*/
+	return AHD_DBG_RESIZE(ptr, ahd__alignflags(align), new_cap, itemsize, headersize);
+}
+
+// as ahd__grow, but a spilling array that's full is written out and started again instead
+static void *
+AHD_DBG(ahd__append, void *ptr, ahd_int inc, ahd_int itemsize, ahd_int headersize, ahd_int align)
+{
+	ahd_arr *head = (ahd_arr *)ptr;
+	if(ptr && head->len && ahd__spillof(head)) {
+		char *arr = (char *)ahd__spill(head, itemsize, headersize);
+		ptr = arr - headersize;
+		if(inc <= (((ahd_arr *)ptr)->cap & AHD_CAP_MASK))
+		{ return arr; }
+	}
+	return AHD_DBG_GROW(ptr, inc, itemsize, headersize, align);
+}
+
+// exactly cap items, not rounded or grown by the array's policy; len is cut to fit
+static void *
+AHD_DBG(ahd__setcap, void *ptr, ahd_int cap, ahd_int itemsize, ahd_int headersize, ahd_int align)
+{
+	return AHD_DBG_RESIZE(ptr, ahd__alignflags(align), cap, itemsize, headersize);
+}
+
+static void
+ahd__setgrowth(void **arr, ahd_int hdr_size, ahd_int el_size, ahd_int align, ahd_growth const *growth)
+{
+	ahd_arr *head;
+	if(! *arr) /* start with no capacity, so the first grow follows the policy */
+	{ *arr = ahd__resize(0, ahd__alignflags(align), 0, el_size, hdr_size); }
+	head = (ahd_arr *)((char *)*arr - hdr_size);
+	((ahd_policy *)(head + 1))->growth = growth;
+	head->cap |= ahd__flag(ahd_POLICY);
+	if(! (head->cap & AHD_CAP_MASK))
+	{ *arr = ahd__grow(head, 0, el_size, hdr_size, 0); }
+}
+
+/* moves the array to memory from alloc (or AHD_REALLOC if alloc is 0) */
+static void
+ahd__setalloc(void **arr, ahd_int hdr_size, ahd_int el_size, ahd_int align, ahd_allocator const *alloc)
+{
+	ahd_arr *head = *arr ? (ahd_arr *)((char *)*arr - hdr_size) : 0, *new_head;
+	ahd_int size  = hdr_size + ahd_if(head, (head->cap & AHD_CAP_MASK) * el_size);
+	if(head && (head->cap & ahd__flag(ahd_POLICY)) && ((ahd_policy *)(head + 1))->alloc == alloc)
+	{ return; }
+
+	new_head = ahd__hdralloc(alloc, head ? ahd__copyflags(head->cap) : ahd__alignflags(align), size, hdr_size);
+	if(! new_head) {
+#ifdef AHD_BUFFER_OUT_OF_MEMORY
+		AHD_BUFFER_OUT_OF_MEMORY ;
+#endif
+		return;
+	}
+	if(head) {
+		AHD_MEMCPY(new_head, head, size);
+		new_head->cap &= ~AHD__BORROWED;
+#if AHD_DEBUG
+		ahd__dbg_moved(head, new_head);
+#endif//AHD_DEBUG
+		ahd__free(head);
+	}
+	((ahd_policy *)(new_head + 1))->alloc = alloc;
+	new_head->cap |= ahd__flag(ahd_POLICY);
+	*arr = (char *)new_head + hdr_size;
+}
+
+/* File-backed arrays: define AHD_MMAP to keep an array in a memory-mapped file.
+ * The file is the header plus the elements, so reopening it gives back the
+ * array as it was (len, cap and contents) in O(1), with the OS paging the
+ * elements in as they're used. Growing resizes the file (ftruncate + mremap,
+ * or remapping where there's no mremap). The header needs an ahd_t(policy)
+ * directly after ahd_t(arr), as for ahd_setalloc, and must be the same type
+ * each time the file is opened; elements should be plain data (no pointers).
+ * One array per file: copies of it (ahd_dup, ahd_sub, ...) go on the heap.
+ * ahd_free unmaps and closes the file as ahd_mapclose does, leaving the array
+ * in it; to empty the file, ahd_clear and ahd_shrink the array first.
+ * The growth policy isn't kept: call ahd_setgrowth again after opening.
+ * On POSIX this needs ftruncate: compile as gnu C (or with _POSIX_C_SOURCE
+ * of at least 200112L defined before any includes).
+ *
+ * typedef struct record_file { ahd_t(arr); ahd_t(policy); } record_file;
+ * ahd_mapfile mf; record *recs;
+ * if(ahd_mapopen(record_file, recs, &mf, "records.bin")) {
+ *     ahd_push(record_file, recs, rec);
+ *     ahd_mapclose(record_file, recs, &mf);
+ * }
+ */
+#ifdef AHD_MMAP
+# ifdef _WIN32
+#  ifndef WIN32_LEAN_AND_MEAN
+#   define WIN32_LEAN_AND_MEAN
+#  endif
+#  include <windows.h>
+# else
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+# endif
+
+typedef struct ahd_mapfile {
+	ahd_allocator alloc; /* filled by ahd_mapopen */
+	char   *base;        /* the whole file, mapped */
+	ahd_int size;
+# ifdef _WIN32
+	HANDLE file, mapping;
+# else
+	int fd;
+# endif
+} ahd_mapfile;
+
+#define ahd_mapopen(ht,a,mf,path) \
+	((void)sizeof(char[offsetof(ht, policy) == sizeof(ahd_arr) ? 1 : -1]), \
+	 ahd__mapopen((void **)&(a), sizeof(ht), sizeof(*(a)), AHD_ALIGNOF(ht), mf, path))
+#define ahd_mapclose(ht,a,mf) (ahd__mapclose(mf), (a) = 0)
+
+/* maps the first size bytes of the file (which must be that long); 0 unmaps */
+static int
+ahd__mapview(ahd_mapfile *mf, ahd_int size)
+{
+# ifdef _WIN32
+	if(mf->base)    { UnmapViewOfFile(mf->base); mf->base = 0; }
+	if(mf->mapping) { CloseHandle(mf->mapping); mf->mapping = 0; }
+	mf->size = 0;
+	if(! size)
+	{ return 1; }
+	mf->mapping = CreateFileMappingA(mf->file, 0, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, 0);
+	if(! mf->mapping)
+	{ return 0; }
+	mf->base = (char *)MapViewOfFile(mf->mapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)size);
+	if(! mf->base)
+	{ CloseHandle(mf->mapping); mf->mapping = 0; return 0; }
+# else
+	void *base = MAP_FAILED;
+	if(mf->base && size) {
+#  ifdef MREMAP_MAYMOVE /* Linux (with _GNU_SOURCE): grow in place if possible, without unmapping */
+		base = mremap(mf->base, mf->size, size, MREMAP_MAYMOVE);
+		if(base != MAP_FAILED)
+		{ mf->base = (char *)base, mf->size = size; return 1; }
+#  endif
+	}
+	if(mf->base)
+	{ munmap(mf->base, mf->size); mf->base = 0, mf->size = 0; }
+	if(! size)
+	{ return 1; }
+	base = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, mf->fd, 0);
+	if(base == MAP_FAILED)
+	{ return 0; }
+	mf->base = (char *)base;
+# endif
+	mf->size = size;
+	return 1;
+}
+
+/* sets the file's length to size bytes and maps all of it */
+static int
+ahd__mapresize(ahd_mapfile *mf, ahd_int size)
+{
+	ahd_int old_size = mf->size;
+# ifdef _WIN32
+	LARGE_INTEGER end;
+	if(size < old_size) { /* a file can't be cut while it's mapped; mapping it longer extends it */
+		ahd__mapview(mf, 0);
+		end.QuadPart = (LONGLONG)size;
+		if(! SetFilePointerEx(mf->file, end, 0, FILE_BEGIN) || ! SetEndOfFile(mf->file))
+		{ ahd__mapview(mf, old_size); return 0; }
+	}
+	if(ahd__mapview(mf, size))
+	{ return 1; }
+	ahd__mapview(mf, old_size); /* put back what was there */
+	return 0;
+# else
+	if(size > old_size && ftruncate(mf->fd, (off_t)size) != 0)
+	{ return 0; }
+	if(! ahd__mapview(mf, size)) {
+		ahd__mapview(mf, old_size);
+		if(size > old_size) { (void)! ftruncate(mf->fd, (off_t)old_size); }
+		return 0;
+	}
+	if(size < old_size)
+	{ (void)! ftruncate(mf->fd, (off_t)size); }
+	return 1;
+# endif
+}
+
+/* unmaps and closes the file, keeping the array in it */
+static void
+ahd__mapclose(ahd_mapfile *mf)
+{
+	ahd__mapview(mf, 0);
+# ifdef _WIN32
+	if(mf->file && mf->file != INVALID_HANDLE_VALUE)
+	{ CloseHandle(mf->file); }
+	mf->file = 0;
+# else
+	if(mf->fd >= 0)
+	{ close(mf->fd); }
+	mf->fd = -1;
+# endif
+}
+
+static void *
+ahd__mmap_realloc(void *data, void *ptr, ahd_int old_size, ahd_int size)
+{
+	ahd_mapfile *mf = (ahd_mapfile *)data;
+	(void)old_size;
+	if(! ptr && mf->base)
+	{ return 0; } /* the file already holds its array */
+	return ahd__mapresize(mf, size) ? mf->base : 0;
+}
+static void ahd__mmap_free(void *data, void *ptr)
+{ (void)ptr; ahd__mapclose((ahd_mapfile *)data); }
+
+/* opens (creating if needed) the file at path as the array *arr; 0 if it
+ * can't be opened, or doesn't hold an array of this header and element size */
+static int
+ahd__mapopen(void **arr, ahd_int hdr_size, ahd_int el_size, ahd_int align, ahd_mapfile *mf, char const *path)
+{
+	ahd_int size, align_bytes = ahd__alignof(ahd__alignflags(align));
+	ahd_arr *head;
+	AHD_MEMSET(mf, 0, sizeof(*mf));
+	mf->alloc.realloc = ahd__mmap_realloc;
+	mf->alloc.free    = ahd__mmap_free;
+	mf->alloc.data    = mf;
+	*arr = 0;
+# ifdef _WIN32
+	{
+		LARGE_INTEGER file_size;
+		mf->file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, 0, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+		if(mf->file == INVALID_HANDLE_VALUE)
+		{ return 0; }
+		if(! GetFileSizeEx(mf->file, &file_size))
+		{ CloseHandle(mf->file); return 0; }
+		size = (ahd_int)file_size.QuadPart;
+	}
+# else
+	{
+		struct stat st;
+		mf->fd = open(path, O_RDWR | O_CREAT, 0644);
+		if(mf->fd < 0)
+		{ return 0; }
+		if(fstat(mf->fd, &st) != 0)
+		{ close(mf->fd); return 0; }
+		size = (ahd_int)st.st_size;
+	}
+# endif
+
+	if(! size) { /* a new array, allocated from the file from the start */
+		ahd__setalloc(arr, hdr_size, el_size, align, &mf->alloc);
+		if(*arr)
+		{ return 1; }
+	}
+	else if(size >= hdr_size + align_bytes && ahd__mapview(mf, size)) {
+		/* mappings are page-aligned, so the header is where it was when the file was written */
+		head = ahd__align(mf->base, 0, 0, hdr_size, align_bytes);
+		if(ahd__flag(ahd_POLICY) == (head->cap & ahd__flag(ahd_POLICY)) &&
+		   ahd__alignof(head->cap) == align_bytes && head->len <= (head->cap & AHD_CAP_MASK) &&
+		   (ahd_int)((char *)head - mf->base) + hdr_size + (head->cap & AHD_CAP_MASK) * el_size <= size)
+		{
+			((ahd_policy *)(head + 1))->alloc  = &mf->alloc;
+			((ahd_policy *)(head + 1))->growth = 0; /* the pointers are from another run */
+			((ahd_policy *)(head + 1))->spill  = 0;
+			*arr = (char *)head + hdr_size;
+			return 1;
+		}
+	}
+	ahd__mapclose(mf);
+	return 0;
+}
+
+/* writes the array's changes out to the file (the OS does so anyway, eventually) */
+static int
+ahd_mapsync(ahd_mapfile *mf)
+{
+	if(! mf->base)
+	{ return 1; }
+# ifdef _WIN32
+	return FlushViewOfFile(mf->base, 0) && FlushFileBuffers(mf->file);
+# else
+	return msync(mf->base, mf->size, MS_SYNC) == 0;
+# endif
+}
+
+/* the allocator for a copy of the array with this header: the file holds
+ * just the one array, so copies of a file-backed array go on the heap */
+static ahd_allocator const *
+ahd__copyalloc(ahd_arr const *head)
+{
+	ahd_allocator const *alloc = ahd__allocof(head);
+	return alloc && alloc->realloc == ahd__mmap_realloc ? 0 : alloc;
+}
+#else
+# define ahd__copyalloc(head) ahd__allocof(head)
+#endif/*AHD_MMAP*/
+
+/* the element storage follows the header in the buffer, but may be padded away from
+ * it; either way there is room for the header just before the elements */
+static void *
+ahd__inlineinit(void *els, ahd_int hdr_size, ahd_int align, ahd_int n)
+{
+	ahd_arr *head = (ahd_arr *)((char *)els - hdr_size);
+	AHD_MEMSET(head, 0, hdr_size);
+	head->cap = n | ahd__alignflags(align) | ahd__flag(ahd_INLINE); /* copies keep the alignment */
+	return els;
+}
+
 #if 1
 static ahd_int
 ahd__pushstr(char **arr, ahd_int hdr_size, ahd_int el_size, char *str, ahd_int n)
@@ -417,8 +1544,8 @@ ahd__pushstr(char **arr, ahd_int hdr_size, ahd_int el_size, char *str, ahd_int n
 	char *str_ = str;
 	while(*(str_++) && (!~n || n--)) {++strLen;}
 
-	if(head->len + strLen + 1 >= head->cap)
-	{ *arr = (char *)ahd__grow(*arr-hdr_size, strLen + 1, el_size, hdr_size); }
+	if(head->len + strLen + 1 >= (head->cap & AHD_CAP_MASK))
+	{ *arr = (char *)ahd__grow(*arr-hdr_size, strLen + 1, el_size, hdr_size, 0); }
 
 	AHD_MEMMOVE(*arr + len, str, strLen);
 
@@ -433,6 +1560,9 @@ ahd__pushstr(char **arr, ahd_int hdr_size, ahd_int el_size, char *str, ahd_int n
 /* Removing elements **********************************************************/
 /******************************************************************************/
 #define ahd_pop(ht,a)         ((a)[--ahd__len(ht,a)])
+// thread-safe pop into *out (see ahd_push_ts); returns 0 if the array was empty
+#define ahd_pop_ts(ht,a,out)  ((void)sizeof(*(out) = *(a)), \
+                               ahd__pop_ts((void **)&(a), sizeof(ht), sizeof(*(a)), offsetof(ht, ts), out))
 #define ahd_shift(ht,a)       ahd_pull(ht,a,0)
 #define ahd_clear(ht,a)       ahd_if(a, ahd__len(ht,a) = 0)
 #define ahd_resetlen(ht,a,n)  (ahd_clear(ht,a), ahd_add(ht,a,n))
@@ -458,17 +1588,21 @@ ahd__pushstr(char **arr, ahd_int hdr_size, ahd_int el_size, char *str, ahd_int n
 #define ahd_last(ht,a)        ((a)[ahd__len(ht,a)-1])
 
 #define ahd_hdr(ht, a)        ((ht *)(a) - 1)
+// the ahd_t(arr) at the start of any header
+#define ahd__arr(ht, a)       ((ahd_arr *)ahd_hdr(ht,a))
 
 // these don't check if array is non-NULL
-#define ahd__len(ht,a)          (ahd_hdr(ht,a)->len)
-#define ahd__cap(ht,a)          (ahd_hdr(ht,a)->cap)
+#define ahd__len(ht,a)          (ahd__arr(ht,a)->len)
+#define ahd__cap(ht,a)          (ahd__arr(ht,a)->cap & AHD_CAP_MASK)
 #define ahd__size(ht,a)         (ahd__len(ht,a) * sizeof(*(a)) )
 #define ahd__capsize(ht,a)      (ahd__cap(ht,a) * sizeof(*(a)) )
 #define ahd__totalsize(ht,a)    (ahd__len(ht,a) * sizeof(*(a)) + sizeof(ht) )
 #define ahd__totalcapsize(ht,a) (ahd__cap(ht,a) * sizeof(*(a)) + sizeof(ht) )
 
 // sets the array back to NULL, so any attempts to access contents fail, or the array can be pushed to again
-#define ahd_free(ht,a)        (ahd_if(a, (AHD_FREE(ahd_hdr(ht,a)),0)), (a) = 0)
+#define ahd_free(ht,a)        (ahd_if(a, (ahd__free(ahd_hdr(ht,a)),0)), (a) = 0)
+// also frees the blocks left behind by ahd_push_ts; no other threads may be using a
+#define ahd_free_ts(ht,a)     (ahd__free_ts(ahd_if(a, ahd_hdr(ht,a)), offsetof(ht, ts)), (a) = 0)
 #define ahd_free2dt(ht,ht2,a)    do { \
 		for(ahd_int ahd_i_ln = 0; ahd_i_ln < ahd_len(ht,a); ++ahd_i_ln) \
 		{ ahd_free(ht2,(a)[ahd_i_ln]); } \
@@ -488,9 +1622,9 @@ static void ahd__free2d(void *outer, ahd_int el_size_outer, ahd_int hdr_size_out
 		for(; i < len; ++i, p += el_size_outer) {
 			char *p2 = *(char **)p;
 			if(p2)
-			{ AHD_FREE(p2 - hdr_size_inner); }
+			{ ahd__free(p2 - hdr_size_inner); }
 		}
-		AHD_FREE(head);
+		ahd__free(head);
 	}
 }
 #else
@@ -498,25 +1632,223 @@ static void ahd__free2d(void *outer, ahd_int el_size_outer, ahd_int hdr_size_out
 #endif// AHD_IMPLEMENTATION
 
 
-#define ahd_union(ht,a,b)
-#define ahd_intersection(ht,a,b)
-
-#define ahd_reverse(ht,a) ahd__reverse(ahd__data(ht,a))
-
-static void ahd__memswap(void *el_a, void *el_b, ahd_int size) {
-	char *a = (char *)el_a,
-		 *b = (char *)el_b;
-	for(;size--; ++a, ++b) {
-		char t = *a;
-		*a = *b;
-		*b = t;
-	}
+/******************************************************************************/
+/* Serialization **************************************************************/
+/******************************************************************************/
+/* A saved array is an ahd_blob followed by its elements, written and read with
+ * one fwrite/fread each. For arrays of arrays (ahd_save2d), the blob is
+ * followed by len+1 offsets (the index of each inner array's first element in
+ * the elements that follow, then the total), then all inner elements in order.
+ * The format is the machine's own byte order and ahd_int size; loading checks
+ * both, along with the element size. Elements should be plain data.
+ *
+ * Loads append to the array (which can be NULL) and return 0, leaving it as it
+ * was, if the file doesn't hold a matching array. ahd_load2d reads all of the
+ * inner arrays into one allocation: they're ahd_PACKED, so growing one copies
+ * it out, and ahd_free2d frees them as usual. They keep the inner header's
+ * alignment, as do copies of them, and a policy set on one moves with it when
+ * it's copied out. Null inner arrays load as empty.
+ */
+#include <stdio.h>
+
+#define AHD_BLOB_MAGIC   0x62646861u /* "ahdb" */
+#define AHD_BLOB_VERSION 1
+#define AHD_BLOB_ENDIAN  0x01020304u
+
+typedef enum ahd_blob_flag {
+	ahd_BLOB_2D = 1, /* an array of arrays, with an offsets table */
+} ahd_blob_flag;
+
+typedef struct ahd_blob {
+	unsigned int magic;    /* AHD_BLOB_MAGIC */
+	unsigned int version;  /* AHD_BLOB_VERSION when written */
+	unsigned int endian;   /* AHD_BLOB_ENDIAN, as written by this machine */
+	unsigned int flags;    /* ahd_blob_flag */
+	ahd_int      el_size;  /* for 2D arrays, of the inner elements */
+	ahd_int      hdr_size; /* of the header type it was saved from (for 2D, the inner one) */
+	ahd_int      len;      /* elements; for 2D, inner arrays */
+	ahd_int      total;    /* elements stored: len, or for 2D, all of the inner elements */
+} ahd_blob;
+
+#define ahd_save(ht,a,f)        ahd__save(a, sizeof(ht), sizeof(*(a)), f)
+#define ahd_load(ht,a,f)        ahd__load((void **)&(a), sizeof(ht), sizeof(*(a)), AHD_ALIGNOF(ht), f)
+#define ahd_save2dt(ht,ht2,a,f) ahd__save2d(a, sizeof(ht), sizeof(ht2), sizeof(**(a)), f)
+#define ahd_load2dt(ht,ht2,a,f) ahd__load2d((void **)&(a), sizeof(ht), AHD_ALIGNOF(ht), sizeof(ht2), AHD_ALIGNOF(ht2), \
+                                            sizeof(**(a)), f)
+#define ahd_save2d(ht,a,f)      ahd_save2dt(ht,ht,a,f)
+#define ahd_load2d(ht,a,f)      ahd_load2dt(ht,ht,a,f)
+
+static ahd_blob
+ahd__blob(unsigned int flags, ahd_int el_size, ahd_int hdr_size, ahd_int len, ahd_int total)
+{
+	ahd_blob blob;
+	AHD_MEMSET(&blob, 0, sizeof(blob));
+	blob.magic   = AHD_BLOB_MAGIC, blob.version  = AHD_BLOB_VERSION, blob.endian = AHD_BLOB_ENDIAN;
+	blob.flags   = flags;
+	blob.el_size = el_size,        blob.hdr_size = hdr_size;
+	blob.len     = len,            blob.total    = total;
+	return blob;
 }
 
-static void ahd__reverse(void *arr, ahd_int hdr_size, ahd_int el_size)
+/* reads a blob and checks that it can be loaded as flags with elements of el_size */
+static int
+ahd__readblob(FILE *f, ahd_blob *blob, unsigned int flags, ahd_int el_size)
+{
+	return fread(blob, sizeof(*blob), 1, f) == 1 &&
+	       blob->magic == AHD_BLOB_MAGIC && blob->version <= AHD_BLOB_VERSION && blob->endian == AHD_BLOB_ENDIAN &&
+	       blob->flags == flags && blob->el_size == el_size &&
+	       (flags & ahd_BLOB_2D || blob->total == blob->len);
+}
+
+static int
+ahd__save(void const *arr, ahd_int hdr_size, ahd_int el_size, FILE *f)
+{
+	ahd_int  len  = arr ? ((ahd_arr const *)((char const *)arr - hdr_size))->len : 0;
+	ahd_blob blob = ahd__blob(0, el_size, hdr_size, len, len);
+	return fwrite(&blob, sizeof(blob), 1, f) == 1 &&
+	       (! len || fwrite(arr, (size_t)(el_size * len), 1, f) == 1);
+}
+
+static int
+ahd__load(void **arr, ahd_int hdr_size, ahd_int el_size, ahd_int align, FILE *f)
+{
+	ahd_blob blob;
+	ahd_int  len, old_cap;
+	ahd_arr *head;
+	if(! ahd__readblob(f, &blob, 0, el_size))
+	{ return 0; }
+
+	head    = *arr ? (ahd_arr *)((char *)*arr - hdr_size) : 0;
+	len     = ahd_if(head, head->len);
+	old_cap = ahd_if(head, head->cap & AHD_CAP_MASK);
+	if(len + blob.len > old_cap) { /* exactly enough: this is often the whole array */
+		char *grown = (char *)ahd__resize(head, ahd__alignflags(align), len + blob.len, el_size, hdr_size);
+		if((uintptr_t)grown == (uintptr_t)hdr_size)
+		{ return 0; }
+		*arr = grown;
+		head = (ahd_arr *)(grown - hdr_size);
+	}
+	if(blob.len && fread((char *)*arr + len * el_size, (size_t)(el_size * blob.len), 1, f) != 1)
+	{ return 0; } /* still len long */
+	head->len = len + blob.len;
+	return 1;
+}
+
+static int
+ahd__save2d(void const *outer, ahd_int hdr_size_outer, ahd_int hdr_size_inner, ahd_int el_size, FILE *f)
+{
+	char * const *inner = (char * const *)outer;
+	ahd_int  n = outer ? ((ahd_arr const *)((char const *)outer - hdr_size_outer))->len : 0, i;
+	ahd_int *offsets = (ahd_int *)AHD_REALLOC(0, (n + 1) * sizeof(ahd_int));
+	ahd_blob blob;
+	int      ok;
+	if(! offsets)
+	{ return 0; }
+	for(offsets[0] = 0, i = 0; i < n; ++i)
+	{ offsets[i+1] = offsets[i] + (inner[i] ? ((ahd_arr *)(inner[i] - hdr_size_inner))->len : 0); }
+
+	blob = ahd__blob(ahd_BLOB_2D, el_size, hdr_size_inner, n, offsets[n]);
+	ok   = fwrite(&blob, sizeof(blob), 1, f) == 1 && fwrite(offsets, (size_t)((n + 1) * sizeof(ahd_int)), 1, f) == 1;
+	for(i = 0; ok && i < n; ++i) {
+		ahd_int len = offsets[i+1] - offsets[i];
+		ok = ! len || fwrite(inner[i], (size_t)(len * el_size), 1, f) == 1;
+	}
+	AHD_FREE(offsets);
+	return ok;
+}
+
+static int
+ahd__load2d(void **outer, ahd_int hdr_size_outer, ahd_int align_outer, ahd_int hdr_size_inner, ahd_int align_inner,
+            ahd_int el_size, FILE *f)
+{
+	ahd_blob blob;
+	ahd_int *offsets = 0, *at = 0, n, i, len, size, align = ahd__max(align_inner, (ahd_int)16);
+	char    *raw = 0, *base, **inner;
+	ahd_arr *head;
+	if(! ahd__readblob(f, &blob, ahd_BLOB_2D, el_size))
+	{ return 0; }
+	n = blob.len;
+
+	/* offsets, then (reusing the space) where each header goes in the block */
+	offsets = (ahd_int *)AHD_REALLOC(0, (n + 1) * sizeof(ahd_int) * 2);
+	if(! offsets || fread(offsets, (size_t)((n + 1) * sizeof(ahd_int)), 1, f) != 1 ||
+	   offsets[0] != 0 || offsets[n] != blob.total)
+	{ goto fail; }
+	at   = offsets + n + 1;
+	size = sizeof(ahd__packblock);
+	for(i = 0; i < n; ++i) {
+		if(offsets[i+1] < offsets[i])
+		{ goto fail; }
+		size += sizeof(ahd__packblock *);
+		at[i] = (size + hdr_size_inner + align - 1) / align * align - hdr_size_inner; /* elements aligned */
+		size  = at[i] + hdr_size_inner + (offsets[i+1] - offsets[i]) * el_size;
+	}
+
+	/* read all of the elements into the end of the block, then spread them out front to back:
+	 * each array's elements only move forwards, onto space that has already been moved from */
+	raw = (char *)AHD_REALLOC(0, size + align);
+	if(! raw)
+	{ goto fail; }
+	base = raw + (align - (uintptr_t)raw % align) % align;
+	if(blob.total && fread(base + size - blob.total * el_size, (size_t)(blob.total * el_size), 1, f) != 1)
+	{ goto fail; }
+
+	len  = ahd_if(*outer, ((ahd_arr *)((char *)*outer - hdr_size_outer))->len);
+	head = *outer ? (ahd_arr *)((char *)*outer - hdr_size_outer) : 0;
+	if(! head || len + n > (head->cap & AHD_CAP_MASK)) {
+		char *grown = (char *)ahd__resize(head, ahd__alignflags(align_outer), len + n, sizeof(char *), hdr_size_outer);
+		if((uintptr_t)grown == (uintptr_t)hdr_size_outer)
+		{ goto fail; }
+		*outer = grown;
+		head   = (ahd_arr *)(grown - hdr_size_outer);
+	}
+
+	((ahd__packblock *)base)->raw  = raw;
+	((ahd__packblock *)base)->refs = n;
+	inner = (char **)*outer + len;
+	for(i = 0; i < n; ++i) {
+		ahd_int   inner_len = offsets[i+1] - offsets[i];
+		ahd_arr  *inner_head = (ahd_arr *)(base + at[i]);
+		AHD_MEMMOVE((char *)inner_head + hdr_size_inner, base + size - (blob.total - offsets[i]) * el_size, inner_len * el_size);
+		AHD_MEMSET(inner_head, 0, hdr_size_inner);
+		ahd__packblockof(inner_head) = (ahd__packblock *)base;
+		inner_head->cap = inner_len | ahd__alignflags(align_inner) | ahd__flag(ahd_PACKED); /* copies keep the alignment */
+		inner_head->len = inner_len;
+		inner[i] = (char *)inner_head + hdr_size_inner;
+	}
+	head->len = len + n;
+	if(! n)
+	{ AHD_FREE(raw); }
+	AHD_FREE(offsets);
+	return 1;
+
+fail:
+	AHD_FREE(raw);
+	AHD_FREE(offsets);
+	return 0;
+}
+
+#define ahd_reverse(ht,a) ahd__reverse(ahd__data(ht,a))
+
+static void ahd__memswap(void *el_a, void *el_b, ahd_int size) {
+	char *a = (char *)el_a,
+		 *b = (char *)el_b;
+	char t[64]; /* swap in blocks rather than byte-by-byte */
+	for(; size >= sizeof(t); size -= sizeof(t), a += sizeof(t), b += sizeof(t)) {
+		AHD_MEMCPY(t, a, sizeof(t));
+		AHD_MEMCPY(a, b, sizeof(t));
+		AHD_MEMCPY(b, t, sizeof(t));
+	}
+	if(size) {
+		AHD_MEMCPY(t, a, size);
+		AHD_MEMCPY(a, b, size);
+		AHD_MEMCPY(b, t, size);
+	}
+}
+
+static void ahd__memreverse(void *arr, ahd_int len, ahd_int el_size)
 {
 	char *a = (char *)arr;
-	ahd_int len = ((ahd_arr *)(a - hdr_size))->len;
 	char *at  = a,
 		 *mid = a + (len / 2) * el_size,
 		 *ta  = a + (len - 1) * el_size;
@@ -525,6 +1857,13 @@ static void ahd__reverse(void *arr, ahd_int hdr_size, ahd_int el_size)
 	{ ahd__memswap(at, ta, el_size); }
 }
 
+static void ahd__reverse(void *arr, ahd_int hdr_size, ahd_int el_size)
+{
+	char *a = (char *)arr;
+	ahd_int len = ((ahd_arr *)(a - hdr_size))->len;
+	ahd__memreverse(a, len, el_size);
+}
+
 
 /******************************************************************************/
 /* Extracting array subsets****************************************************/
@@ -535,12 +1874,22 @@ static void ahd__reverse(void *arr, ahd_int hdr_size, ahd_int el_size)
 // TODO: refactor with similar fns
 static void *
 AHD_DBG(ahd__dup, void *arr, ahd_int hdr_size, ahd_int el_size) {
-    AHD_DBG_UNUSED;
-	ahd_arr *head          = (ahd_arr *)((char *)arr - hdr_size);
-	ahd_int total_cap_size = hdr_size + head->cap * el_size;
-	ahd_arr *new_head      = (ahd_arr *) AHD_REALLOC(0, total_cap_size);
-	if (head)
-	{ return (char *)AHD_MEMMOVE(new_head, head, total_cap_size) + hdr_size; }
+	ahd_arr *head              = (ahd_arr *)((char *)arr - hdr_size);
+	ahd_int total_cap_size     = hdr_size + (head->cap & AHD_CAP_MASK) * el_size;
+	ahd_allocator const *alloc = ahd__copyalloc(head);
+	ahd_arr *new_head          = ahd__hdralloc(alloc, ahd__copyflags(head->cap), total_cap_size, hdr_size);
+	if (new_head) {
+#if AHD_DEBUG
+		ahd__dbg_created(AHD_DBG_SITE, new_head, total_cap_size, total_cap_size - hdr_size);
+#endif//AHD_DEBUG
+		AHD_MEMMOVE(new_head, head, total_cap_size);
+		new_head->cap &= ~AHD__BORROWED;
+		if(new_head->cap & ahd__flag(ahd_POLICY)) { /* a copy doesn't spill to the same file, or live in it */
+			((ahd_policy *)(new_head + 1))->spill = 0;
+			((ahd_policy *)(new_head + 1))->alloc = alloc;
+		}
+		return (char *)new_head + hdr_size;
+	}
 	else {
 #ifdef AHD_BUFFER_OUT_OF_MEMORY
 		AHD_BUFFER_OUT_OF_MEMORY ;
@@ -551,16 +1900,96 @@ AHD_DBG(ahd__dup, void *arr, ahd_int hdr_size, ahd_int el_size) {
 }
 
 static void *ahd__sub(void *arr, ahd_int hdr_size, ahd_int el_size, ahd_int first, ahd_int n) {
-	char *new_arr = (char *)ahd__grow(0, n, el_size, hdr_size);
+	ahd_arr *src  = (ahd_arr *)((char *)arr - hdr_size);
+	ahd_allocator const *alloc = ahd__copyalloc(src);
+	ahd_arr *new_head = ahd__hdralloc(alloc, ahd__copyflags(src->cap), hdr_size, hdr_size);
+	char *new_arr;
+	if(! new_head) {
+#ifdef AHD_BUFFER_OUT_OF_MEMORY
+		AHD_BUFFER_OUT_OF_MEMORY ;
+#endif
+		return (char*)(uintptr_t)hdr_size; // try to force a NULL pointer exception later
+	}
+	if(src->cap & ahd__flag(ahd_POLICY)) { /* same growth (and allocator, bar a file's) as the source */
+		*(ahd_policy *)(new_head + 1) = *(ahd_policy *)(src + 1);
+		((ahd_policy *)(new_head + 1))->spill = 0;
+		((ahd_policy *)(new_head + 1))->alloc = alloc;
+	}
+	new_arr = (char *)ahd__grow(new_head, n, el_size, hdr_size, 0);
 	ahd_arr *head = (ahd_arr *)(new_arr - hdr_size);
 	head->len = n;
 	AHD_MEMMOVE(new_arr, ((char *)arr + first*el_size), n*el_size);
 	return new_arr;
 }
 
-#define ahd_slice()
-// TODO: don't repeat i
-#define ahd_unique(ht,a)
+/* ahd_sliceof gives an ahd_slice: a window onto n elements of a from index f,
+ * without copying. The elements are those of a, so changes show in both. Like
+ * any pointer into a, it is invalid once a grows or is freed. Use with the
+ * ahd_slice_* macros below, or make a real array from it with ahd_slice_dup.
+ */
+typedef struct ahd_slice {
+	void *base;    /* the array (or a run of elements anywhere) */
+	ahd_int first; /* index of the slice's first element in base */
+	ahd_int len;
+	ahd_int el_size;
+} ahd_slice;
+
+#define ahd_sliceof(ht,a,f,n)        ahd__slice(a, ahd_len(ht,a), f, n, sizeof(*(a))) // clamped to a
+#define ahd_slice_sub(s,f,n)         ahd__slice(ahd__slicep(s), (s).len, f, n, (s).el_size)
+#define ahd_slice_dup(ht,s)          ahd__slicedup(s, sizeof(ht), AHD_ALIGNOF(ht))
+#define ahd_slicep(t,s)              ((t *)ahd__slicep(s)) // the first element
+#define ahd__slicep(s)               ((char *)(s).base + (s).first * (s).el_size)
+
+#define ahd_slice_eq(s,b)            ((s).el_size == (b).el_size && (s).len == (b).len && \
+                                      AHD_MEMCMP(ahd__slicep(s), ahd__slicep(b), (s).len * (s).el_size) == 0)
+#define ahd_slice_each(s,i)          (ahd_decl(ahd_int) i = 0; i < (s).len; ++i)
+#define ahd_slice_each_v(s,i,t,v) \
+	(ahd_decl(ahd_int) i = 0, ahd_foronce((s).len)++;) \
+	for(t v; i < (s).len && (v = ahd_slicep(t,s)[i], 1); ++i)
+// runs the block with each v until it sets tr; i is then v's index, or s.len if none did
+#define ahd_slice_find(s,i,t,v,tr) \
+	for((i) = 0, (tr) = 0; (i) < (s).len && ! (tr); (i) += ! (tr)) \
+	for(ahd_decl(ahd_int) ahd_foronce(1);) \
+	for(t v = ahd_slicep(t,s)[i]; ! ahd_n_ln++; )
+#define ahd_slice_reducefn(fn,s,acc,udata) \
+	ahd__reduce(acc, sizeof(*(acc)), ahd__slicep(s), (s).el_size, 0, (s).len, fn, udata)
+
+// sorts just the slice's elements of the array; mem is the address of the key in its first element
+#define ahd__slice_sortx(x,s,mem,dir) \
+	ahd__sort(ahd__slicep(s), (s).len, (s).el_size, (ahd_int)((char *)(mem) - ahd__slicep(s)), ahd__type##x(mem), dir)
+#define ahd_slice_sorti(s,mem,dir)   ahd__slice_sortx(i,s,mem,dir)
+#define ahd_slice_sortu(s,mem,dir)   ahd__slice_sortx(u,s,mem,dir)
+#define ahd_slice_sortint(s,mem,dir) ahd__slice_sortx(int,s,mem,dir)
+#define ahd_slice_sortf(s,mem,dir)   ahd__slice_sortx(f,s,mem,dir)
+#define ahd_slice_reverse(s)         ahd__memreverse(ahd__slicep(s), (s).len, (s).el_size)
+/* Usage:
+ * ahd_slice window = arr_slice(samples, 100, 50);
+ * float total = 0;
+ * for ahd_slice_each_v(window, i, float, sample) { total += sample; }
+ * ahd_slice_sortf(window, ahd_slicep(float, window), ahd_ASC); // sorts samples[100..149]
+ * float *copy = (float *)arr_slicedup(window);
+ */
+
+static ahd_slice
+ahd__slice(void *base, ahd_int base_len, ahd_int first, ahd_int n, ahd_int el_size)
+{
+	ahd_slice s;
+	s.base    = base;
+	s.first   = ahd__min(first, base_len);
+	s.len     = ahd__min(n, base_len - s.first);
+	s.el_size = el_size;
+	return s;
+}
+
+// a new array with a copy of the slice's elements
+static void *
+ahd__slicedup(ahd_slice s, ahd_int hdr_size, ahd_int align)
+{
+	char *arr = (char *)ahd__setcap(0, s.len, s.el_size, hdr_size, align);
+	((ahd_arr *)(arr - hdr_size))->len = s.len;
+	AHD_MEMCPY(arr, ahd__slicep(s), s.len * s.el_size);
+	return arr;
+}
 
 
 
@@ -594,6 +2023,430 @@ static inline ahd_int ahd__bc(ahd_int len, ahd_int i) { AHD_ASSERT(i < len && "b
 /* 	return index; */
 /* } */
 
+/******************************************************************************/
+/* Parallel execution *********************************************************/
+/******************************************************************************/
+/* Define AHD_THREADS to run the parallel variants (ahd_psort*, ...) on multiple
+ * threads (Win32 threads or pthreads); otherwise they run their tasks in turn
+ * on the calling thread.
+ */
+#ifdef AHD_THREADS
+# ifdef _WIN32
+#  ifndef WIN32_LEAN_AND_MEAN
+#   define WIN32_LEAN_AND_MEAN
+#  endif
+#  include <windows.h>
+#  include <process.h>
+# else
+#  include <pthread.h>
+#  include <sched.h>
+#  include <unistd.h>
+# endif
+#endif/*AHD_THREADS*/
+
+#ifndef  AHD_MAX_THREADS
+# define AHD_MAX_THREADS 64
+#endif// AHD_MAX_THREADS
+
+typedef void ahd_taskfn(void *data, int i_task, int n_tasks);
+
+typedef struct ahd__task {
+	ahd_taskfn *fn;
+	void *data;
+	int i, n;
+} ahd__task;
+
+#ifdef AHD_THREADS
+# ifdef _WIN32
+static unsigned __stdcall ahd__task_run(void *task)
+{ ahd__task *t = (ahd__task *)task; t->fn(t->data, t->i, t->n); return 0; }
+# else
+static void *ahd__task_run(void *task)
+{ ahd__task *t = (ahd__task *)task; t->fn(t->data, t->i, t->n); return 0; }
+# endif
+#endif/*AHD_THREADS*/
+
+static int
+ahd_num_cores(void)
+{
+#if defined(AHD_THREADS) && defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+#elif defined(AHD_THREADS)
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int)n : 1;
+#else
+	return 1;
+#endif
+}
+
+/* calls fn(data, i, n_tasks) for each i in [0, n_tasks), each on its own thread
+ * (the calling thread does task 0); returns once all have finished */
+static void
+ahd__parallel(ahd_taskfn *fn, void *data, int n_tasks)
+{
+	int i;
+#ifdef AHD_THREADS
+	ahd__task tasks[AHD_MAX_THREADS];
+# ifdef _WIN32
+	HANDLE threads[AHD_MAX_THREADS] = {0};
+# else
+	pthread_t threads[AHD_MAX_THREADS];
+	int started[AHD_MAX_THREADS] = {0};
+# endif
+#endif/*AHD_THREADS*/
+
+	n_tasks = ahd__max(1, ahd__min(n_tasks, AHD_MAX_THREADS));
+	for(i = 1; i < n_tasks; ++i) {
+#ifdef AHD_THREADS
+		tasks[i].fn = fn, tasks[i].data = data;
+		tasks[i].i  = i,  tasks[i].n    = n_tasks;
+#endif
+#if defined(AHD_THREADS) && defined(_WIN32)
+		threads[i] = (HANDLE)_beginthreadex(0, 0, ahd__task_run, &tasks[i], 0, 0);
+		if(! threads[i])
+#elif defined(AHD_THREADS)
+		started[i] = pthread_create(&threads[i], 0, ahd__task_run, &tasks[i]) == 0;
+		if(! started[i])
+#endif
+		{ fn(data, i, n_tasks); } /* no threads: do it here */
+	}
+
+	fn(data, 0, n_tasks);
+
+#ifdef AHD_THREADS
+	for(i = 1; i < n_tasks; ++i) {
+# ifdef _WIN32
+		if(threads[i]) { WaitForSingleObject(threads[i], INFINITE); CloseHandle(threads[i]); }
+# else
+		if(started[i]) { pthread_join(threads[i], 0); }
+# endif
+	}
+#endif/*AHD_THREADS*/
+}
+
+
+/******************************************************************************/
+/* Thread-safe arrays *********************************************************/
+/******************************************************************************/
+#if defined(_MSC_VER) && ! defined(__clang__)
+# include <intrin.h>
+# define ahd__atomic_add(p,v)       ((ahd_int)_InterlockedExchangeAdd64((__int64 volatile *)(p), (__int64)(v)))
+# define ahd__atomic_or(p,v)        ((ahd_int)_InterlockedOr64((__int64 volatile *)(p), (__int64)(v)))
+# define ahd__atomic_load(p)        ahd__atomic_or(p, 0)
+# define ahd__atomic_store(p,v)     ((void)_InterlockedExchange64((__int64 volatile *)(p), (__int64)(v)))
+# define ahd__atomic_loadp(p)       _InterlockedCompareExchangePointer((void *volatile *)(p), 0, 0)
+# define ahd__atomic_storep(p,v)    ((void)_InterlockedExchangePointer((void *volatile *)(p), (v)))
+# define ahd__atomic_casp(p,old,v)  (_InterlockedCompareExchangePointer((void *volatile *)(p), (v), (old)) == (old))
+#else
+# define ahd__atomic_add(p,v)       __atomic_fetch_add((p), (v), __ATOMIC_SEQ_CST)
+# define ahd__atomic_or(p,v)        __atomic_fetch_or((p), (v), __ATOMIC_SEQ_CST)
+# define ahd__atomic_load(p)        __atomic_load_n((p), __ATOMIC_SEQ_CST)
+# define ahd__atomic_store(p,v)     __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+# define ahd__atomic_loadp(p)       __atomic_load_n((p), __ATOMIC_SEQ_CST)
+# define ahd__atomic_storep(p,v)    __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+# define ahd__atomic_casp(p,old,v)  ahd__casp((p), (old), (v))
+static int ahd__casp(void **p, void *old, void *v)
+{ return __atomic_compare_exchange_n(p, &old, v, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); }
+#endif
+
+// set in len by a thread popping; any claims made meanwhile are discarded
+#define AHD__TS_EXCL ((ahd_int)1 << 62)
+
+static void
+ahd__yield(void)
+{
+#if defined(AHD_THREADS) && defined(_WIN32)
+	SwitchToThread();
+#elif defined(AHD_THREADS)
+	sched_yield();
+#endif
+}
+
+/* Called by the thread that claimed slot cap: once the other slots have been
+ * written, copies the array to a bigger block and publishes it. The old block
+ * is kept, as other threads may still be looking at its len.
+ */
+static void
+ahd__grow_ts(void **arr, char *data, ahd_int hdr_size, ahd_int el_size, ahd_int ts_off)
+{
+	ahd_arr *head = (ahd_arr *)(data - hdr_size), *new_head;
+	ahd_ts  *ts   = (ahd_ts *)((char *)head + ts_off), *new_ts;
+	ahd_int  cap  = head->cap & AHD_CAP_MASK,
+	         new_cap = ahd__growcap(ahd__growthof(head), cap, cap + 1, el_size, hdr_size);
+
+	new_head = ahd__hdralloc(ahd__allocof(head), head->cap & ~AHD_CAP_MASK, hdr_size + new_cap * el_size, hdr_size);
+	if(! new_head) {
+#ifdef AHD_BUFFER_OUT_OF_MEMORY
+		AHD_BUFFER_OUT_OF_MEMORY ;
+#endif
+		ahd__atomic_store(&head->len, cap); /* let the next claim try again */
+		return;
+	}
+	while(ahd__atomic_load(&ts->written) != cap)
+	{ ahd__yield(); }
+#ifdef AHD_GROW_STATS
+	ahd_grow_stats.reallocs    += 1;
+	ahd_grow_stats.bytes_moved += cap * el_size;
+#endif/*AHD_GROW_STATS*/
+
+	/* all but len and ts, which later claims on the old block still touch */
+	new_ts = (ahd_ts *)((char *)new_head + ts_off);
+	AHD_MEMCPY(new_head + 1, head + 1, ts_off - sizeof(ahd_arr));
+	AHD_MEMCPY(new_ts + 1, (char *)head + ts_off + sizeof(ahd_ts), hdr_size - ts_off - sizeof(ahd_ts) + cap * el_size);
+	new_head->cap   |= new_cap;
+	new_head->len    = cap;
+	new_ts->written  = cap;
+	new_ts->retired  = head;
+	ahd__atomic_storep(arr, (char *)new_head + hdr_size);
+}
+
+/* claims a slot for a value and returns its index; the caller writes the value
+ * then adds 1 to ts.written */
+static ahd_int
+ahd__claim_ts(void **arr, ahd_int hdr_size, ahd_int el_size, ahd_int align, ahd_int ts_off)
+{
+	for(;;) {
+		char *data = (char *)ahd__atomic_loadp(arr);
+		ahd_arr *head;
+		ahd_int cap, i;
+		if(! data) { /* the first pusher creates the array */
+			char *new_data = (char *)ahd__grow(0, 1, el_size, hdr_size, align);
+			if(! ahd__atomic_casp(arr, 0, new_data))
+			{ ahd__free(new_data - hdr_size); }
+			continue;
+		}
+
+		head = (ahd_arr *)(data - hdr_size);
+		cap  = head->cap & AHD_CAP_MASK;
+		i    = ahd__atomic_add(&head->len, 1);
+		if(i < cap)
+		{ return i; }
+		if(i == cap)
+		{ ahd__grow_ts(arr, data, hdr_size, el_size, ts_off); }
+		else /* another thread is growing or popping */
+		{ while(ahd__atomic_loadp(arr) == data && ahd__atomic_load(&head->len) > cap) { ahd__yield(); } }
+	}
+}
+
+static int
+ahd__pop_ts(void **arr, ahd_int hdr_size, ahd_int el_size, ahd_int ts_off, void *out)
+{
+	for(;;) {
+		char *data = (char *)ahd__atomic_loadp(arr);
+		ahd_arr *head;
+		ahd_ts *ts;
+		ahd_int len;
+		if(! data)
+		{ return 0; }
+
+		head = (ahd_arr *)(data - hdr_size);
+		ts   = (ahd_ts *)((char *)head + ts_off);
+		len  = ahd__atomic_or(&head->len, AHD__TS_EXCL);
+		if((len & AHD__TS_EXCL) || len > (head->cap & AHD_CAP_MASK)) { /* popping or growing */
+			while(ahd__atomic_loadp(arr) == data && (ahd__atomic_load(&head->len) & AHD__TS_EXCL)) { ahd__yield(); }
+			continue;
+		}
+
+		while(ahd__atomic_load(&ts->written) != len) /* wait for values being pushed */
+		{ ahd__yield(); }
+		if(len) {
+			AHD_MEMCPY(out, data + (len - 1) * el_size, el_size);
+			ahd__atomic_store(&ts->written, len - 1);
+		}
+		ahd__atomic_store(&head->len, len - (len > 0));
+		return len > 0;
+	}
+}
+
+static void
+ahd__free_ts(void *ptr, ahd_int ts_off)
+{
+	ahd_arr *head = (ahd_arr *)ptr;
+	while(head) {
+		ahd_arr *retired = (ahd_arr *)((ahd_ts *)((char *)head + ts_off))->retired;
+		ahd__free(head);
+		head = retired;
+	}
+}
+
+
+/******************************************************************************/
+/* Spilling to a file *********************************************************/
+/******************************************************************************/
+/* An array with a spill keeps at most threshold bytes of elements: when a push
+ * finds it full, the elements are written to the file in one fwrite and the
+ * array starts again from len 0, so memory stays bounded and pushes stay O(1)
+ * (the check is the one they already make for growth). With background set
+ * (and AHD_THREADS defined), the array is double-buffered: pushes carry on in
+ * a second buffer while a thread writes the full one.
+ * Only appends (ahd_push, ahd_add and the ahd_push* family) spill. Anything
+ * else that needs room (ahd_insert, ahd_reserve, ...) grows the array as usual,
+ * past threshold; it's written out in full at the next append that fills it.
+ * The header needs an ahd_t(policy) directly after ahd_t(arr), as for
+ * ahd_setalloc. ahd_flush writes out what's in the array now; call
+ * ahd_setspill(ht,a,0) to flush and detach it (freeing the second buffer)
+ * before freeing the array or closing the file. ahd_setspill returns 0 if it
+ * runs out of memory, leaving the array without a spill.
+ *
+ * typedef struct log_arr { ahd_t(arr); ahd_t(policy); } log_arr;
+ * ahd_spill spill = { file, 1 << 20, 1 };
+ * ahd_setspill(log_arr, recs, &spill);
+ * ... ahd_push(log_arr, recs, rec); ...
+ * ahd_setspill(log_arr, recs, 0);
+ */
+typedef struct ahd_spill {
+	FILE   *file;
+	ahd_int threshold;  /* bytes of elements to hold before writing them out */
+	int     background; /* write on another thread (with AHD_THREADS) while pushes go to a second buffer */
+	int     error;      /* set when a write fails; those elements are lost */
+	ahd_int written;    /* bytes written so far */
+
+	/* for background writes */
+	ahd_arr  *spare;    /* the other buffer: being written, or ready */
+	char     *pending;  /* the elements being written */
+	ahd_int   pending_size;
+	ahd__task task;
+	int       busy;
+#if defined(AHD_THREADS) && defined(_WIN32)
+	HANDLE    thread;
+#elif defined(AHD_THREADS)
+	pthread_t thread;
+#endif
+} ahd_spill;
+
+#define ahd_setspill(ht,a,spill) \
+	((void)sizeof(char[offsetof(ht, policy) == sizeof(ahd_arr) ? 1 : -1]), \
+	 ahd__setspill((void **)&(a), sizeof(ht), sizeof(*(a)), AHD_ALIGNOF(ht), spill))
+#define ahd_flush(ht,a) ahd__flush(ahd_if(a, ahd_hdr(ht,a)), sizeof(ht), sizeof(*(a)))
+
+static void
+ahd__spill_write(void *data, int i_task, int n_tasks)
+{
+	ahd_spill *spill = (ahd_spill *)data;
+	(void)i_task, (void)n_tasks;
+	if(! spill->pending_size)
+	{ return; }
+	if(fwrite(spill->pending, (size_t)spill->pending_size, 1, spill->file) == 1)
+	{ spill->written += spill->pending_size; }
+	else
+	{ spill->error = 1; }
+}
+
+/* waits for the background write, if there is one */
+static void
+ahd__spill_wait(ahd_spill *spill)
+{
+	if(! spill->busy)
+	{ return; }
+#if defined(AHD_THREADS) && defined(_WIN32)
+	WaitForSingleObject(spill->thread, INFINITE);
+	CloseHandle(spill->thread);
+#elif defined(AHD_THREADS)
+	pthread_join(spill->thread, 0);
+#endif
+	spill->busy = 0;
+}
+
+/* writes out the elements of the full array with header head, and returns the
+ * (now empty) array to carry on pushing to: head's, or the spare buffer's */
+static void *
+ahd__spill(ahd_arr *head, ahd_int itemsize, ahd_int headersize)
+{
+	ahd_spill *spill = ahd__spillof(head);
+	ahd_arr   *next  = head;
+	ahd__spill_wait(spill); /* the spare buffer is free once its write is done */
+	spill->pending      = (char *)head + headersize;
+	spill->pending_size = head->len * itemsize;
+
+#ifdef AHD_THREADS
+	if(spill->background) {
+		ahd_int cap = head->cap & AHD_CAP_MASK;
+		if(spill->spare && (spill->spare->cap & AHD_CAP_MASK) != cap)
+		{ ahd__free(spill->spare); spill->spare = 0; } /* the array has been resized since */
+		if(! spill->spare)
+		{ spill->spare = ahd__hdralloc(ahd__allocof(head), ahd__copyflags(head->cap), headersize + cap * itemsize, headersize); }
+		if(spill->spare) {
+			next = spill->spare;
+			AHD_MEMCPY(next, head, headersize);
+			spill->spare = head; /* ...once it's written */
+			spill->task.fn = ahd__spill_write, spill->task.data = spill;
+			spill->task.i  = 0,                spill->task.n    = 1;
+# ifdef _WIN32
+			spill->thread = (HANDLE)_beginthreadex(0, 0, ahd__task_run, &spill->task, 0, 0);
+			spill->busy   = spill->thread != 0;
+# else
+			spill->busy   = pthread_create(&spill->thread, 0, ahd__task_run, &spill->task) == 0;
+# endif
+		}
+	}
+#endif/*AHD_THREADS*/
+	if(! spill->busy) /* in the foreground */
+	{ ahd__spill_write(spill, 0, 1); }
+	next->len = 0;
+	return (char *)next + headersize;
+}
+
+/* writes out the elements in the array (if it has a spill) and empties it;
+ * returns 0 if any write has failed */
+static int
+ahd__flush(void *ptr, ahd_int hdr_size, ahd_int el_size)
+{
+	ahd_arr   *head  = (ahd_arr *)ptr;
+	ahd_spill *spill = head ? ahd__spillof(head) : 0;
+	if(! spill)
+	{ return 1; }
+	ahd__spill_wait(spill);
+	spill->pending      = (char *)head + hdr_size;
+	spill->pending_size = head->len * el_size;
+	ahd__spill_write(spill, 0, 1);
+	head->len = 0;
+	if(fflush(spill->file) != 0)
+	{ spill->error = 1; }
+	return ! spill->error;
+}
+
+/* spills the array to spill->file from now on; 0 flushes it and goes back to growing.
+ * returns 0 if out of memory */
+static int
+ahd__setspill(void **arr, ahd_int hdr_size, ahd_int el_size, ahd_int align, ahd_spill *spill)
+{
+	ahd_arr *head = *arr ? (ahd_arr *)((char *)*arr - hdr_size) : 0;
+	ahd_spill *old = head ? ahd__spillof(head) : 0;
+	ahd_int cap;
+	char *resized;
+	if(old) {
+		ahd__flush(head, hdr_size, el_size);
+		if(old->spare)
+		{ ahd__free(old->spare); old->spare = 0; }
+		((ahd_policy *)(head + 1))->spill = 0;
+	}
+	if(! spill)
+	{ return 1; }
+
+	if(! head) {
+		char *created = (char *)ahd__resize(0, ahd__alignflags(align), 0, el_size, hdr_size);
+		if((uintptr_t)created == (uintptr_t)hdr_size)
+		{ return 0; }
+		*arr = created;
+		head = (ahd_arr *)(created - hdr_size);
+	}
+	head->cap |= ahd__flag(ahd_POLICY);
+	((ahd_policy *)(head + 1))->spill = spill;
+	spill->spare = 0, spill->busy = 0;
+	if(head->len * el_size >= spill->threshold)
+	{ ahd__flush(head, hdr_size, el_size); }
+	cap     = ahd__max(spill->threshold / el_size, (ahd_int)1);
+	resized = (char *)ahd__resize(head, ahd__alignflags(align), cap, el_size, hdr_size);
+	if((uintptr_t)resized == (uintptr_t)hdr_size) { /* head is untouched */
+		((ahd_policy *)(head + 1))->spill = 0;
+		return 0;
+	}
+	*arr = resized;
+	return 1;
+}
+
 /******************************************************************************/
 /* Array element rearranging **************************************************/
 /******************************************************************************/
@@ -607,10 +2460,51 @@ static inline ahd_int ahd__bc(ahd_int len, ahd_int i) { AHD_ASSERT(i < len && "b
 #define ahd_sortint(ht,a,mem,dir) ahd__sortx(int[ahd_is_signed(*(mem))],ht,a,mem,dir)
 #define ahd_sortf(ht,a,mem,dir)   ahd__sortx(f,ht,a,mem,dir)
 
-#define AHD_STACK_BUF_SIZE 256
+// always radix sort (ahd_sort* do so automatically above AHD_SORT_RADIX_MIN elements)
+#define ahd__radixx(x,ht,a,mem,dir) \
+	ahd__radix##x(ahd__data(ht,a), mem, (ahd_int)sizeof(*(mem)), dir)
+
+#define ahd_radixi(ht,a,mem,dir)   ahd__radixx(i,ht,a,mem,dir)
+#define ahd_radixu(ht,a,mem,dir)   ahd__radixx(u,ht,a,mem,dir)
+#define ahd_radixint(ht,a,mem,dir) ahd__radixx(int[ahd_is_signed(*(mem))],ht,a,mem,dir)
+#define ahd_radixf(ht,a,mem,dir)   ahd__radixx(f,ht,a,mem,dir)
+
+// type codes for the member: ahd_INT/ahd_FLT | size (| ahd_SIGN)
+#define ahd__typei(mem)   (ahd_INT | ahd_SIGN | (int)sizeof(*(mem)))
+#define ahd__typeu(mem)   (ahd_INT | (int)sizeof(*(mem)))
+#define ahd__typeint(mem) (ahd_INT | ahd_is_signed(*(mem)) << ahd_SIGNSHIFT | (int)sizeof(*(mem)))
+#define ahd__typef(mem)   (ahd_FLT | (int)sizeof(*(mem)))
+
+// returns a permutation (an ahd_arr array of ahd_int, free it with ahd_free(ahd_arr, perm)):
+// perm[i] is the index of the element that sorts to position i. `a` is not modified.
+#define ahd__sortidxx(x,ht,a,mem,dir) ahd__sortidx(ahd__data(ht,a), mem, ahd__type##x(mem), dir)
+#define ahd_sortidxi(ht,a,mem,dir)    ahd__sortidxx(i,ht,a,mem,dir)
+#define ahd_sortidxu(ht,a,mem,dir)    ahd__sortidxx(u,ht,a,mem,dir)
+#define ahd_sortidxint(ht,a,mem,dir)  ahd__sortidxx(int,ht,a,mem,dir)
+#define ahd_sortidxf(ht,a,mem,dir)    ahd__sortidxx(f,ht,a,mem,dir)
+// mem is the address of a `char *` member (str) or a `char [N]` member (chr). Both are stable.
+#define ahd_sortstr(ht,a,mem,dir)     ahd__sortstr(ahd__data(ht,a), mem, ahd_STR, 0, dir)
+#define ahd_sortchr(ht,a,mem,dir)     ahd__sortstr(ahd__data(ht,a), mem, ahd_CHR, sizeof(*(mem)), dir)
+#define ahd_sortidxstr(ht,a,mem,dir)  ahd__sortidxstr(ahd__data(ht,a), mem, ahd_STR, 0, dir)
+#define ahd_sortidxchr(ht,a,mem,dir)  ahd__sortidxstr(ahd__data(ht,a), mem, ahd_CHR, sizeof(*(mem)), dir)
+// rearrange a in place so that a[i] = (old a)[perm[i]]
+#define ahd_permute(ht,a,perm)        ahd__permute(ahd__data(ht,a), perm)
+
+// guaranteed stable sort; moves each element once (good for large elements)
+#define ahd__stablex(x,ht,a,mem,dir)     ahd__stablesortx(ahd__data(ht,a), mem, ahd__type##x(mem), dir)
+#define ahd_stablesorti(ht,a,mem,dir)    ahd__stablex(i,ht,a,mem,dir)
+#define ahd_stablesortu(ht,a,mem,dir)    ahd__stablex(u,ht,a,mem,dir)
+#define ahd_stablesortint(ht,a,mem,dir)  ahd__stablex(int,ht,a,mem,dir)
+#define ahd_stablesortf(ht,a,mem,dir)    ahd__stablex(f,ht,a,mem,dir)
+
+// as ahd_sort*, but on ahd_psort_threads threads from AHD_PSORT_MIN elements (not stable)
+#define ahd__psortx(x,ht,a,mem,dir)   ahd__psort(ahd__data(ht,a), mem, ahd__type##x(mem), dir)
+#define ahd_psorti(ht,a,mem,dir)      ahd__psortx(i,ht,a,mem,dir)
+#define ahd_psortu(ht,a,mem,dir)      ahd__psortx(u,ht,a,mem,dir)
+#define ahd_psortint(ht,a,mem,dir)    ahd__psortx(int,ht,a,mem,dir)
+#define ahd_psortf(ht,a,mem,dir)      ahd__psortx(f,ht,a,mem,dir)
 
-#define ahd__max(a,b) ((a) >= (b) ? (a) : (b))
-#define ahd__min(a,b) ((a) <  (b) ? (a) : (b))
+#define AHD_STACK_BUF_SIZE 256
 
 #define ahd_rotr(ht,a,n) ahd__memrotr(a, sizeof(*(a)), ahd_len(ht,a), n)
 
@@ -623,13 +2517,12 @@ static void ahd__memrotr(void *mem, ahd_int el_size, ahd_int len, ahd_int rot_n)
 	        max_size       = ahd__min(size, sizeof(buf)),
 			size_remaining = size,
 			size_copied    = 0,
-			cpy_size       = ahd__min(size_remaining, max_size);
+			cpy_size;
 
-	for(; size_remaining;
-		size_remaining -= (cpy_size = ahd__min(size_remaining, max_size)),
-		size_copied += cpy_size)
+	for(; size_remaining; size_remaining -= cpy_size, size_copied += cpy_size)
 	{
 		char *bytes = (char *)mem + size_copied;
+		cpy_size = ahd__min(size_remaining, max_size);
 		AHD_MEMMOVE(buf, bytes + n_bytes, cpy_size);
 		AHD_MEMMOVE(bytes + cpy_size, bytes, n_bytes);
 		AHD_MEMMOVE(bytes, buf, cpy_size);
@@ -650,153 +2543,1084 @@ typedef enum ahd_sort_type {
 	ahd_SIGN = 1 << ahd_SIGNSHIFT,
 } ahd_sort_type;
 
-/* TODO: sort_ _int, _flt, _str, _chr, _fn*/
+/* TODO: sort_ _fn*/
+
+/* Sort engine ****************************************************************
+ * Introsort: quicksort with median-of-3 pivots, falling back to heapsort when
+ * the recursion gets too deep (guaranteeing O(n log n)) and to insertion sort
+ * for small partitions.
+ * Keys are described by `type`: ahd_INT/ahd_FLT | size of member (| ahd_SIGN)
+ */
+#ifndef  AHD_SORT_INSERTION_MAX
+# define AHD_SORT_INSERTION_MAX 16
+#endif// AHD_SORT_INSERTION_MAX
 
+typedef struct ahd__sorter {
+	char *tmp;       /* scratch space for 1 element */
+	ahd_int el_size;
+	ahd_int mem_off; /* offset of key member from start of element */
+	int type;
+	int dir;
+} ahd__sorter;
 
+#define AHD__KEYCMP(t) { t A = *(t *)a, B = *(t *)b; return (A > B) - (A < B); }
 static int
-ahd__sorti(void *array, ahd_int hdr_size, ahd_int el_size, void *member, ahd_int member_size, ahd_sort_dir dir)
+ahd__keycmp(char const *a, char const *b, int type)
 {
-	int result = 1;
-	char *arr = (char *)array;
-	ahd_arr *head = (ahd_arr *)(arr - hdr_size);
-	ahd_int len = head->len,
-			member_offset = (ahd_int)((char *)member - arr);
-	char *guard = arr + len * el_size, *at, *a, *b;
+	switch(type) {
+		case ahd_INT | ahd_SIGN | sizeof (char):      AHD__KEYCMP(signed char);
+		case ahd_INT | ahd_SIGN | sizeof (short):     AHD__KEYCMP(short);
+		case ahd_INT | ahd_SIGN | sizeof (int):       AHD__KEYCMP(int);
+		case ahd_INT | ahd_SIGN | sizeof (long long): AHD__KEYCMP(long long);
+
+		case ahd_INT | sizeof (unsigned char):        AHD__KEYCMP(unsigned char);
+		case ahd_INT | sizeof (unsigned short):       AHD__KEYCMP(unsigned short);
+		case ahd_INT | sizeof (unsigned int):         AHD__KEYCMP(unsigned int);
+		case ahd_INT | sizeof (unsigned long long):   AHD__KEYCMP(unsigned long long);
 
-	/* insertion sort */
-	for(at = arr; at + el_size < guard; at += el_size)
+		case ahd_FLT | sizeof (float):                AHD__KEYCMP(float);
+		case ahd_FLT | sizeof (double):               AHD__KEYCMP(double);
+
+		default: return 0;
+	}
+}
+#undef AHD__KEYCMP
+
+static int
+ahd__sort_validtype(int type)
+{
+	switch(type & ~ahd_SIGN) {
+		case ahd_INT | 1: case ahd_INT | 2: case ahd_INT | 4: case ahd_INT | 8:
+		case ahd_FLT | 4: case ahd_FLT | 8:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+static inline int
+ahd__sortcmp(ahd__sorter *s, char const *el_a, char const *el_b)
+{ return ahd__keycmp(el_a + s->mem_off, el_b + s->mem_off, s->type) * s->dir; }
+
+static void
+ahd__sort_insertion(ahd__sorter *s, char *arr, ahd_int len)
+{
+	ahd_int el_size = s->el_size;
+	char *guard = arr + len * el_size, *at, *b;
+
+	/* stable: only moves an element past strictly greater ones */
+	for(at = arr + el_size; at < guard; at += el_size)
 	{
-		for(a = at + member_offset; ; a -= el_size)
+		if(ahd__sortcmp(s, at - el_size, at) <= 0)
+		{ continue; }
+
+		AHD_MEMCPY(s->tmp, at, el_size);
+		for(b = at - el_size; b > arr && ahd__sortcmp(s, b - el_size, s->tmp) > 0; b -= el_size) {}
+		AHD_MEMMOVE(b + el_size, b, at - b);
+		AHD_MEMCPY(b, s->tmp, el_size);
+	}
+}
+
+static void
+ahd__sort_heap(ahd__sorter *s, char *arr, ahd_int len)
+{
+	ahd_int el_size = s->el_size, i = len / 2, n = len;
+
+	/* heapify, then repeatedly move the max to the end */
+	for(;;)
+	{
+		ahd_int root, child;
+		if(i > 0)      { --i; }
+		else if(--n)   { ahd__memswap(arr, arr + n * el_size, el_size); }
+		else           { break; }
+
+		for(root = i; (child = 2 * root + 1) < n; root = child)
 		{
-			int cmp = 0;
-			b = a + el_size;
-			switch(member_size) {
-				case sizeof (char): {
-					char A = *(char *)a, B = *(char *)b;
-					cmp = A > B ? 1 : A < B ? -1 : 0;
-				} break;
-
-				case sizeof (short): {
-					short A = *(short *)a, B = *(short *)b;
-					cmp = A > B ? 1 : A < B ? -1 : 0;
-				} break;
-
-				case sizeof (int): {
-					int A = *(int *)a, B = *(int *)b;
-					cmp = A > B ? 1 : A < B ? -1 : 0;
-				} break;
-
-				case sizeof (long long): {
-					long long A = *(long long *)a, B = *(long long *)b;
-					cmp = A > B ? 1 : A < B ? -1 : 0;
-				} break;
-
-				/* case sizeof (char *):               cmp = strcmp(*(char **)a, *(char **)b);          break; */
-				/* case sizeof (char *):               cmp = strncmp((char *)a, (char *)b, str_len);          break; */
-
-				default: result = 0;
-			}
+			if(child + 1 < n &&
+			   ahd__sortcmp(s, arr + child * el_size, arr + (child + 1) * el_size) < 0)
+			{ ++child; }
 
-			if(cmp * dir > 0) {
-				// TODO: speed up with memmove (don't swap all of them)
-				ahd__memswap(a-member_offset, b-member_offset, el_size);
-				if(a == arr) { break; }
-			} else break;
+			if(ahd__sortcmp(s, arr + root * el_size, arr + child * el_size) >= 0)
+			{ break; }
+			ahd__memswap(arr + root * el_size, arr + child * el_size, el_size);
 		}
 	}
+}
+
+static void
+ahd__sort_intro(ahd__sorter *s, char *arr, ahd_int len, int depth)
+{
+	ahd_int el_size = s->el_size;
+
+	while(len > AHD_SORT_INSERTION_MAX)
+	{
+		char *lo  = arr,
+			 *mid = arr + (len / 2) * el_size,
+			 *hi  = arr + (len - 1) * el_size,
+			 *i, *j;
+		ahd_int n_lo, n_hi;
+
+		if(depth-- == 0)
+		{ ahd__sort_heap(s, arr, len); return; }
+
+		/* median of 3, leaving hi >= pivot as a sentinel */
+		if(ahd__sortcmp(s, mid, lo) < 0) { ahd__memswap(mid, lo, el_size); }
+		if(ahd__sortcmp(s, hi, mid) < 0) {
+			ahd__memswap(hi, mid, el_size);
+			if(ahd__sortcmp(s, mid, lo) < 0) { ahd__memswap(mid, lo, el_size); }
+		}
+		ahd__memswap(lo, mid, el_size); /* pivot lives at arr[0] while partitioning */
+
+		/* Hoare partition; stopping on equal keys keeps duplicates balanced */
+		for(i = arr, j = arr + len * el_size; ; ahd__memswap(i, j, el_size))
+		{
+			do { i += el_size; } while(ahd__sortcmp(s, i, arr) < 0);
+			do { j -= el_size; } while(ahd__sortcmp(s, arr, j) < 0);
+			if(i >= j) { break; }
+		}
+		ahd__memswap(arr, j, el_size);
+
+		/* recurse on the smaller side to bound stack depth, loop on the larger */
+		n_lo = (ahd_int)(j - arr) / el_size;
+		n_hi = len - n_lo - 1;
+		if(n_lo < n_hi) { ahd__sort_intro(s, arr,          n_lo, depth); arr = j + el_size; len = n_hi; }
+		else            { ahd__sort_intro(s, j + el_size,  n_hi, depth);                    len = n_lo; }
+	}
+
+	ahd__sort_insertion(s, arr, len);
+}
+
+/* 1 if already in order, -1 if strictly in reverse order (reversing keeps it stable), else 0 */
+static int
+ahd__sort_presorted(ahd__sorter *s, char *arr, ahd_int len)
+{
+	ahd_int el_size = s->el_size;
+	char *at, *guard = arr + len * el_size;
+	int cmp = ahd__sortcmp(s, arr, arr + el_size);
+
+	for(at = arr + el_size; at + el_size < guard; at += el_size)
+	{
+		int next = ahd__sortcmp(s, at, at + el_size);
+		if(cmp <= 0 ? next > 0 : next <= 0)
+		{ return 0; }
+	}
+	return cmp <= 0 ? 1 : -1;
+}
+
+/* Radix sort ****************************************************************
+ * LSD radix sort on the key bytes, moving whole elements through a scratch
+ * buffer. Keys are mapped to unsigned integers with the same ordering:
+ * signed ints have their sign bit flipped, floats are flipped entirely if
+ * negative (sign bit set otherwise). Stable.
+ */
+#ifndef  AHD_SORT_RADIX_MIN
+# define AHD_SORT_RADIX_MIN 512 /* ahd__sort switches to radix at this many elements */
+#endif// AHD_SORT_RADIX_MIN
+#ifndef  AHD_SORT_RADIX_MAX_EL_SIZE
+# define AHD_SORT_RADIX_MAX_EL_SIZE 64 /* ...as long as elements are cheap enough to move */
+#endif// AHD_SORT_RADIX_MAX_EL_SIZE
+
+static unsigned long long
+ahd__radixkey(char const *key, int type, ahd_sort_dir dir)
+{
+	int key_bits = (type & 0xF) * 8;
+	unsigned long long k = 0,
+	                   top_bit = 1ull << (key_bits - 1),
+	                   mask = top_bit | (top_bit - 1);
+
+	switch(type & 0xF) {
+		case sizeof (unsigned char):      k = *(unsigned char *)key;      break;
+		case sizeof (unsigned short):     k = *(unsigned short *)key;     break;
+		case sizeof (unsigned int):       k = *(unsigned int *)key;       break;
+		case sizeof (unsigned long long): k = *(unsigned long long *)key; break;
+	}
+
+	if(type & ahd_FLT)       { k = (k & top_bit) ? ~k & mask : k | top_bit; }
+	else if(type & ahd_SIGN) { k ^= top_bit; }
+
+	return dir == ahd_DESC ? ~k & mask : k;
+}
+
+static int
+ahd__radixsort(void *array, ahd_int len, ahd_int el_size, ahd_int mem_off, int type, ahd_sort_dir dir)
+{
+	ahd_int counts[8][256] = {{0}};
+	ahd_int key_size = type & 0xF, i, pass;
+	char *src = (char *)array, *dst, *scratch, *el, *guard = src + len * el_size;
+
+	if(! ahd__sort_validtype(type))
+	{ return 0; }
+	if(len < 2)
+	{ return 1; }
+
+	scratch = dst = (char *)AHD_REALLOC(0, len * el_size);
+	if(! scratch)
+	{ return 0; }
+
+	/* histograms for every pass in one read of the keys */
+	for(el = src; el < guard; el += el_size) {
+		unsigned long long k = ahd__radixkey(el + mem_off, type, dir);
+		for(pass = 0; pass < key_size; ++pass, k >>= 8)
+		{ ++counts[pass][k & 0xFF]; }
+	}
+
+	for(pass = 0; pass < key_size; ++pass)
+	{
+		ahd_int *count = counts[pass], offset = 0;
+		int shift = (int)pass * 8;
+		char *tmp;
+
+		/* every key has the same byte here: nothing to do */
+		if(count[(ahd__radixkey(src + mem_off, type, dir) >> shift) & 0xFF] == len)
+		{ continue; }
+
+		for(i = 0; i < 256; ++i) {
+			ahd_int c = count[i];
+			count[i] = offset;
+			offset += c;
+		}
+
+		for(el = src, guard = src + len * el_size; el < guard; el += el_size) {
+			ahd_int b = (ahd__radixkey(el + mem_off, type, dir) >> shift) & 0xFF;
+			AHD_MEMCPY(dst + count[b]++ * el_size, el, el_size);
+		}
 
+		tmp = src, src = dst, dst = tmp;
+	}
+
+	if(src != (char *)array)
+	{ AHD_MEMCPY(array, src, len * el_size); }
+	AHD_FREE(scratch);
+	return 1;
+}
+
+/* Index sort *****************************************************************
+ * Sorts (key, index) pairs rather than the elements themselves, giving a
+ * permutation: perm[i] is the index of the element that belongs at i.
+ * Applying that with ahd__mempermute moves each element exactly once.
+ * Stable, as the pairs are radix sorted.
+ */
+typedef struct ahd__idxkey {
+	unsigned long long key;
+	ahd_int idx;
+} ahd__idxkey;
+
+/* returns an ahd_arr array, to be freed by the caller */
+static ahd_int *
+ahd__sortperm(void *array, ahd_int len, ahd_int el_size, ahd_int mem_off, int type, ahd_sort_dir dir)
+{
+	char *el = (char *)array;
+	ahd__idxkey *keys;
+	ahd_int *perm = 0, i;
+
+	if(! ahd__sort_validtype(type))
+	{ return 0; }
+
+	keys = (ahd__idxkey *)AHD_REALLOC(0, (len ? len : 1) * sizeof(*keys));
+	if(! keys)
+	{ return 0; }
+
+	for(i = 0; i < len; ++i, el += el_size) {
+		keys[i].key = ahd__radixkey(el + mem_off, type, dir);
+		keys[i].idx = i;
+	}
+
+	if(ahd__radixsort(keys, len, sizeof(*keys), 0, ahd_INT | sizeof(keys->key), ahd_ASC)) {
+		perm = (ahd_int *)ahd__setcap(0, len, sizeof(*perm), sizeof(ahd_arr), 0);
+		if((uintptr_t)perm == sizeof(ahd_arr))
+		{ perm = 0; } /* out of memory */
+		else {
+			ahd__len(ahd_arr, perm) = len;
+			for(i = 0; i < len; ++i)
+			{ perm[i] = keys[i].idx; }
+		}
+	}
+
+	AHD_FREE(keys);
+	return perm;
+}
+
+/* in-place cycle-following permutation: arr[i] = old arr[perm[i]] */
+static int
+ahd__mempermute(void *array, ahd_int len, ahd_int el_size, ahd_int *perm)
+{
+	char buf[AHD_STACK_BUF_SIZE];
+	char *arr = (char *)array,
+		 *tmp = el_size <= sizeof(buf) ? buf : (char *)AHD_REALLOC(0, el_size);
+	ahd_int done = (ahd_int)1 << (sizeof(ahd_int) * 8 - 1), i, j, k;
+
+	if(! tmp)
+	{ return 0; }
+
+	for(i = 0; i < len; ++i)
+	{
+		if(perm[i] & done || perm[i] == i)
+		{ continue; }
+
+		AHD_MEMCPY(tmp, arr + i * el_size, el_size);
+		for(j = i; (k = perm[j]) != i; j = k) {
+			perm[j] |= done;
+			AHD_MEMCPY(arr + j * el_size, arr + k * el_size, el_size);
+		}
+		perm[j] |= done;
+		AHD_MEMCPY(arr + j * el_size, tmp, el_size);
+	}
+
+	/* leave perm as we found it */
+	for(i = 0; i < len; ++i)
+	{ perm[i] &= ~done; }
+
+	if(tmp != buf)
+	{ AHD_FREE(tmp); }
+	return 1;
+}
+
+static int
+ahd__stablesort(void *array, ahd_int len, ahd_int el_size, ahd_int mem_off, int type, ahd_sort_dir dir)
+{
+	ahd_int *perm = ahd__sortperm(array, len, el_size, mem_off, type, dir);
+	int result = perm && ahd__mempermute(array, len, el_size, perm);
+	ahd_free(ahd_arr, perm);
 	return result;
 }
 
+static int
+ahd__sort(void *array, ahd_int len, ahd_int el_size, ahd_int mem_off, int type, ahd_sort_dir dir)
+{
+	char buf[AHD_STACK_BUF_SIZE];
+	ahd__sorter s;
+	int depth = 0;
+	ahd_int n;
+
+	if(! ahd__sort_validtype(type))
+	{ return 0; }
+	if(len < 2)
+	{ return 1; }
+
+	s.tmp     = el_size <= sizeof(buf) ? buf : (char *)AHD_REALLOC(0, el_size);
+	s.el_size = el_size;
+	s.mem_off = mem_off;
+	s.type    = type;
+	s.dir     = dir;
+	if(! s.tmp)
+	{ return 0; }
+
+	for(n = len; n; n >>= 1) { depth += 2; } /* 2 * log2(len) */
+
+	switch(ahd__sort_presorted(&s, (char *)array, len)) {
+		case  1: break;
+		case -1: ahd__memreverse(array, len, el_size); break;
+		default:
+			/* large elements: sort their keys, then move each element once */
+			if(len < AHD_SORT_RADIX_MIN ||
+			   ! (el_size > AHD_SORT_RADIX_MAX_EL_SIZE
+			      ? ahd__stablesort(array, len, el_size, mem_off, type, dir)
+			      : ahd__radixsort (array, len, el_size, mem_off, type, dir)))
+			{ ahd__sort_intro(&s, (char *)array, len, depth); }
+	}
+
+	if(s.tmp != buf)
+	{ AHD_FREE(s.tmp); }
+	return 1;
+}
+
+static int
+ahd__sorti(void *array, ahd_int hdr_size, ahd_int el_size, void *member, ahd_int member_size, ahd_sort_dir dir)
+{
+	char *arr = (char *)array;
+	if(! arr) { return 1; }
+	return ahd__sort(arr, ((ahd_arr *)(arr - hdr_size))->len, el_size,
+	                 (ahd_int)((char *)member - arr), ahd_INT | ahd_SIGN | (int)member_size, dir);
+}
+
 static int
 ahd__sortu(void *array, ahd_int hdr_size, ahd_int el_size, void *member, ahd_int member_size, ahd_sort_dir dir)
 {
-	int result = 1;
 	char *arr = (char *)array;
-	ahd_arr *head = (ahd_arr *)(arr - hdr_size);
-	ahd_int len = head->len,
-			member_offset = (ahd_int)((char *)member - arr);
-	char *guard = arr + len * el_size, *at, *a, *b;
+	if(! arr) { return 1; }
+	return ahd__sort(arr, ((ahd_arr *)(arr - hdr_size))->len, el_size,
+	                 (ahd_int)((char *)member - arr), ahd_INT | (int)member_size, dir);
+}
+
+static int
+ahd__sortf(void *array, ahd_int hdr_size, ahd_int el_size, void *member, ahd_int member_size, ahd_sort_dir dir)
+{
+	char *arr = (char *)array;
+	if(! arr) { return 1; }
+	return ahd__sort(arr, ((ahd_arr *)(arr - hdr_size))->len, el_size,
+	                 (ahd_int)((char *)member - arr), ahd_FLT | (int)member_size, dir);
+}
 
-	/* insertion sort */
-	for(at = arr; at + el_size < guard; at += el_size)
+static int
+ahd__radixi(void *array, ahd_int hdr_size, ahd_int el_size, void *member, ahd_int member_size, ahd_sort_dir dir)
+{
+	char *arr = (char *)array;
+	if(! arr) { return 1; }
+	return ahd__radixsort(arr, ((ahd_arr *)(arr - hdr_size))->len, el_size,
+	                      (ahd_int)((char *)member - arr), ahd_INT | ahd_SIGN | (int)member_size, dir);
+}
+
+static int
+ahd__radixu(void *array, ahd_int hdr_size, ahd_int el_size, void *member, ahd_int member_size, ahd_sort_dir dir)
+{
+	char *arr = (char *)array;
+	if(! arr) { return 1; }
+	return ahd__radixsort(arr, ((ahd_arr *)(arr - hdr_size))->len, el_size,
+	                      (ahd_int)((char *)member - arr), ahd_INT | (int)member_size, dir);
+}
+
+static int
+ahd__radixf(void *array, ahd_int hdr_size, ahd_int el_size, void *member, ahd_int member_size, ahd_sort_dir dir)
+{
+	char *arr = (char *)array;
+	if(! arr) { return 1; }
+	return ahd__radixsort(arr, ((ahd_arr *)(arr - hdr_size))->len, el_size,
+	                      (ahd_int)((char *)member - arr), ahd_FLT | (int)member_size, dir);
+}
+
+static ahd_int *
+ahd__sortidx(void *array, ahd_int hdr_size, ahd_int el_size, void *member, int type, ahd_sort_dir dir)
+{
+	char *arr = (char *)array;
+	return ahd__sortperm(arr, arr ? ((ahd_arr *)(arr - hdr_size))->len : 0, el_size,
+	                     (ahd_int)((char *)member - arr), type, dir);
+}
+
+static int
+ahd__permute(void *array, ahd_int hdr_size, ahd_int el_size, ahd_int *perm)
+{
+	char *arr = (char *)array;
+	ahd_int len;
+	if(! arr) { return 1; }
+	len = ahd__min(((ahd_arr *)(arr - hdr_size))->len, ahd_len(ahd_arr, perm));
+#if AHD_BOUNDS_CHECK
 	{
-		for(a = at + member_offset; ; a -= el_size)
-		{
-			int cmp = 0;
-			b = a + el_size;
-
-			switch(member_size) {
-				case sizeof (unsigned char): {
-					unsigned char A = *(char *)a, B = *(char *)b;
-					cmp = A > B ? 1 : A < B ? -1 : 0;
-				} break;
-
-				case sizeof (unsigned short): {
-					unsigned short A = *(short *)a, B = *(short *)b;
-					cmp = A > B ? 1 : A < B ? -1 : 0;
-				} break;
-
-				case sizeof (unsigned int): {
-					unsigned int A = *(int *)a, B = *(int *)b;
-					cmp = A > B ? 1 : A < B ? -1 : 0;
-				} break;
-
-				case sizeof (unsigned long long): {
-					unsigned long long A = *(long long *)a, B = *(long long *)b;
-					cmp = A > B ? 1 : A < B ? -1 : 0;
-				} break;
-
-				default: result = 0;
+		ahd_int i;
+		for(i = 0; i < len; ++i)
+		{ ahd__bc(len, perm[i]); }
+	}
+#endif
+	return ahd__mempermute(arr, len, el_size, perm);
+}
+
+static int
+ahd__stablesortx(void *array, ahd_int hdr_size, ahd_int el_size, void *member, int type, ahd_sort_dir dir)
+{
+	char *arr = (char *)array;
+	if(! arr) { return 1; }
+	return ahd__stablesort(arr, ((ahd_arr *)(arr - hdr_size))->len, el_size,
+	                       (ahd_int)((char *)member - arr), type, dir);
+}
+
+/* Parallel sort **************************************************************
+ * The array is cut into one run per thread (a power of 2 of them), each run is
+ * sorted with ahd__sort, then pairs of runs are merged into a scratch copy and
+ * back until one is left. Every merge round keeps all threads busy: the threads
+ * on a pair each write an equal share of its output, finding where their share
+ * starts in both runs with a binary search.
+ */
+#ifndef  AHD_PSORT_MIN
+# define AHD_PSORT_MIN (1 << 16) /* fewer elements than this are sorted on the calling thread */
+#endif// AHD_PSORT_MIN
+#ifndef  AHD_PSORT_THREADS
+# define AHD_PSORT_THREADS 0     /* 0: 1 thread per core */
+#endif// AHD_PSORT_THREADS
+
+/* number of threads used by ahd_psort*; <= 0 for 1 per core */
+static int ahd_psort_threads = AHD_PSORT_THREADS;
+
+typedef struct ahd__psorter {
+	ahd__sorter s;
+	char *src, *dst;  /* merge from src to dst */
+	ahd_int len;
+	int n_runs;
+	int run_w;        /* runs (of the initial n_runs) per run being merged */
+	int ok[AHD_MAX_THREADS];
+} ahd__psorter;
+
+/* start of initial run i */
+#define ahd__psort_at(p, i) ((ahd_int)(i) * (p)->len / (ahd_int)(p)->n_runs)
+
+static void
+ahd__psort_run(void *data, int i, int n)
+{
+	ahd__psorter *p = (ahd__psorter *)data;
+	ahd_int el_size = p->s.el_size, at = ahd__psort_at(p, i);
+	p->ok[i] = ahd__sort(p->src + at * el_size, ahd__psort_at(p, i + 1) - at, el_size,
+	                     p->s.mem_off, p->s.type, (ahd_sort_dir)p->s.dir);
+	(void)n;
+}
+
+/* the number of elements taken from a in the first k of the (stable) merge of a & b */
+static ahd_int
+ahd__psort_corank(ahd__psorter *p, char *a, ahd_int a_n, char *b, ahd_int b_n, ahd_int k)
+{
+	ahd_int el_size = p->s.el_size;
+	ahd_int lo = k > b_n ? k - b_n : 0, hi = ahd__min(k, a_n);
+	while(lo < hi) {
+		ahd_int i = lo + (hi - lo) / 2, j = k - i;
+		if(ahd__sortcmp(&p->s, b + (j - 1) * el_size, a + i * el_size) >= 0)
+		{ lo = i + 1; } /* a[i] comes before b[j-1]: take more from a */
+		else
+		{ hi = i; }
+	}
+	return lo;
+}
+
+static void
+ahd__psort_merge(void *data, int i_thread, int n)
+{
+	ahd__psorter *p = (ahd__psorter *)data;
+	ahd_int el_size = p->s.el_size;
+	int n_pair = 2 * p->run_w; /* threads per pair == initial runs per pair */
+	int pair = i_thread / n_pair, part = i_thread % n_pair;
+	ahd_int lo  = ahd__psort_at(p, pair * n_pair),
+	        mid = ahd__psort_at(p, ahd__min(pair * n_pair + p->run_w, p->n_runs)),
+	        hi  = ahd__psort_at(p, ahd__min(pair * n_pair + n_pair,   p->n_runs));
+	char *a = p->src + lo * el_size, *b = p->src + mid * el_size;
+	ahd_int a_n = mid - lo, b_n = hi - mid;
+	ahd_int k     = (hi - lo) * part / n_pair,
+	        k_end = (hi - lo) * (part + 1) / n_pair;
+	ahd_int i = ahd__psort_corank(p, a, a_n, b, b_n, k), j = k - i;
+	char *out = p->dst + (lo + k) * el_size;
+
+	for(; k < k_end; ++k, out += el_size) {
+		if(j >= b_n || (i < a_n && ahd__sortcmp(&p->s, b + j * el_size, a + i * el_size) >= 0))
+		{ AHD_MEMCPY(out, a + i++ * el_size, el_size); }
+		else
+		{ AHD_MEMCPY(out, b + j++ * el_size, el_size); }
+	}
+	(void)n;
+}
+
+static void
+ahd__psort_copy(void *data, int i, int n)
+{
+	ahd__psorter *p = (ahd__psorter *)data;
+	ahd_int at = ahd__psort_at(p, i) * p->s.el_size;
+	AHD_MEMCPY(p->dst + at, p->src + at, ahd__psort_at(p, i + 1) * p->s.el_size - at);
+	(void)n;
+}
+
+static int
+ahd__psortmem(void *array, ahd_int len, ahd_int el_size, ahd_int mem_off, int type, ahd_sort_dir dir, int n_threads)
+{
+	ahd__psorter p;
+	char *scratch;
+	int i, result = 1;
+
+	if(len < AHD_PSORT_MIN)
+	{ return ahd__sort(array, len, el_size, mem_off, type, dir); }
+	if(n_threads <= 0)
+	{ n_threads = ahd_num_cores(); }
+	n_threads = ahd__min(n_threads, AHD_MAX_THREADS);
+	while(n_threads & (n_threads - 1)) { n_threads &= n_threads - 1; } /* round down to power of 2 */
+
+	if(n_threads < 2 || len < AHD_PSORT_MIN || ! ahd__sort_validtype(type))
+	{ return ahd__sort(array, len, el_size, mem_off, type, dir); }
+
+	p.s.tmp     = 0;
+	p.s.el_size = el_size;
+	p.s.mem_off = mem_off;
+	p.s.type    = type;
+	p.s.dir     = dir;
+	switch(ahd__sort_presorted(&p.s, (char *)array, len)) {
+		case  1: return 1;
+		case -1: ahd__memreverse(array, len, el_size); return 1;
+	}
+
+	scratch = (char *)AHD_REALLOC(0, len * el_size);
+	if(! scratch)
+	{ return ahd__sort(array, len, el_size, mem_off, type, dir); }
+
+	p.src    = (char *)array;
+	p.dst    = scratch;
+	p.len    = len;
+	p.n_runs = n_threads;
+	ahd__parallel(ahd__psort_run, &p, n_threads);
+	for(i = 0; i < n_threads; ++i) { result &= p.ok[i]; }
+
+	for(p.run_w = 1; p.run_w < n_threads; p.run_w *= 2) {
+		char *swap = p.src;
+		ahd__parallel(ahd__psort_merge, &p, n_threads);
+		p.src = p.dst, p.dst = swap;
+	}
+	if(p.src != (char *)array) {
+		p.dst = (char *)array;
+		ahd__parallel(ahd__psort_copy, &p, n_threads);
+	}
+
+	AHD_FREE(scratch);
+	return result;
+}
+#undef ahd__psort_at
+
+static int
+ahd__psort(void *array, ahd_int hdr_size, ahd_int el_size, void *member, int type, ahd_sort_dir dir)
+{
+	char *arr = (char *)array;
+	if(! arr) { return 1; }
+	return ahd__psortmem(arr, ((ahd_arr *)(arr - hdr_size))->len, el_size,
+	                     (ahd_int)((char *)member - arr), type, dir, ahd_psort_threads);
+}
+
+/* String sort ****************************************************************
+ * Multikey quicksort over (prefix, string, index) keys. Each key caches the
+ * next 8 bytes of its string as a big-endian word, so most comparisons are a
+ * single integer compare without touching the string. Only when a group of
+ * keys shares a prefix are the next 8 bytes loaded, for that group alone.
+ * Equal strings are ordered by index, so the result is stable; the elements
+ * are then moved into place with ahd__mempermute.
+ */
+typedef struct ahd__strkey {
+	unsigned long long pfx; /* bytes [depth, depth+8) of str, 0-padded after its end */
+	char const *str;
+	ahd_int idx;
+} ahd__strkey;
+
+typedef struct ahd__strsorter {
+	ahd_int max_len; /* for char array members, which may not be 0-terminated */
+	ahd_sort_dir dir;
+} ahd__strsorter;
+
+static unsigned long long
+ahd__strpfx(char const *str, ahd_int depth, ahd_int max_len)
+{
+	unsigned long long pfx = 0;
+	ahd_int i;
+	for(i = depth; i < depth + 8; ++i) {
+		unsigned char c = i < max_len ? (unsigned char)str[i] : 0;
+		pfx = pfx << 8 | c;
+		if(! c) { return pfx << 8 * (depth + 7 - i); }
+	}
+	return pfx;
+}
+
+/* pfx ends in a 0 byte iff the string ended within it */
+#define ahd__strpfx_ended(pfx) (((pfx) & 0xFF) == 0)
+
+static int
+ahd__strkeycmp(ahd__strsorter *s, ahd__strkey const *a, ahd__strkey const *b, ahd_int depth)
+{
+	ahd_int i;
+	if(a->pfx != b->pfx)
+	{ return a->pfx < b->pfx ? -1 : 1; }
+
+	for(i = depth + 8; ! ahd__strpfx_ended(a->pfx) && i < s->max_len; ++i) {
+		unsigned char ca = (unsigned char)a->str[i], cb = (unsigned char)b->str[i];
+		if(ca != cb) { return ca < cb ? -1 : 1; }
+		if(! ca)     { break; }
+	}
+	/* equal strings: keep the original order (reversed for DESC, which is undone at the end) */
+	return ((a->idx > b->idx) - (a->idx < b->idx)) * (int)s->dir;
+}
+
+static void
+ahd__strsort_insertion(ahd__strsorter *s, ahd__strkey *keys, ahd_int n, ahd_int depth)
+{
+	ahd_int i, j;
+	for(i = 1; i < n; ++i) {
+		ahd__strkey k = keys[i];
+		for(j = i; j > 0 && ahd__strkeycmp(s, &keys[j-1], &k, depth) > 0; --j)
+		{ keys[j] = keys[j-1]; }
+		keys[j] = k;
+	}
+}
+
+/* moves keys that share the prefix pivot on to their next 8 bytes;
+ * returns 0 if there are none (the strings are identical, so are sorted here) */
+static int
+ahd__strsort_next(ahd__strsorter *s, ahd__strkey *keys, ahd_int n, unsigned long long pivot, ahd_int depth)
+{
+	ahd_int i;
+	if(ahd__strpfx_ended(pivot)) {
+		/* identical strings; only the original order is left to sort on */
+		ahd__sort(keys, n, sizeof(*keys), (ahd_int)((char *)&keys->idx - (char *)keys),
+		          ahd_INT | sizeof(keys->idx), s->dir);
+		return 0;
+	}
+
+	for(i = 0; i < n; ++i)
+	{ keys[i].pfx = ahd__strpfx(keys[i].str, depth + 8, s->max_len); }
+	return 1;
+}
+
+static void
+ahd__strsort_mkq(ahd__strsorter *s, ahd__strkey *keys, ahd_int n, ahd_int depth)
+{
+	while(n > AHD_SORT_INSERTION_MAX)
+	{
+		unsigned long long a = keys[0].pfx, b = keys[n/2].pfx, c = keys[n-1].pfx, pivot;
+		ahd_int lt = 0, i = 0, gt = n;
+
+		pivot = a < b ? (b < c ? b : a < c ? c : a)
+		              : (a < c ? a : b < c ? c : b);
+
+		/* 3-way partition: [0,lt) < pivot, [lt,gt) == pivot, [gt,n) > pivot */
+		while(i < gt) {
+			ahd__strkey t;
+			if(keys[i].pfx < pivot)      { t = keys[i]; keys[i++] = keys[lt]; keys[lt++] = t; }
+			else if(keys[i].pfx > pivot) { t = keys[i]; keys[i] = keys[--gt]; keys[gt] = t; }
+			else                         { ++i; }
+		}
+
+		/* recurse on the 2 smaller parts to bound stack depth, loop on the largest */
+		if(gt - lt >= lt && gt - lt >= n - gt) {
+			ahd__strsort_mkq(s, keys,      lt,     depth);
+			ahd__strsort_mkq(s, keys + gt, n - gt, depth);
+
+			keys += lt, n = gt - lt;
+			if(! ahd__strsort_next(s, keys, n, pivot, depth))
+			{ return; }
+			depth += 8;
+		}
+		else {
+			if(ahd__strsort_next(s, keys + lt, gt - lt, pivot, depth))
+			{ ahd__strsort_mkq(s, keys + lt, gt - lt, depth + 8); }
+
+			if(lt < n - gt) { ahd__strsort_mkq(s, keys,      lt,     depth); keys += gt, n -= gt; }
+			else            { ahd__strsort_mkq(s, keys + gt, n - gt, depth); n = lt; }
+		}
+	}
+
+	ahd__strsort_insertion(s, keys, n, depth);
+}
+
+/* type is ahd_STR for `char *` members, ahd_CHR for `char [member_size]` members
+ * returns an ahd_arr array, to be freed by the caller */
+static ahd_int *
+ahd__sortstrperm(void *array, ahd_int len, ahd_int el_size, ahd_int mem_off, int type, ahd_int member_size, ahd_sort_dir dir)
+{
+	char *el = (char *)array;
+	ahd__strsorter s;
+	ahd__strkey *keys;
+	ahd_int *perm = 0, i;
+
+	s.max_len = type == ahd_CHR ? member_size : ~(ahd_int)0;
+	s.dir     = dir;
+
+	keys = (ahd__strkey *)AHD_REALLOC(0, (len ? len : 1) * sizeof(*keys));
+	if(! keys)
+	{ return 0; }
+
+	for(i = 0; i < len; ++i, el += el_size) {
+		char const *str = type == ahd_CHR ? el + mem_off : *(char const **)(el + mem_off);
+		keys[i].str = str ? str : "";
+		keys[i].pfx = ahd__strpfx(keys[i].str, 0, s.max_len);
+		keys[i].idx = i;
+	}
+
+	ahd__strsort_mkq(&s, keys, len, 0);
+
+	perm = (ahd_int *)ahd__setcap(0, len, sizeof(*perm), sizeof(ahd_arr), 0);
+	if((uintptr_t)perm == sizeof(ahd_arr))
+	{ perm = 0; } /* out of memory */
+	else {
+		ahd__len(ahd_arr, perm) = len;
+		for(i = 0; i < len; ++i)
+		{ perm[i] = keys[dir == ahd_DESC ? len - 1 - i : i].idx; }
+	}
+
+	AHD_FREE(keys);
+	return perm;
+}
+
+static ahd_int *
+ahd__sortidxstr(void *array, ahd_int hdr_size, ahd_int el_size, void *member, int type, ahd_int member_size, ahd_sort_dir dir)
+{
+	char *arr = (char *)array;
+	return ahd__sortstrperm(arr, arr ? ((ahd_arr *)(arr - hdr_size))->len : 0, el_size,
+	                        (ahd_int)((char *)member - arr), type, member_size, dir);
+}
+
+static int
+ahd__sortstr(void *array, ahd_int hdr_size, ahd_int el_size, void *member, int type, ahd_int member_size, ahd_sort_dir dir)
+{
+	char *arr = (char *)array;
+	ahd_int *perm;
+	int result;
+	if(! arr) { return 1; }
+
+	perm   = ahd__sortidxstr(arr, hdr_size, el_size, member, type, member_size, dir);
+	result = perm && ahd__mempermute(arr, ((ahd_arr *)(arr - hdr_size))->len, el_size, perm);
+	ahd_free(ahd_arr, perm);
+	return result;
+}
+
+/******************************************************************************/
+/* Set operations *************************************************************/
+/******************************************************************************/
+/* Each returns a new array (NULL if it would be empty) of distinct elements,
+ * compared by their bytes, or by those of the member at mem for the *by
+ * variants (mem is its address in a's first element). Elements come in the
+ * order they first appear in a, then b; if a and b are already sorted (by the
+ * key as a signed/unsigned integer, or by memcmp), they are merged instead of
+ * hashed and the result is sorted.
+ * Padding bytes are compared too: zero structs (e.g. `= {0}`) before filling them.
+ */
+typedef enum ahd_setop {
+	ahd_UNIQUE,       /* a, with later repeats removed */
+	ahd_UNIQUEADJ,    /* a, with elements equal to the one before removed: {a,b,b,c,b} -> {a,b,c,b} */
+	ahd_UNION,        /* in a or b */
+	ahd_INTERSECTION, /* in a and b */
+	ahd_DIFFERENCE,   /* in a but not b */
+	ahd_SYMDIFF,      /* in a or b but not both */
+} ahd_setop;
+
+#define ahd__setx(op,ht,a,b,off,size) \
+	ahd__setop(op, a, b, sizeof(ht), sizeof(*(a)), AHD_ALIGNOF(ht), off, size)
+#define ahd__memoff(a,mem)                 ((ahd_int)((char *)(mem) - (char *)(a)))
+
+#define ahd_unique(ht,a)                   ahd__setx(ahd_UNIQUE,       ht,a,0, 0, sizeof(*(a)))
+#define ahd_uniqueadj(ht,a)                ahd__setx(ahd_UNIQUEADJ,    ht,a,0, 0, sizeof(*(a)))
+#define ahd_union(ht,a,b)                  ahd__setx(ahd_UNION,        ht,a,b, 0, sizeof(*(a)))
+#define ahd_intersection(ht,a,b)           ahd__setx(ahd_INTERSECTION, ht,a,b, 0, sizeof(*(a)))
+#define ahd_difference(ht,a,b)             ahd__setx(ahd_DIFFERENCE,   ht,a,b, 0, sizeof(*(a)))
+#define ahd_symdiff(ht,a,b)                ahd__setx(ahd_SYMDIFF,      ht,a,b, 0, sizeof(*(a)))
+
+#define ahd_uniqueby(ht,a,mem)             ahd__setx(ahd_UNIQUE,       ht,a,0, ahd__memoff(a,mem), sizeof(*(mem)))
+#define ahd_uniqueadjby(ht,a,mem)          ahd__setx(ahd_UNIQUEADJ,    ht,a,0, ahd__memoff(a,mem), sizeof(*(mem)))
+#define ahd_unionby(ht,a,b,mem)            ahd__setx(ahd_UNION,        ht,a,b, ahd__memoff(a,mem), sizeof(*(mem)))
+#define ahd_intersectionby(ht,a,b,mem)     ahd__setx(ahd_INTERSECTION, ht,a,b, ahd__memoff(a,mem), sizeof(*(mem)))
+#define ahd_differenceby(ht,a,b,mem)       ahd__setx(ahd_DIFFERENCE,   ht,a,b, ahd__memoff(a,mem), sizeof(*(mem)))
+#define ahd_symdiffby(ht,a,b,mem)          ahd__setx(ahd_SYMDIFF,      ht,a,b, ahd__memoff(a,mem), sizeof(*(mem)))
+/* Usage:
+ * int *ids = ..., *seen = ...;
+ * int *new_ids = (int *)arr_difference(ids, seen); // each id once, unless already seen
+ * obj_t *one_per_kind = (obj_t *)arr_uniqueby(objects, &objects->kind);
+ */
+
+static inline ahd_int
+ahd__hashbytes(void const *bytes, ahd_int size)
+{
+	unsigned char const *p = (unsigned char const *)bytes;
+	ahd_int h = 0x9e3779b97f4a7c15ull ^ size, w;
+	for(; size >= 8; size -= 8, p += 8) {
+		AHD_MEMCPY(&w, p, 8);
+		h = (h ^ w) * 0xff51afd7ed558ccdull;
+		h ^= h >> 32;
+	}
+	if(size) {
+		w = 0;
+		AHD_MEMCPY(&w, p, size);
+		h = (h ^ w) * 0xff51afd7ed558ccdull;
+	}
+	h ^= h >> 29;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	return h ^ (h >> 32);
+}
+
+/* Open addressing with linear probing. Each slot has the element (0 if empty)
+ * and a tag: the key itself if it fits, so that probes rarely have to look at
+ * the element, or its hash.
+ */
+typedef struct ahd__hashslot {
+	ahd_int tag;
+	char const *el;
+} ahd__hashslot;
+
+typedef struct ahd__hashset {
+	ahd__hashslot *slots;
+	ahd_int mask;
+	ahd_int key_off, key_size;
+} ahd__hashset;
+
+static int
+ahd__hashset_init(ahd__hashset *h, ahd_int n, ahd_int key_off, ahd_int key_size)
+{
+	ahd_int n_slots = 16, i;
+	while(n_slots < 2 * n) { n_slots <<= 1; } /* at most half full */
+	h->slots    = (ahd__hashslot *)AHD_REALLOC(0, n_slots * sizeof(*h->slots));
+	h->mask     = n_slots - 1;
+	h->key_off  = key_off;
+	h->key_size = key_size;
+	for(i = 0; h->slots && i < n_slots; ++i) { h->slots[i].el = 0; }
+	return h->slots != 0;
+}
+
+/* the element in h with el's key; if there is none, adds el if `add` and returns 0 */
+static inline char const *
+ahd__hashset_get(ahd__hashset *h, char const *el, int add)
+{
+	char const *key = el + h->key_off;
+	ahd_int tag = 0, i;
+	int inline_key = h->key_size <= sizeof(tag);
+	ahd__hashslot *slot;
+	switch(h->key_size) { /* fixed size copies, so that they are just loads */
+		case 1:  { unsigned char      k; AHD_MEMCPY(&k, key, 1); tag = k; } break;
+		case 2:  { unsigned short     k; AHD_MEMCPY(&k, key, 2); tag = k; } break;
+		case 4:  { unsigned int       k; AHD_MEMCPY(&k, key, 4); tag = k; } break;
+		case 8:  { AHD_MEMCPY(&tag, key, 8); } break;
+		default: { if(inline_key) { AHD_MEMCPY(&tag, key, h->key_size); }
+		           else           { tag = ahd__hashbytes(key, h->key_size); } }
+	}
+
+	for(i = (inline_key ? ahd__hashbytes(&tag, sizeof(tag)) : tag) & h->mask;
+	    (slot = &h->slots[i])->el; i = (i + 1) & h->mask)
+	{
+		if(slot->tag == tag && (inline_key || AHD_MEMCMP(slot->el + h->key_off, key, h->key_size) == 0))
+		{ return slot->el; }
+	}
+	if(add)
+	{ slot->tag = tag, slot->el = el; }
+	return 0;
+}
+
+static int
+ahd__setcmp(char const *a, char const *b, ahd_int key_size, int type)
+{ return type ? ahd__keycmp(a, b, type) : AHD_MEMCMP(a, b, key_size); }
+
+/* an order (ahd_sort_type, or 0 for memcmp) that both runs of keys are ascending in, or -1 */
+static int
+ahd__setorder(char const *a, ahd_int a_n, char const *b, ahd_int b_n, ahd_int el_size, ahd_int key_off, ahd_int key_size)
+{
+	int types[3], n_types = 0, i_type;
+	ahd_int i;
+	a += key_off, b += key_off;
+	if(key_size == 1 || key_size == 2 || key_size == 4 || key_size == 8) {
+		types[n_types++] = ahd_INT | ahd_SIGN | (int)key_size;
+		types[n_types++] = ahd_INT | (int)key_size;
+	}
+	types[n_types++] = 0;
+
+	for(i_type = 0; i_type < n_types; ++i_type) {
+		int type = types[i_type], sorted = 1;
+		for(i = 1; sorted && i < a_n; ++i) { sorted = ahd__setcmp(a + (i-1)*el_size, a + i*el_size, key_size, type) <= 0; }
+		for(i = 1; sorted && i < b_n; ++i) { sorted = ahd__setcmp(b + (i-1)*el_size, b + i*el_size, key_size, type) <= 0; }
+		if(sorted)
+		{ return type; }
+	}
+	return -1;
+}
+
+/* sorted runs: one pass over each, as in merge sort */
+static ahd_int
+ahd__setmerge(ahd_setop op, char *out, char const *a, ahd_int a_n, char const *b, ahd_int b_n,
+              ahd_int el_size, ahd_int key_off, ahd_int key_size, int type)
+{
+	char const *a_end = a + a_n * el_size, *b_end = b + b_n * el_size, *last = 0;
+	ahd_int n = 0;
+#define AHD__SETOUT(el) do { \
+		if(! last || ahd__setcmp(last + key_off, (el) + key_off, key_size, type) != 0) \
+		{ AHD_MEMCPY(out + n++ * el_size, (el), el_size); last = (el); } \
+	} while(0)
+	while(a < a_end || b < b_end) {
+		int cmp = a == a_end ?  1 :
+		          b == b_end ? -1 : ahd__setcmp(a + key_off, b + key_off, key_size, type);
+		if(cmp < 0) { /* only in a */
+			if(op != ahd_INTERSECTION) { AHD__SETOUT(a); }
+			a += el_size;
+		}
+		else if(cmp > 0) { /* only in b */
+			if(op == ahd_UNION || op == ahd_SYMDIFF) { AHD__SETOUT(b); }
+			b += el_size;
+		}
+		else { /* in both: step past all of this key in b */
+			char const *el = a;
+			if(op == ahd_UNION || op == ahd_INTERSECTION) { AHD__SETOUT(a); }
+			for(; a < a_end && ahd__setcmp(a + key_off, el + key_off, key_size, type) == 0; a += el_size) {}
+			for(; b < b_end && ahd__setcmp(b + key_off, el + key_off, key_size, type) == 0; b += el_size) {}
+		}
+	}
+#undef AHD__SETOUT
+	return n;
+}
+
+static ahd_int
+ahd__sethash(ahd_setop op, char *out, char const *a, ahd_int a_n, char const *b, ahd_int b_n,
+             ahd_int el_size, ahd_int key_off, ahd_int key_size)
+{
+	ahd__hashset in_a, in_b;
+	char const *el, *a_end = a + a_n * el_size, *b_end = b + b_n * el_size;
+	ahd_int n = 0;
+	int ok;
+
+	AHD_MEMSET(&in_a, 0, sizeof(in_a));
+	AHD_MEMSET(&in_b, 0, sizeof(in_b));
+	switch(op) {
+		case ahd_UNIQUE: case ahd_UNION: /* out what wasn't already in in_a */
+			if((ok = ahd__hashset_init(&in_a, a_n + b_n, key_off, key_size))) {
+				for(el = a; el < a_end; el += el_size)
+				{ if(! ahd__hashset_get(&in_a, el, 1)) { AHD_MEMCPY(out + n++ * el_size, el, el_size); } }
+				for(el = b; op == ahd_UNION && el < b_end; el += el_size)
+				{ if(! ahd__hashset_get(&in_a, el, 1)) { AHD_MEMCPY(out + n++ * el_size, el, el_size); } }
+			}
+			break;
+
+		case ahd_INTERSECTION: /* out what is in in_b and not yet in in_a (the output) */
+			if((ok = ahd__hashset_init(&in_b, b_n, key_off, key_size) && ahd__hashset_init(&in_a, a_n, key_off, key_size))) {
+				for(el = b; el < b_end; el += el_size) { ahd__hashset_get(&in_b, el, 1); }
+				for(el = a; el < a_end; el += el_size) {
+					if(ahd__hashset_get(&in_b, el, 0) && ! ahd__hashset_get(&in_a, el, 1))
+					{ AHD_MEMCPY(out + n++ * el_size, el, el_size); }
+				}
+			}
+			break;
+
+		case ahd_DIFFERENCE: case ahd_SYMDIFF: /* out what isn't in the other; then add it there so it isn't repeated */
+			if((ok = ahd__hashset_init(&in_b, a_n + b_n, key_off, key_size) &&
+			         (op == ahd_DIFFERENCE || ahd__hashset_init(&in_a, a_n + b_n, key_off, key_size)))) {
+				for(el = b; el < b_end; el += el_size) { ahd__hashset_get(&in_b, el, 1); }
+				for(el = a; op == ahd_SYMDIFF && el < a_end; el += el_size) { ahd__hashset_get(&in_a, el, 1); }
+				for(el = a; el < a_end; el += el_size)
+				{ if(! ahd__hashset_get(&in_b, el, 1)) { AHD_MEMCPY(out + n++ * el_size, el, el_size); } }
+				for(el = b; op == ahd_SYMDIFF && el < b_end; el += el_size)
+				{ if(! ahd__hashset_get(&in_a, el, 1)) { AHD_MEMCPY(out + n++ * el_size, el, el_size); } }
 			}
+			break;
 
-			if(cmp * dir > 0) {
-				// TODO: speed up with memmove (don't swap all of them)
-				ahd__memswap(a-member_offset, b-member_offset, el_size);
-				if(a == arr) { break; }
-			} else break;
-		}
+		default: ok = 0;
 	}
-
-	return result;
+	if(in_a.slots) { AHD_FREE((void *)in_a.slots); }
+	if(in_b.slots) { AHD_FREE((void *)in_b.slots); }
+	return ok ? n : ~(ahd_int)0;
 }
 
-/* USAGE: ahd__sortint[is_signed(val)](...) */
-typedef int (*ahd__sort_int_t)(void *, ahd_int, ahd_int, void *, ahd_int, ahd_sort_dir);
-ahd__sort_int_t ahd__sortint[2] = { ahd__sortu, ahd__sorti };
-
-static int
-ahd__sortf(void *array, ahd_int hdr_size, ahd_int el_size, void *member,  ahd_int member_size, ahd_sort_dir dir)
+static void *
+ahd__setop(ahd_setop op, void *arr_a, void *arr_b, ahd_int hdr_size, ahd_int el_size, ahd_int align,
+           ahd_int key_off, ahd_int key_size)
 {
-	int result = 1;
-	char *arr = (char *)array;
-	ahd_arr *head = (ahd_arr *)(arr - hdr_size);
-	ahd_int len = head->len,
-			member_offset = (ahd_int)((char *)member - arr);
-	char *guard = arr + len * el_size, *at, *a, *b;
-	double Dir = (double)dir;
-
-	/* insertion sort */
-	for(at = arr; at + el_size < guard; at += el_size) {
-		for(a = at + member_offset; ; a -= el_size) {
-			double cmp = 0.0;
-			b = a + el_size;
-			switch(member_size) {
-				case sizeof (float):  cmp = (double)(*(float *)a  - *(float  *)b); break;
-				case sizeof (double): cmp =          *(double *)a - *(double *)b;  break;
-			}
-
-			if(cmp * Dir > 0.0) {
-				// TODO: speed up with memmove (don't swap all of them)
-				ahd__memswap(a - member_offset, b - member_offset, el_size);
-				if(a == arr) { break; }
-			} else break;
+	char const *a = (char const *)arr_a, *b = (char const *)arr_b;
+	ahd_int a_n = a ? ((ahd_arr *)(a - hdr_size))->len : 0,
+	        b_n = b && op != ahd_UNIQUE && op != ahd_UNIQUEADJ ? ((ahd_arr *)(b - hdr_size))->len : 0,
+	        n = 0, i;
+	int type;
+	char *out;
+	if(! (a_n + b_n))
+	{ return 0; }
+	if(! b_n)
+	{ b = a; }
+
+	out = (char *)ahd__setcap(0, a_n + b_n, el_size, hdr_size, align);
+	if(op == ahd_UNIQUEADJ) {
+		for(i = 0; i < a_n; ++i) {
+			char const *el = a + i * el_size;
+			if(! i || AHD_MEMCMP(el - el_size + key_off, el + key_off, key_size) != 0)
+			{ AHD_MEMCPY(out + n++ * el_size, el, el_size); }
 		}
 	}
+	else if((type = ahd__setorder(a, a_n, b, b_n, el_size, key_off, key_size)) >= 0)
+	{ n = ahd__setmerge(op, out, a, a_n, b, b_n, el_size, key_off, key_size, type); }
+	else
+	{ n = ahd__sethash(op, out, a, a_n, b, b_n, el_size, key_off, key_size); }
 
-	return result;
+	if(n == ~(ahd_int)0) { /* out of memory */
+#ifdef AHD_BUFFER_OUT_OF_MEMORY
+		AHD_BUFFER_OUT_OF_MEMORY ;
+#endif
+		n = 0;
+	}
+	((ahd_arr *)(out - hdr_size))->len = n;
+	if(! n)
+	{ ahd__free(out - hdr_size); return 0; }
+	return n < a_n + b_n ? ahd__setcap(out - hdr_size, n, el_size, hdr_size, 0) : out;
 }
 
+/* USAGE: ahd__sortint[is_signed(val)](...) */
+typedef int (*ahd__sort_int_t)(void *, ahd_int, ahd_int, void *, ahd_int, ahd_sort_dir);
+static ahd__sort_int_t ahd__sortint[2]  = { ahd__sortu,  ahd__sorti };
+static ahd__sort_int_t ahd__radixint[2] = { ahd__radixu, ahd__radixi };
+
 
 #define ahd_eq(ht,a,b) (sizeof(*(a))  == sizeof(*(b))  && \
                         ahd_len(ht,a) == ahd_len(ht,b) && \
@@ -857,8 +3681,8 @@ ahd__sortf(void *array, ahd_int hdr_size, ahd_int el_size, void *member,  ahd_in
  */
 
 // expression
-#define ahd_mapfn(ht,fn,a,b,udata) (ahd_resetlen(ht, b, ht__len(ht,a)), \
-		                            ahd__map(a, sizeof(*(a)), b, sizeof(*(b)), sizeof(ht), ahd_len(a), fn, udata))
+#define ahd_mapfn(ht,fn,a,b,udata) ((void *)(a) == (void *)(b) || ahd_resetlen(ht, b, ahd_len(ht,a)), \
+		                            ahd__map(a, sizeof(*(a)), b, sizeof(*(b)), sizeof(ht), ahd_len(ht,a), fn, udata))
 
 typedef struct ahd_any {
 	char *base;
@@ -871,6 +3695,7 @@ typedef struct ahd_loop_info {
 	ahd_int n;
 	void *udata;
 	ahd_any a, b;
+	int chunk, n_chunks; /* the part of [0, n) being run by the parallel variants (0 of 1 otherwise) */
 } ahd_loop_info;
 typedef int ahd_loopfn(ahd_loop_info *info, void *a, void *b);
 
@@ -879,7 +3704,7 @@ static void ahd__map(void *arr_a, ahd_int el_size_a, void *arr_b, ahd_int el_siz
 {
 	char *a = (char *)arr_a, *b = (char *)arr_b;
 	ahd_loop_info info = { 0 };
-	info.n = len,     info.udata = udata;
+	info.n = len,     info.udata = udata,         info.n_chunks = 1;
 	info.a.base = a,  info.a.hdr_size = hdr_size, info.a.el_size = el_size_a;
 	info.b.base = b,  info.b.hdr_size = hdr_size, info.b.el_size = el_size_b;
 
@@ -913,6 +3738,7 @@ static void ahd__reduce(void *accum, ahd_int el_size_acc,
 	ahd_loop_info info = { 0 };
 	info.n = len;
 	info.udata = udata;
+	info.n_chunks = 1;
 	info.a.base = acc,  info.a.el_size = el_size_acc,  info.a.hdr_size = 0;
 	info.b.base = val,  info.b.el_size = el_size_val,  info.b.hdr_size = hdr_size;
 	for(; info.i < len; ++info.i, val += el_size_val)
@@ -956,21 +3782,251 @@ static void ahd__reduce(void *accum, ahd_int el_size_acc,
 /* 				i < ahd__len(a); \ */
 /* 				!tr && ahd_push(ht,b,(a)[i]), ++i, tr = 1) */
 
-#define ahd_filterfn()
-static void ahd__filter(void *arr, void *out, ahd_int len, ahd_int el_size, ahd_int hdr_size, ahd_loopfn fn, void *udata) {
+// expression: keeps a[i] in b if fn(info, &a[i], 0) is nonzero, in order; returns the number kept.
+// b is resized to len(a) first, so there is no grow check per element. a may be b.
+#define ahd_filterfn(ht,fn,a,b,udata) ((void)sizeof(char[sizeof(*(a)) == sizeof(*(b)) ? 1 : -1]), \
+		! ahd_len(ht,a) ? (ahd_clear(ht,b), (ahd_int)0) : ((a) == (b) || ahd_resetlen(ht,b,ahd__len(ht,a)), \
+		ahd__len(ht,b) = ahd__filter(a, b, ahd__len(ht,b), sizeof(*(a)), sizeof(ht), fn, udata)))
+/* Usage:
+ * int is_valid(ahd_loop_info *info, void *obj, void *unused) {
+ *     (void)info, (void)unused;
+ *     return ((obj_t *)obj)->is_valid;
+ * }
+ * ...
+ * ahd_int n_valid = arr_filterfn(is_valid, objects, valid_objects, 0);
+ * arr_filterfn(is_valid, objects, objects, 0); // in place
+ */
+
+#ifndef  AHD_FILTER_COPY_MAX
+# define AHD_FILTER_COPY_MAX 64 /* larger elements are only copied if they're kept */
+#endif// AHD_FILTER_COPY_MAX
+
+/* Every element is copied to out, which only moves on if fn keeps it, so
+ * there is no branch on fn's result to mispredict. Element sizes up to 8 go
+ * through a local (in a register), as out may be the element itself. */
+#define AHD__COMPACT(size) \
+	for(; info->i < end; ++info->i, a += (size)) { \
+		char el[size]; \
+		AHD_MEMCPY(el, a, size); \
+		AHD_MEMCPY(out, el, size); \
+		out += (size) * (ahd_int)(fn(info, a, 0) != 0); \
+	}
+
+/* packs the elements of a from info->i up to end that fn keeps at out (<= a) */
+static ahd_int
+ahd__compact(ahd_loop_info *info, char *a, char *out, ahd_int end, ahd_int el_size, ahd_loopfn fn)
+{
+	char *out_start = out;
+	switch(el_size) {
+		case 1: AHD__COMPACT(1); break;
+		case 2: AHD__COMPACT(2); break;
+		case 4: AHD__COMPACT(4); break;
+		case 8: AHD__COMPACT(8); break;
+		default:
+			if(el_size <= AHD_FILTER_COPY_MAX) {
+				for(; info->i < end; ++info->i, a += el_size) {
+					AHD_MEMMOVE(out, a, el_size);
+					out += el_size * (ahd_int)(fn(info, a, 0) != 0);
+				}
+			}
+			else for(; info->i < end; ++info->i, a += el_size) {
+				if(fn(info, a, 0)) {
+					if(out != a) { AHD_MEMCPY(out, a, el_size); }
+					out += el_size;
+				}
+			}
+	}
+	return (ahd_int)(out - out_start) / el_size;
+}
+#undef AHD__COMPACT
+
+static ahd_int
+ahd__filter(void *arr, void *out, ahd_int len, ahd_int el_size, ahd_int hdr_size, ahd_loopfn fn, void *udata) {
 	char *a = (char *)arr;
 	ahd_loop_info info = { 0 };
-	info.n = len,     info.udata = udata;
+	info.n = len,     info.udata = udata,        info.n_chunks = 1;
 	info.a.base = a,  info.a.el_size = el_size,  info.a.hdr_size = hdr_size;
+	info.b.base = (char *)out, info.b.el_size = el_size, info.b.hdr_size = hdr_size;
+	return ahd__compact(&info, a, (char *)out, len, el_size, fn);
+}
 
-	for(; info.i < len; ++info.i, a += el_size)
-	{
-		if(fn(&info, a, out))
-		{
-			//TODO
-		}
+/* Parallel map/reduce/filter *************************************************
+ * As ahd__map/reduce/filter, with [0, len) cut into one chunk per thread (see
+ * ahd__parallel), each passed to fn with its own ahd_loop_info (i runs over the
+ * chunk; chunk and n_chunks say which it is).
+ * - pmapfn sets len(b) to len(a) and calls fn(info, &a[i], &b[i]).
+ * - preducefn gives each chunk its own copy of *acc to reduce into, so *acc
+ *   should start as the identity of fn (0 for a sum). The partials are then
+ *   folded into *acc in order with combine(info, acc, partial).
+ * - pfilterfn is filterfn. Each chunk packs what it keeps at the start of its
+ *   own part of b (with ahd__compact), then the parts are moved down into
+ *   place at offsets from a prefix sum of the chunks' counts.
+ * fn is called from several threads at once if AHD_THREADS is defined, and
+ * must not touch other elements of b.
+ */
+#ifndef  AHD_PLOOP_MIN
+# define AHD_PLOOP_MIN (1 << 14) /* fewer elements than this are done on the calling thread */
+#endif// AHD_PLOOP_MIN
+#ifndef  AHD_PLOOP_THREADS
+# define AHD_PLOOP_THREADS 0     /* 0: 1 thread per core */
+#endif// AHD_PLOOP_THREADS
+
+/* number of threads used by ahd_pmapfn/preducefn/pfilterfn; <= 0 for 1 per core */
+static int ahd_ploop_threads = AHD_PLOOP_THREADS;
+
+#define ahd_pmapfn(ht,fn,a,b,udata) ((void *)(a) == (void *)(b) || ahd_resetlen(ht,b,ahd_len(ht,a)), \
+		ahd__pmap(a, sizeof(*(a)), b, sizeof(*(b)), sizeof(ht), ahd_len(ht,a), fn, udata))
+#define ahd_preducefn(ht,fn,combine,a,acc,udata) \
+		ahd__preduce(acc, sizeof(*(acc)), a, sizeof(*(a)), sizeof(ht), ahd_len(ht,a), fn, combine, udata)
+#define ahd_pfilterfn(ht,fn,a,b,udata) ((void)sizeof(char[sizeof(*(a)) == sizeof(*(b)) ? 1 : -1]), \
+		! ahd_len(ht,a) ? (ahd_clear(ht,b), (ahd_int)0) : ((a) == (b) || ahd_resetlen(ht,b,ahd__len(ht,a)), \
+		ahd__len(ht,b) = ahd__pfilter(a, b, ahd__len(ht,b), sizeof(*(a)), sizeof(ht), fn, udata)))
+/* Usage:
+ * int sum_hits(ahd_loop_info *info, void *acc, void *val) {
+ *     (void)info;
+ *     *(long long *)acc += ((struct shot *)val)->hits;
+ *     return 0;
+ * }
+ * int add_sums(ahd_loop_info *info, void *acc, void *partial) {
+ *     (void)info;
+ *     *(long long *)acc += *(long long *)partial;
+ *     return 0;
+ * }
+ * ...
+ * long long hits = 0;
+ * arr_preducefn(sum_hits, add_sums, shots, &hits, 0);
+ */
+
+typedef struct ahd__ploop {
+	char *a, *b;    /* b: the output for map & filter, or the partials for reduce */
+	ahd_int el_size_a, el_size_b, hdr_size, len;
+	ahd_loopfn *fn;
+	void *udata;
+	int n_chunks;
+	ahd_int n_kept[AHD_MAX_THREADS];
+} ahd__ploop;
+
+/* start of chunk i */
+#define ahd__ploop_at(p, i) ((ahd_int)(i) * (p)->len / (ahd_int)(p)->n_chunks)
+
+static int
+ahd__ploop_chunks(ahd_int len)
+{
+	int n;
+	if(len < AHD_PLOOP_MIN) { return 1; } /* before asking the OS for the core count */
+	n = ahd_ploop_threads > 0 ? ahd_ploop_threads : ahd_num_cores();
+	return (int)ahd__min((ahd_int)ahd__min(n, AHD_MAX_THREADS), len);
+}
+
+static ahd_loop_info
+ahd__ploop_info(ahd__ploop *p, int i)
+{
+	ahd_loop_info info = { 0 };
+	info.i = ahd__ploop_at(p, i), info.n = p->len,         info.udata = p->udata;
+	info.chunk = i,               info.n_chunks = p->n_chunks;
+	info.a.base = p->a, info.a.hdr_size = p->hdr_size, info.a.el_size = p->el_size_a;
+	info.b.base = p->b, info.b.hdr_size = p->hdr_size, info.b.el_size = p->el_size_b;
+	return info;
+}
+
+static void
+ahd__pmap_chunk(void *data, int i, int n)
+{
+	ahd__ploop *p = (ahd__ploop *)data;
+	ahd_loop_info info = ahd__ploop_info(p, i);
+	ahd_int end = ahd__ploop_at(p, i + 1);
+	char *a = p->a + info.i * p->el_size_a, *b = p->b + info.i * p->el_size_b;
+	for(; info.i < end; ++info.i, a += p->el_size_a, b += p->el_size_b)
+	{ p->fn(&info, a, b); }
+	(void)n;
+}
+
+static void
+ahd__pmap(void *arr_a, ahd_int el_size_a, void *arr_b, ahd_int el_size_b,
+          ahd_int hdr_size, ahd_int len, ahd_loopfn fn, void *udata)
+{
+	ahd__ploop p;
+	p.a = (char *)arr_a,       p.b = (char *)arr_b;
+	p.el_size_a = el_size_a,   p.el_size_b = el_size_b;
+	p.hdr_size  = hdr_size,    p.len = len;
+	p.fn = fn,                 p.udata = udata;
+	p.n_chunks  = ahd__ploop_chunks(len);
+	if(len) { ahd__parallel(ahd__pmap_chunk, &p, p.n_chunks); }
+}
+
+static void
+ahd__preduce_chunk(void *data, int i, int n)
+{
+	ahd__ploop *p = (ahd__ploop *)data;
+	ahd_loop_info info = ahd__ploop_info(p, i);
+	ahd_int end = ahd__ploop_at(p, i + 1);
+	char *acc = p->b + i * p->el_size_b, *val = p->a + info.i * p->el_size_a;
+	info.b = info.a, info.a.base = acc, info.a.hdr_size = 0, info.a.el_size = p->el_size_b; /* as ahd__reduce */
+	for(; info.i < end; ++info.i, val += p->el_size_a)
+	{ p->fn(&info, acc, val); }
+	(void)n;
+}
+
+static void
+ahd__preduce(void *accum, ahd_int el_size_acc, void *value, ahd_int el_size_val, ahd_int hdr_size,
+             ahd_int len, ahd_loopfn fn, ahd_loopfn combine, void *udata)
+{
+	ahd__ploop p;
+	ahd_loop_info info = { 0 };
+	int i;
+	p.n_chunks = ahd__ploop_chunks(len);
+	p.b = p.n_chunks > 1 ? (char *)AHD_REALLOC(0, p.n_chunks * el_size_acc) : 0;
+	if(! p.b)
+	{ ahd__reduce(accum, el_size_acc, value, el_size_val, hdr_size, len, fn, udata); return; }
+
+	p.a = (char *)value,       p.el_size_a = el_size_val;
+	p.el_size_b = el_size_acc, p.hdr_size  = hdr_size;
+	p.len = len,               p.fn = fn,  p.udata = udata;
+	for(i = 0; i < p.n_chunks; ++i)
+	{ AHD_MEMCPY(p.b + i * el_size_acc, accum, el_size_acc); }
+	ahd__parallel(ahd__preduce_chunk, &p, p.n_chunks);
+
+	info.n = p.n_chunks, info.udata = udata, info.n_chunks = p.n_chunks;
+	info.a.base = (char *)accum, info.a.el_size = el_size_acc;
+	info.b.base = p.b,           info.b.el_size = el_size_acc;
+	for(i = 0; i < p.n_chunks; ++i, ++info.i) {
+		info.chunk = i;
+		combine(&info, accum, p.b + i * el_size_acc);
+	}
+	AHD_FREE(p.b);
+}
+
+static void
+ahd__pfilter_chunk(void *data, int i, int n)
+{
+	ahd__ploop *p = (ahd__ploop *)data;
+	ahd_loop_info info = ahd__ploop_info(p, i);
+	ahd_int end = ahd__ploop_at(p, i + 1), el_size = p->el_size_a;
+	p->n_kept[i] = ahd__compact(&info, p->a + info.i * el_size, p->b + info.i * el_size, end, el_size, p->fn);
+	(void)n;
+}
+
+static ahd_int
+ahd__pfilter(void *arr, void *out, ahd_int len, ahd_int el_size, ahd_int hdr_size, ahd_loopfn fn, void *udata)
+{
+	ahd__ploop p;
+	ahd_int n = 0;
+	int i;
+	if(! len) { return 0; }
+	p.a = (char *)arr,      p.b = (char *)out;
+	p.el_size_a = el_size,  p.el_size_b = el_size;
+	p.hdr_size  = hdr_size, p.len = len;
+	p.fn = fn,              p.udata = udata;
+	p.n_chunks  = ahd__ploop_chunks(len);
+	ahd__parallel(ahd__pfilter_chunk, &p, p.n_chunks);
+
+	for(i = 0; i < p.n_chunks; n += p.n_kept[i++]) { /* each chunk's kept elements go just after the last's */
+		ahd_int at = ahd__ploop_at(&p, i);
+		if(at != n) { AHD_MEMMOVE(p.b + n * el_size, p.b + at * el_size, p.n_kept[i] * el_size); }
 	}
+	return n;
 }
+#undef ahd__ploop_at
 
 #define ahd_split()
 #define ahd_join()
@@ -1002,6 +4058,630 @@ static void ahd__filter(void *arr, void *out, ahd_int len, ahd_int el_size, ahd_
  * if(found) { assert(objects[i_obj].is_valid); }
  */
 
+/* Scanning arrays of numbers *************************************************
+ * Find or count elements of integer or float arrays (not structs) by value,
+ * rather than with a predicate for each one as above. These go a vector at a
+ * time where the compiler targets SSE2 or AVX2 (unless AHD_NO_SIMD is
+ * defined), and element by element otherwise. x, lo and hi are converted to
+ * the element type; ranges include both ends.
+ * The find* variants return the index of the first match, or len(a) if none.
+ */
+typedef enum ahd_scan_op { ahd_FINDEQ, ahd_FINDGT, ahd_COUNTEQ, ahd_COUNTRANGE } ahd_scan_op;
+
+#define ahd__scanfn_i   ahd__scan_int
+#define ahd__scanfn_u   ahd__scan_int
+#define ahd__scanfn_int ahd__scan_int
+#define ahd__scanfn_f   ahd__scan_flt
+#define ahd__scanx(x,op,ht,a,lo,hi) ahd_if(a, ahd__scanfn_##x(a, ahd__len(ht,a), ahd__type##x(a), op, lo, hi))
+
+#define ahd_findeqi(ht,a,x)            ahd__scanx(i,   ahd_FINDEQ,     ht,a,x,x)
+#define ahd_findequ(ht,a,x)            ahd__scanx(u,   ahd_FINDEQ,     ht,a,x,x)
+#define ahd_findeqint(ht,a,x)          ahd__scanx(int, ahd_FINDEQ,     ht,a,x,x)
+#define ahd_findeqf(ht,a,x)            ahd__scanx(f,   ahd_FINDEQ,     ht,a,x,x)
+#define ahd_findgti(ht,a,x)            ahd__scanx(i,   ahd_FINDGT,     ht,a,x,x)
+#define ahd_findgtu(ht,a,x)            ahd__scanx(u,   ahd_FINDGT,     ht,a,x,x)
+#define ahd_findgtint(ht,a,x)          ahd__scanx(int, ahd_FINDGT,     ht,a,x,x)
+#define ahd_findgtf(ht,a,x)            ahd__scanx(f,   ahd_FINDGT,     ht,a,x,x)
+#define ahd_counteqi(ht,a,x)           ahd__scanx(i,   ahd_COUNTEQ,    ht,a,x,x)
+#define ahd_countequ(ht,a,x)           ahd__scanx(u,   ahd_COUNTEQ,    ht,a,x,x)
+#define ahd_counteqint(ht,a,x)         ahd__scanx(int, ahd_COUNTEQ,    ht,a,x,x)
+#define ahd_counteqf(ht,a,x)           ahd__scanx(f,   ahd_COUNTEQ,    ht,a,x,x)
+#define ahd_countrangei(ht,a,lo,hi)    ahd__scanx(i,   ahd_COUNTRANGE, ht,a,lo,hi)
+#define ahd_countrangeu(ht,a,lo,hi)    ahd__scanx(u,   ahd_COUNTRANGE, ht,a,lo,hi)
+#define ahd_countrangeint(ht,a,lo,hi)  ahd__scanx(int, ahd_COUNTRANGE, ht,a,lo,hi)
+#define ahd_countrangef(ht,a,lo,hi)    ahd__scanx(f,   ahd_COUNTRANGE, ht,a,lo,hi)
+/* Usage:
+ * int *ids = ...;
+ * ahd_int at = arr_findeqint(ids, 42);
+ * if(at < arr_len(ids)) { ... }
+ * ahd_int n_hot = arr_countrangef(temperatures, 30.f, 45.f);
+ */
+
+#if ! defined(AHD_NO_SIMD) && defined(__AVX2__)
+# include <immintrin.h>
+# define AHD__VBYTES 32
+# define AHD__VGT64  1 /* there is a 64-bit integer compare */
+typedef __m256i ahd__vec;
+typedef __m256  ahd__vecf32;
+typedef __m256d ahd__vecf64;
+# define ahd__vload(p)     _mm256_loadu_si256((__m256i const *)(p))
+# define ahd__vbits(v)     ((unsigned)_mm256_movemask_epi8(v))
+# define ahd__vor(a,b)     _mm256_or_si256(a,b)
+# define ahd__vxor(a,b)    _mm256_xor_si256(a,b)
+# define ahd__vnot(a)      _mm256_xor_si256(a, _mm256_set1_epi8(-1))
+# define ahd__vzero()      _mm256_setzero_si256()
+# define ahd__vstore(p,v)  _mm256_storeu_si256((__m256i *)(p), v)
+# define ahd__vsub8(a,b)   _mm256_sub_epi8(a,b)
+# define ahd__vsub16(a,b)  _mm256_sub_epi16(a,b)
+# define ahd__vsub32(a,b)  _mm256_sub_epi32(a,b)
+# define ahd__vsub64(a,b)  _mm256_sub_epi64(a,b)
+# define ahd__vset8(x)     _mm256_set1_epi8((char)(x))
+# define ahd__vset16(x)    _mm256_set1_epi16((short)(x))
+# define ahd__vset32(x)    _mm256_set1_epi32((int)(x))
+# define ahd__vset64(x)    _mm256_set1_epi64x((long long)(x))
+# define ahd__veq8(a,b)    _mm256_cmpeq_epi8(a,b)
+# define ahd__veq16(a,b)   _mm256_cmpeq_epi16(a,b)
+# define ahd__veq32(a,b)   _mm256_cmpeq_epi32(a,b)
+# define ahd__veq64(a,b)   _mm256_cmpeq_epi64(a,b)
+# define ahd__vgt8(a,b)    _mm256_cmpgt_epi8(a,b)
+# define ahd__vgt16(a,b)   _mm256_cmpgt_epi16(a,b)
+# define ahd__vgt32(a,b)   _mm256_cmpgt_epi32(a,b)
+# define ahd__vgt64(a,b)   _mm256_cmpgt_epi64(a,b)
+# define ahd__vloadf32(p)  _mm256_loadu_ps((float const *)(p))
+# define ahd__vloadf64(p)  _mm256_loadu_pd((double const *)(p))
+# define ahd__vsetf32(x)   _mm256_set1_ps(x)
+# define ahd__vsetf64(x)   _mm256_set1_pd(x)
+# define ahd__vcmpf32(a,b,pred) _mm256_castps_si256(_mm256_cmp_ps(a, b, AHD__CMP_##pred))
+# define ahd__vcmpf64(a,b,pred) _mm256_castpd_si256(_mm256_cmp_pd(a, b, AHD__CMP_##pred))
+# define ahd__vandf(a,b)   _mm256_and_si256(a,b)
+# define AHD__CMP_eq _CMP_EQ_OQ
+# define AHD__CMP_gt _CMP_GT_OQ
+# define AHD__CMP_ge _CMP_GE_OQ
+# define AHD__CMP_le _CMP_LE_OQ
+typedef __m256d ahd__vecd; /* doubles, for reductions */
+# define AHD__VDLANES      4
+# define ahd__vdzero()     _mm256_setzero_pd()
+# define ahd__vdset(x)     _mm256_set1_pd(x)
+# define ahd__vdf32(p)     _mm256_cvtps_pd(_mm_loadu_ps((float const *)(p)))
+# define ahd__vdf64(p)     _mm256_loadu_pd((double const *)(p))
+# define ahd__vdadd(a,b)   _mm256_add_pd(a,b)
+# define ahd__vdsub(a,b)   _mm256_sub_pd(a,b)
+# define ahd__vdmul(a,b)   _mm256_mul_pd(a,b)
+# define ahd__vdmin(a,b)   _mm256_min_pd(a,b)
+# define ahd__vdmax(a,b)   _mm256_max_pd(a,b)
+# define ahd__vdstore(p,v) _mm256_storeu_pd(p,v)
+#elif ! defined(AHD_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+# include <emmintrin.h>
+# define AHD__VBYTES 16
+# define AHD__VGT64  0
+typedef __m128i ahd__vec;
+typedef __m128  ahd__vecf32;
+typedef __m128d ahd__vecf64;
+# define ahd__vload(p)     _mm_loadu_si128((__m128i const *)(p))
+# define ahd__vbits(v)     ((unsigned)_mm_movemask_epi8(v))
+# define ahd__vor(a,b)     _mm_or_si128(a,b)
+# define ahd__vxor(a,b)    _mm_xor_si128(a,b)
+# define ahd__vnot(a)      _mm_xor_si128(a, _mm_set1_epi8(-1))
+# define ahd__vzero()      _mm_setzero_si128()
+# define ahd__vstore(p,v)  _mm_storeu_si128((__m128i *)(p), v)
+# define ahd__vsub8(a,b)   _mm_sub_epi8(a,b)
+# define ahd__vsub16(a,b)  _mm_sub_epi16(a,b)
+# define ahd__vsub32(a,b)  _mm_sub_epi32(a,b)
+# define ahd__vsub64(a,b)  _mm_sub_epi64(a,b)
+# define ahd__vset8(x)     _mm_set1_epi8((char)(x))
+# define ahd__vset16(x)    _mm_set1_epi16((short)(x))
+# define ahd__vset32(x)    _mm_set1_epi32((int)(x))
+# define ahd__vset64(x)    _mm_set1_epi64x((long long)(x))
+# define ahd__veq8(a,b)    _mm_cmpeq_epi8(a,b)
+# define ahd__veq16(a,b)   _mm_cmpeq_epi16(a,b)
+# define ahd__veq32(a,b)   _mm_cmpeq_epi32(a,b)
+# define ahd__veq64(a,b)   ahd__veq64_sse2(a,b)
+# define ahd__vgt8(a,b)    _mm_cmpgt_epi8(a,b)
+# define ahd__vgt16(a,b)   _mm_cmpgt_epi16(a,b)
+# define ahd__vgt32(a,b)   _mm_cmpgt_epi32(a,b)
+# define ahd__vgt64(a,b)   ahd__vgt32(a,b) /* unused: AHD__VGT64 */
+# define ahd__vloadf32(p)  _mm_loadu_ps((float const *)(p))
+# define ahd__vloadf64(p)  _mm_loadu_pd((double const *)(p))
+# define ahd__vsetf32(x)   _mm_set1_ps(x)
+# define ahd__vsetf64(x)   _mm_set1_pd(x)
+# define ahd__vcmpf32(a,b,pred) _mm_castps_si128(_mm_cmp##pred##_ps(a, b))
+# define ahd__vcmpf64(a,b,pred) _mm_castpd_si128(_mm_cmp##pred##_pd(a, b))
+# define ahd__vandf(a,b)   _mm_and_si128(a,b)
+typedef __m128d ahd__vecd; /* doubles, for reductions */
+# define AHD__VDLANES      2
+# define ahd__vdzero()     _mm_setzero_pd()
+# define ahd__vdset(x)     _mm_set1_pd(x)
+# define ahd__vdf32(p)     _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64((__m128i const *)(p))))
+# define ahd__vdf64(p)     _mm_loadu_pd((double const *)(p))
+# define ahd__vdadd(a,b)   _mm_add_pd(a,b)
+# define ahd__vdsub(a,b)   _mm_sub_pd(a,b)
+# define ahd__vdmul(a,b)   _mm_mul_pd(a,b)
+# define ahd__vdmin(a,b)   _mm_min_pd(a,b)
+# define ahd__vdmax(a,b)   _mm_max_pd(a,b)
+# define ahd__vdstore(p,v) _mm_storeu_pd(p,v)
+// the halves of each 64-bit lane are both equal
+static inline __m128i ahd__veq64_sse2(__m128i a, __m128i b)
+{ __m128i eq = _mm_cmpeq_epi32(a, b); return _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2,3,0,1))); }
+#else
+# define AHD__VBYTES 0
+#endif
+
+#if AHD__VBYTES
+
+static inline int
+ahd__ctz(unsigned bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_ctz(bits);
+#else
+	int n = 0;
+	for(; ! (bits & 1); bits >>= 1) { ++n; }
+	return n;
+#endif
+}
+
+static inline int
+ahd__popcount(unsigned bits)
+{
+	bits = bits - ((bits >> 1) & 0x55555555u);
+	bits = (bits & 0x33333333u) + ((bits >> 2) & 0x33333333u);
+	return (int)((((bits + (bits >> 4)) & 0x0f0f0f0fu) * 0x01010101u) >> 24);
+}
+
+/* counts in lanes of 4 or 8 bytes, from subtracting compare results (-1 for a match) */
+static inline ahd_int
+ahd__vsum(ahd__vec acc, ahd_int size)
+{
+	unsigned char lanes[AHD__VBYTES];
+	ahd_int sum = 0, i;
+	ahd__vstore(lanes, acc);
+	for(i = 0; i < AHD__VBYTES; i += size) {
+		if(size == 4) { unsigned int       lane; AHD_MEMCPY(&lane, lanes + i, 4); sum += lane; }
+		else          { unsigned long long lane; AHD_MEMCPY(&lane, lanes + i, 8); sum += lane; }
+	}
+	return sum;
+}
+
+/* Loops over the whole vectors in the array; `match` is the compare result
+ * for the vector x (all bits set in the lanes of matching elements). Counts
+ * of small elements come from the bits of each result; others are added up in
+ * the lanes of an accumulator. Leaves i at the elements left over. */
+# define AHD__SCANVEC(size, bits_, vt, load, match) do { \
+		ahd_int step = AHD__VBYTES / (size); \
+		unsigned bits; \
+		if(op == ahd_FINDEQ || op == ahd_FINDGT) { \
+			for(; i + step <= len; i += step) { \
+				vt x = load(p + i * (size)); \
+				if((bits = ahd__vbits(match))) { return i + ahd__ctz(bits) / (size); } \
+			} \
+		} \
+		else if((size) < 4) { \
+			for(; i + step <= len; i += step) { \
+				vt x = load(p + i * (size)); \
+				n += ahd__popcount(ahd__vbits(match)) / (size); \
+			} \
+		} \
+		else { \
+			ahd__vec acc = ahd__vzero(); \
+			ahd_int n_acc = 0; \
+			for(; i + step <= len; i += step) { \
+				vt x = load(p + i * (size)); \
+				acc = ahd__vsub##bits_(acc, match); \
+				if(++n_acc == (ahd_int)1 << 30) { n += ahd__vsum(acc, size); acc = ahd__vzero(); n_acc = 0; } \
+			} \
+			n += ahd__vsum(acc, size); \
+		} \
+	} while(0)
+
+/* unsigned compares are signed ones with the sign bit flipped (bias) */
+# define AHD__SCANVECINT(size, bits_, bias) do { \
+		ahd__vec vlo = ahd__vset##bits_(lo), vhi = ahd__vset##bits_(hi), vbias = ahd__vset##bits_(bias); \
+		ahd__vec blo = ahd__vxor(vlo, vbias), bhi = ahd__vxor(vhi, vbias); \
+		if(size == 8 && ! AHD__VGT64 && (op == ahd_FINDGT || op == ahd_COUNTRANGE)) \
+		{ break; } \
+		switch(op) { \
+			case ahd_FINDEQ: case ahd_COUNTEQ: \
+				AHD__SCANVEC(size, bits_, ahd__vec, ahd__vload, ahd__veq##bits_(x, vlo)); break; \
+			case ahd_FINDGT: \
+				AHD__SCANVEC(size, bits_, ahd__vec, ahd__vload, ahd__vgt##bits_(ahd__vxor(x, vbias), blo)); break; \
+			case ahd_COUNTRANGE: \
+				AHD__SCANVEC(size, bits_, ahd__vec, ahd__vload, ahd__vnot(ahd__vor( \
+				             ahd__vgt##bits_(blo, ahd__vxor(x, vbias)), ahd__vgt##bits_(ahd__vxor(x, vbias), bhi)))); break; \
+			default: break; \
+		} \
+	} while(0)
+
+# define AHD__SCANVECFLT(size, bits_, vt, t) do { \
+		vt vlo = ahd__vsetf##bits_((t)lo), vhi = ahd__vsetf##bits_((t)hi); \
+		switch(op) { \
+			case ahd_FINDEQ: case ahd_COUNTEQ: \
+				AHD__SCANVEC(size, bits_, vt, ahd__vloadf##bits_, ahd__vcmpf##bits_(x, vlo, eq)); break; \
+			case ahd_FINDGT: \
+				AHD__SCANVEC(size, bits_, vt, ahd__vloadf##bits_, ahd__vcmpf##bits_(x, vlo, gt)); break; \
+			case ahd_COUNTRANGE: \
+				AHD__SCANVEC(size, bits_, vt, ahd__vloadf##bits_, ahd__vandf( \
+				             ahd__vcmpf##bits_(x, vlo, ge), ahd__vcmpf##bits_(x, vhi, le))); break; \
+			default: break; \
+		} \
+	} while(0)
+#else
+# define AHD__SCANVECINT(size, bits_, bias)
+# define AHD__SCANVECFLT(size, bits_, vt, t)
+#endif/*AHD__VBYTES*/
+
+/* the elements from i on, one at a time */
+#define AHD__SCANONE(t) do { \
+		t const *v = (t const *)p; \
+		t x = (t)lo, y = (t)hi; \
+		switch(op) { \
+			case ahd_FINDEQ:     for(; i < len; ++i) { if(v[i] == x) { return i; } }   return len; \
+			case ahd_FINDGT:     for(; i < len; ++i) { if(v[i] >  x) { return i; } }   return len; \
+			case ahd_COUNTEQ:    for(; i < len; ++i) { n += v[i] == x; }               return n; \
+			case ahd_COUNTRANGE: for(; i < len; ++i) { n += x <= v[i] && v[i] <= y; }  return n; \
+			default:             return 0; \
+		} \
+	} while(0)
+
+static ahd_int
+ahd__scan_int(void const *arr, ahd_int len, int type, int op, long long lo, long long hi)
+{
+	char const *p = (char const *)arr;
+	ahd_int i = 0, n = 0;
+	switch(type) {
+		case ahd_INT | ahd_SIGN | 1: AHD__SCANVECINT(1, 8,  0); AHD__SCANONE(signed char);        break;
+		case ahd_INT | ahd_SIGN | 2: AHD__SCANVECINT(2, 16, 0); AHD__SCANONE(short);              break;
+		case ahd_INT | ahd_SIGN | 4: AHD__SCANVECINT(4, 32, 0); AHD__SCANONE(int);                break;
+		case ahd_INT | ahd_SIGN | 8: AHD__SCANVECINT(8, 64, 0); AHD__SCANONE(long long);          break;
+		case ahd_INT | 1: AHD__SCANVECINT(1, 8,  0x80);                  AHD__SCANONE(unsigned char);      break;
+		case ahd_INT | 2: AHD__SCANVECINT(2, 16, 0x8000);                AHD__SCANONE(unsigned short);     break;
+		case ahd_INT | 4: AHD__SCANVECINT(4, 32, 0x80000000u);           AHD__SCANONE(unsigned int);       break;
+		case ahd_INT | 8: AHD__SCANVECINT(8, 64, 0x8000000000000000ull); AHD__SCANONE(unsigned long long); break;
+		default: break;
+	}
+	return 0;
+}
+
+static ahd_int
+ahd__scan_flt(void const *arr, ahd_int len, int type, int op, double lo, double hi)
+{
+	char const *p = (char const *)arr;
+	ahd_int i = 0, n = 0;
+	switch(type) {
+		case ahd_FLT | 4: AHD__SCANVECFLT(4, 32, ahd__vecf32, float);  AHD__SCANONE(float);  break;
+		case ahd_FLT | 8: AHD__SCANVECFLT(8, 64, ahd__vecf64, double); AHD__SCANONE(double); break;
+		default: break;
+	}
+	return 0;
+}
+
+/* Reductions over arrays of numbers ******************************************
+ * Sum, min, max, argmin, argmax and dot product of an integer or float member
+ * of each element (mem is its address in a, as for the sorts; pass a itself
+ * for arrays of numbers).
+ * - Integer sums wrap around as unsigned arithmetic does, and come back as long
+ *   long (unsigned long long for the u variants), as do mins and maxes.
+ * - Float sums are added up in doubles; ksumf uses Kahan summation to carry the
+ *   rounding error from each add (don't build it with -ffast-math).
+ * - Float mins and maxes skip NaNs; they are NaN if every element is.
+ * - Min and max of an empty array are 0; argmin and argmax return the index of
+ *   the first extreme element, or len(a) if there isn't one.
+ * - dot pairs a[i] with b[i] up to the shorter length; the members must be the
+ *   same type.
+ * Contiguous float arrays are added up a vector of doubles at a time under
+ * SSE2/AVX2, and the min/max of contiguous integers is found a vector at a
+ * time (64-bit integers only under AVX2); integer sums and dot products are
+ * left to the compiler to vectorize.
+ */
+#include <math.h> /* HUGE_VAL, NAN */
+
+typedef enum ahd_reduce_op { ahd_SUM, ahd_KSUM, ahd_MIN, ahd_MAX } ahd_reduce_op;
+
+#define ahd__redfn_i   ahd__reduce_int
+#define ahd__redfn_u   (unsigned long long)ahd__reduce_int
+#define ahd__redfn_int ahd__reduce_int
+#define ahd__redfn_f   ahd__reduce_flt
+#define ahd__argfn_i   ahd__argext_int
+#define ahd__argfn_u   ahd__argext_int
+#define ahd__argfn_int ahd__argext_int
+#define ahd__argfn_f   ahd__argext_flt
+#define ahd__dotfn_i   ahd__dot_int
+#define ahd__dotfn_u   (unsigned long long)ahd__dot_int
+#define ahd__dotfn_int ahd__dot_int
+#define ahd__dotfn_f   ahd__dot_flt
+#define ahd__redx(x,op,ht,a,mem)     ahd_if(a, ahd__redfn_##x(ahd__data(ht,a), mem, ahd__type##x(mem), op))
+#define ahd__argx(x,op,ht,a,mem)     ahd_if(a, ahd__argfn_##x(ahd__data(ht,a), mem, ahd__type##x(mem), op))
+#define ahd__dotx(x,ht,a,ma,b,mb)   ((void)sizeof(char[sizeof(*(ma)) == sizeof(*(mb)) ? 1 : -1]), \
+	ahd_if(a, ahd_if(b, ahd__dotfn_##x(ahd__data(ht,a), ma, ahd__data(ht,b), mb, ahd__type##x(ma)))))
+
+#define ahd_sumi(ht,a,mem)            ahd__redx(i,   ahd_SUM,  ht,a,mem)
+#define ahd_sumu(ht,a,mem)            ahd__redx(u,   ahd_SUM,  ht,a,mem)
+#define ahd_sumint(ht,a,mem)          ahd__redx(int, ahd_SUM,  ht,a,mem)
+#define ahd_sumf(ht,a,mem)            ahd__redx(f,   ahd_SUM,  ht,a,mem)
+#define ahd_ksumf(ht,a,mem)           ahd__redx(f,   ahd_KSUM, ht,a,mem)
+#define ahd_mini(ht,a,mem)            ahd__redx(i,   ahd_MIN,  ht,a,mem)
+#define ahd_minu(ht,a,mem)            ahd__redx(u,   ahd_MIN,  ht,a,mem)
+#define ahd_minint(ht,a,mem)          ahd__redx(int, ahd_MIN,  ht,a,mem)
+#define ahd_minf(ht,a,mem)            ahd__redx(f,   ahd_MIN,  ht,a,mem)
+#define ahd_maxi(ht,a,mem)            ahd__redx(i,   ahd_MAX,  ht,a,mem)
+#define ahd_maxu(ht,a,mem)            ahd__redx(u,   ahd_MAX,  ht,a,mem)
+#define ahd_maxint(ht,a,mem)          ahd__redx(int, ahd_MAX,  ht,a,mem)
+#define ahd_maxf(ht,a,mem)            ahd__redx(f,   ahd_MAX,  ht,a,mem)
+#define ahd_argmini(ht,a,mem)         ahd__argx(i,   ahd_MIN,  ht,a,mem)
+#define ahd_argminu(ht,a,mem)         ahd__argx(u,   ahd_MIN,  ht,a,mem)
+#define ahd_argminint(ht,a,mem)       ahd__argx(int, ahd_MIN,  ht,a,mem)
+#define ahd_argminf(ht,a,mem)         ahd__argx(f,   ahd_MIN,  ht,a,mem)
+#define ahd_argmaxi(ht,a,mem)         ahd__argx(i,   ahd_MAX,  ht,a,mem)
+#define ahd_argmaxu(ht,a,mem)         ahd__argx(u,   ahd_MAX,  ht,a,mem)
+#define ahd_argmaxint(ht,a,mem)       ahd__argx(int, ahd_MAX,  ht,a,mem)
+#define ahd_argmaxf(ht,a,mem)         ahd__argx(f,   ahd_MAX,  ht,a,mem)
+#define ahd_doti(ht,a,ma,b,mb)        ahd__dotx(i,   ht,a,ma,b,mb)
+#define ahd_dotu(ht,a,ma,b,mb)        ahd__dotx(u,   ht,a,ma,b,mb)
+#define ahd_dotint(ht,a,ma,b,mb)      ahd__dotx(int, ht,a,ma,b,mb)
+#define ahd_dotf(ht,a,ma,b,mb)        ahd__dotx(f,   ht,a,ma,b,mb)
+/* Usage:
+ * struct particle { float x, y, mass; } *ps = ...;
+ * double total = arr_sumf(ps, &ps->mass);
+ * ahd_int heaviest = arr_argmaxf(ps, &ps->mass);
+ * long long n_dot = arr_dotint(counts, counts, weights, weights);
+ */
+
+#if AHD__VBYTES
+/* the min/max of whole vectors of contiguous integers, from the first one on
+ * (vm takes x in the lanes where `a > b`); leaves m at it and i at the rest */
+# define AHD__MINMAXVEC(t, size, bits_, bias, a, b) do { \
+		ahd_int step = AHD__VBYTES / (size), j; \
+		ahd__vec vbias = ahd__vset##bits_(bias), vm; \
+		t lanes[AHD__VBYTES / (size)]; \
+		if(((size) == 8 && ! AHD__VGT64) || len < 2 * step) { break; } \
+		vm = ahd__vxor(ahd__vload(p), vbias); \
+		for(i = step; i + step <= len; i += step) { \
+			ahd__vec x = ahd__vxor(ahd__vload(p + i * (size)), vbias); \
+			vm = ahd__vxor(vm, ahd__vandf(ahd__vxor(vm, x), ahd__vgt##bits_(a, b))); \
+		} \
+		ahd__vstore(lanes, ahd__vxor(vm, vbias)); \
+		for(m = lanes[0], j = 1; j < step; ++j) \
+		{ m = op == ahd_MIN ? (lanes[j] < m ? lanes[j] : m) : (lanes[j] > m ? lanes[j] : m); } \
+	} while(0)
+#else
+# define AHD__MINMAXVEC(t, size, bits_, bias, a, b)
+#endif/*AHD__VBYTES*/
+
+/* integers, a[i] at p + i*stride; sums as unsigned to wrap without UB */
+#define AHD__REDUCEINT(t, bits_, bias) do { \
+		t m = *(t const *)p; \
+		unsigned long long sum = 0; \
+		if(el_size == (ahd_int)sizeof(t)) { \
+			t const *v = (t const *)p; \
+			i = 1; \
+			switch(op) { \
+				case ahd_MIN: AHD__MINMAXVEC(t, sizeof(t), bits_, bias, vm, x); \
+				              for(; i < len; ++i) { m = v[i] < m ? v[i] : m; } return (long long)m; \
+				case ahd_MAX: AHD__MINMAXVEC(t, sizeof(t), bits_, bias, x, vm); \
+				              for(; i < len; ++i) { m = v[i] > m ? v[i] : m; } return (long long)m; \
+				default:      for(i = 0; i < len; ++i) { sum += (unsigned long long)v[i]; } return (long long)sum; \
+			} \
+		} \
+		switch(op) { \
+			case ahd_MIN: for(i = 1, p += el_size; i < len; ++i, p += el_size) \
+			              { t x = *(t const *)p; m = x < m ? x : m; } return (long long)m; \
+			case ahd_MAX: for(i = 1, p += el_size; i < len; ++i, p += el_size) \
+			              { t x = *(t const *)p; m = x > m ? x : m; } return (long long)m; \
+			default:      for(i = 0; i < len; ++i, p += el_size) \
+			              { sum += (unsigned long long)*(t const *)p; } return (long long)sum; \
+		} \
+	} while(0)
+
+#define AHD__FINDINT(t) do { \
+		t m = (t)x; \
+		for(i = 0; i < len && *(t const *)p != m; ++i, p += el_size) {} \
+		return i; \
+	} while(0)
+
+#define AHD__DOTINT(t) do { \
+		unsigned long long sum = 0; \
+		if(el_size_a == (ahd_int)sizeof(t) && el_size_b == (ahd_int)sizeof(t)) { \
+			t const *u = (t const *)p, *v = (t const *)q; \
+			for(i = 0; i < len; ++i) { sum += (unsigned long long)u[i] * (unsigned long long)v[i]; } \
+		} \
+		else for(i = 0; i < len; ++i, p += el_size_a, q += el_size_b) \
+		{ sum += (unsigned long long)*(t const *)p * (unsigned long long)*(t const *)q; } \
+		return (long long)sum; \
+	} while(0)
+
+static long long
+ahd__reduce_int(void const *array, ahd_int hdr_size, ahd_int el_size, void const *member, int type, int op)
+{
+	char const *p = (char const *)member;
+	ahd_int len = ((ahd_arr const *)((char const *)array - hdr_size))->len, i;
+	if(! len) { return 0; }
+	switch(type) {
+		case ahd_INT | ahd_SIGN | 1: AHD__REDUCEINT(signed char, 8,  0);        break;
+		case ahd_INT | ahd_SIGN | 2: AHD__REDUCEINT(short,       16, 0);        break;
+		case ahd_INT | ahd_SIGN | 4: AHD__REDUCEINT(int,         32, 0);        break;
+		case ahd_INT | ahd_SIGN | 8: AHD__REDUCEINT(long long,   64, 0);        break;
+		case ahd_INT | 1: AHD__REDUCEINT(unsigned char,      8,  0x80);                  break;
+		case ahd_INT | 2: AHD__REDUCEINT(unsigned short,     16, 0x8000);                break;
+		case ahd_INT | 4: AHD__REDUCEINT(unsigned int,       32, 0x80000000u);           break;
+		case ahd_INT | 8: AHD__REDUCEINT(unsigned long long, 64, 0x8000000000000000ull); break;
+		default: break;
+	}
+	return 0;
+}
+
+/* the first element equal to the min/max */
+static ahd_int
+ahd__argext_int(void const *array, ahd_int hdr_size, ahd_int el_size, void const *member, int type, int op)
+{
+	char const *p = (char const *)member;
+	ahd_int len = ((ahd_arr const *)((char const *)array - hdr_size))->len, i;
+	long long x = ahd__reduce_int(array, hdr_size, el_size, member, type, op);
+	if(el_size == (ahd_int)(type & 0xf))
+	{ return ahd__scan_int(p, len, type, ahd_FINDEQ, x, x); }
+	switch(type) {
+		case ahd_INT | ahd_SIGN | 1: AHD__FINDINT(signed char);        break;
+		case ahd_INT | ahd_SIGN | 2: AHD__FINDINT(short);              break;
+		case ahd_INT | ahd_SIGN | 4: AHD__FINDINT(int);                break;
+		case ahd_INT | ahd_SIGN | 8: AHD__FINDINT(long long);          break;
+		case ahd_INT | 1:            AHD__FINDINT(unsigned char);      break;
+		case ahd_INT | 2:            AHD__FINDINT(unsigned short);     break;
+		case ahd_INT | 4:            AHD__FINDINT(unsigned int);       break;
+		case ahd_INT | 8:            AHD__FINDINT(unsigned long long); break;
+		default: break;
+	}
+	return len;
+}
+
+static long long
+ahd__dot_int(void const *array_a, ahd_int hdr_size_a, ahd_int el_size_a, void const *member_a,
+             void const *array_b, ahd_int hdr_size_b, ahd_int el_size_b, void const *member_b, int type)
+{
+	char const *p = (char const *)member_a, *q = (char const *)member_b;
+	ahd_int len = ahd__min(((ahd_arr const *)((char const *)array_a - hdr_size_a))->len,
+	                       ((ahd_arr const *)((char const *)array_b - hdr_size_b))->len), i;
+	switch(type) {
+		case ahd_INT | ahd_SIGN | 1: AHD__DOTINT(signed char);        break;
+		case ahd_INT | ahd_SIGN | 2: AHD__DOTINT(short);              break;
+		case ahd_INT | ahd_SIGN | 4: AHD__DOTINT(int);                break;
+		case ahd_INT | ahd_SIGN | 8: AHD__DOTINT(long long);          break;
+		case ahd_INT | 1:            AHD__DOTINT(unsigned char);      break;
+		case ahd_INT | 2:            AHD__DOTINT(unsigned short);     break;
+		case ahd_INT | 4:            AHD__DOTINT(unsigned int);       break;
+		case ahd_INT | 8:            AHD__DOTINT(unsigned long long); break;
+		default: break;
+	}
+	return 0;
+}
+
+static inline void
+ahd__kahan(double *sum, double *c, double x)
+{
+	double y = x - *c, t = *sum + y;
+	*c = (t - *sum) - y;
+	*sum = t;
+}
+
+#if AHD__VBYTES
+/* whole vectors of contiguous floats, widened to doubles; leaves i at the rest */
+# define AHD__REDUCEVEC(size, load) do { \
+		ahd__vecd vacc = ahd__vdset(acc), vc = ahd__vdzero(); \
+		double lanes[AHD__VDLANES], lanes_c[AHD__VDLANES]; \
+		ahd_int j; \
+		switch(op) { \
+			case ahd_MIN: \
+				for(; i + AHD__VDLANES <= len; i += AHD__VDLANES) { vacc = ahd__vdmin(load(p + i * (size)), vacc); } break; \
+			case ahd_MAX: \
+				for(; i + AHD__VDLANES <= len; i += AHD__VDLANES) { vacc = ahd__vdmax(load(p + i * (size)), vacc); } break; \
+			case ahd_KSUM: \
+				for(; i + AHD__VDLANES <= len; i += AHD__VDLANES) { \
+					ahd__vecd y = ahd__vdsub(load(p + i * (size)), vc), t = ahd__vdadd(vacc, y); \
+					vc = ahd__vdsub(ahd__vdsub(t, vacc), y); \
+					vacc = t; \
+				} break; \
+			default: \
+				for(; i + AHD__VDLANES <= len; i += AHD__VDLANES) { vacc = ahd__vdadd(vacc, load(p + i * (size))); } break; \
+		} \
+		ahd__vdstore(lanes, vacc); \
+		ahd__vdstore(lanes_c, vc); \
+		for(j = 0; j < AHD__VDLANES; ++j) switch(op) { \
+			case ahd_MIN:  acc = lanes[j] < acc ? lanes[j] : acc; break; \
+			case ahd_MAX:  acc = lanes[j] > acc ? lanes[j] : acc; break; \
+			case ahd_KSUM: ahd__kahan(&acc, &c, lanes[j]); ahd__kahan(&acc, &c, -lanes_c[j]); break; \
+			default:       acc += lanes[j]; break; \
+		} \
+	} while(0)
+
+# define AHD__DOTVEC(size, load) do { \
+		ahd__vecd vacc = ahd__vdzero(); \
+		double lanes[AHD__VDLANES]; \
+		ahd_int j; \
+		for(; i + AHD__VDLANES <= len; i += AHD__VDLANES) \
+		{ vacc = ahd__vdadd(vacc, ahd__vdmul(load(p + i * (size)), load(q + i * (size)))); } \
+		ahd__vdstore(lanes, vacc); \
+		for(j = 0; j < AHD__VDLANES; ++j) { acc += lanes[j]; } \
+	} while(0)
+#else
+# define AHD__REDUCEVEC(size, load)
+# define AHD__DOTVEC(size, load)
+#endif/*AHD__VBYTES*/
+
+/* the elements from i on, one at a time */
+#define AHD__REDUCEFLT(t) do { \
+		for(p += i * el_size; i < len; ++i, p += el_size) { \
+			double x = *(t const *)p; \
+			switch(op) { \
+				case ahd_MIN:  acc = x < acc ? x : acc; break; \
+				case ahd_MAX:  acc = x > acc ? x : acc; break; \
+				case ahd_KSUM: ahd__kahan(&acc, &c, x); break; \
+				default:       acc += x; break; \
+			} \
+		} \
+	} while(0)
+
+static ahd_int
+ahd__find_flt(char const *p, ahd_int len, ahd_int el_size, int type, double x)
+{
+	ahd_int i = 0;
+	if(el_size == (ahd_int)(type & 0xf))
+	{ return ahd__scan_flt(p, len, type, ahd_FINDEQ, x, x); }
+	if(type == (ahd_FLT | 4)) { for(; i < len && *(float  const *)p != (float)x; ++i, p += el_size) {} }
+	else                      { for(; i < len && *(double const *)p != x;        ++i, p += el_size) {} }
+	return i;
+}
+
+static double
+ahd__reduce_flt(void const *array, ahd_int hdr_size, ahd_int el_size, void const *member, int type, int op)
+{
+	char const *p = (char const *)member;
+	ahd_int len = ((ahd_arr const *)((char const *)array - hdr_size))->len, i = 0;
+	double start = op == ahd_MIN ? HUGE_VAL : op == ahd_MAX ? -HUGE_VAL : 0,
+	       acc = start, c = 0;
+	if(! len) { return 0; }
+	if(el_size == (ahd_int)(type & 0xf)) switch(type) {
+		case ahd_FLT | 4: AHD__REDUCEVEC(4, ahd__vdf32); break;
+		case ahd_FLT | 8: AHD__REDUCEVEC(8, ahd__vdf64); break;
+		default: break;
+	}
+	switch(type) {
+		case ahd_FLT | 4: AHD__REDUCEFLT(float);  break;
+		case ahd_FLT | 8: AHD__REDUCEFLT(double); break;
+		default: return 0;
+	}
+	// all NaN, unless the extreme really is infinite
+	if((op == ahd_MIN || op == ahd_MAX) && acc == start &&
+	   ahd__find_flt((char const *)member, len, el_size, type, acc) == len)
+	{ return NAN; }
+	return acc - c;
+}
+
+static ahd_int
+ahd__argext_flt(void const *array, ahd_int hdr_size, ahd_int el_size, void const *member, int type, int op)
+{
+	ahd_int len = ((ahd_arr const *)((char const *)array - hdr_size))->len;
+	double x = ahd__reduce_flt(array, hdr_size, el_size, member, type, op);
+	return x == x ? ahd__find_flt((char const *)member, len, el_size, type, x) : len;
+}
+
+static double
+ahd__dot_flt(void const *array_a, ahd_int hdr_size_a, ahd_int el_size_a, void const *member_a,
+             void const *array_b, ahd_int hdr_size_b, ahd_int el_size_b, void const *member_b, int type)
+{
+	char const *p = (char const *)member_a, *q = (char const *)member_b;
+	ahd_int len = ahd__min(((ahd_arr const *)((char const *)array_a - hdr_size_a))->len,
+	                       ((ahd_arr const *)((char const *)array_b - hdr_size_b))->len), i = 0;
+	double acc = 0;
+	if(el_size_a == (ahd_int)(type & 0xf) && el_size_b == el_size_a) switch(type) {
+		case ahd_FLT | 4: AHD__DOTVEC(4, ahd__vdf32); break;
+		case ahd_FLT | 8: AHD__DOTVEC(8, ahd__vdf64); break;
+		default: break;
+	}
+	p += i * el_size_a, q += i * el_size_b;
+	for(; i < len; ++i, p += el_size_a, q += el_size_b) {
+		if(type == (ahd_FLT | 4)) { acc += (double)*(float  const *)p * *(float  const *)q; }
+		else                      { acc += *(double const *)p * *(double const *)q; }
+	}
+	return acc;
+}
+
 #define ahd_exitscope continue
 // NOTE: adding to NULL ptr is technically UB
 #define ahd_scope(init,end)            for(init, *ahd_n_ln = 0; ! ahd_n_ln++; end)
@@ -1030,20 +4710,317 @@ static void ahd__filter(void *arr, void *out, ahd_int len, ahd_int el_size, ahd_
  */
 
 
-/* // TODO: make atomic */
-/* static ahd_int ahd_rc_inc(ahd_rc *rc) */
-/* { return ++rc->rc; } */
+/******************************************************************************/
+/* Reference counting *********************************************************/
+/******************************************************************************/
+/* For headers with an ahd_t(rc): hand an array on with ahd_retain rather than
+ * copying it, and have each holder ahd_release it. rc.rc counts the references
+ * beyond the first, so a new array starts with 1. The counting is atomic, but
+ * the contents are not protected: only modify an array after ahd_cow.
+ * If rc.free is set, the last release calls it with the array instead of
+ * freeing it (e.g. to free what the elements own, then ahd_free the array).
+ */
+#define ahd_refs(ht,a)    ahd_if(a, ahd__atomic_load(&ahd_hdr(ht,a)->rc.rc) + 1)
+#define ahd_retain(ht,a)  (ahd_if(a, ahd__atomic_add(&ahd_hdr(ht,a)->rc.rc, (ahd_int)1)), (a))
+#define ahd_release(ht,a) (ahd__release(ahd_if(a, ahd_hdr(ht,a)), sizeof(ht), offsetof(ht, rc)), (a) = 0)
+// copy-on-write: if a is shared, replaces this reference with a copy of its own
+#define ahd_cow(ht,a)     (*(void **)&(a) = ahd__cow(a, sizeof(ht), sizeof(*(a)), offsetof(ht, rc)))
+
+static void
+ahd__release(void *ptr, ahd_int hdr_size, ahd_int rc_off)
+{
+	ahd_rc *rc = ptr ? (ahd_rc *)((char *)ptr + rc_off) : 0;
+	if(! rc || ahd__atomic_add(&rc->rc, (ahd_int)-1) != 0)
+	{ return; }
+	if(rc->free) { rc->free((char *)ptr + hdr_size); }
+	else         { ahd__free(ptr); }
+}
+
+static void *
+ahd__cow(void *arr, ahd_int hdr_size, ahd_int el_size, ahd_int rc_off)
+{
+	char *copy;
+	if(! arr || ahd__atomic_load((ahd_int *)((char *)arr - hdr_size + rc_off)) == 0)
+	{ return arr; } /* not shared */
+	copy = (char *)ahd__dup(arr, hdr_size, el_size);
+	((ahd_rc *)(copy - hdr_size + rc_off))->rc = 0; /* keeps rc.free */
+	ahd__release((char *)arr - hdr_size, hdr_size, rc_off);
+	return copy;
+}
+
+
+/******************************************************************************/
+/* Hash maps ******************************************************************/
+/******************************************************************************/
+/* For headers with an ahd_t(map): the elements of the array are the entries,
+ * each with a `key` member (and a `value` member for ahd_map_put), and
+ * map.slots indexes them by key. Iterate over the array as usual: the entries
+ * stay contiguous, as ahd_map_del moves the last one into the gap it leaves.
+ * Keys are hashed and compared by their bytes, so pointers (e.g. strings) are
+ * compared by address, and struct keys should have no padding.
+ * Lookups write the key into the spare element past len (growing the array if
+ * there is none); ahd_map_getp, which takes a pointer to the key, doesn't, so
+ * use that for lookups from several threads at once.
+ * Add, remove, copy and free entries only with the ahd_map_* operations, so
+ * that the index keeps up. These work with ahd_t(rc) in the header too, but
+ * are not thread-safe.
+ */
+#define ahd__mapargs(ht,a)    (a), sizeof(ht), sizeof(*(a)), offsetof(ht, map), \
+                              ahd__memoff(a, &(a)->key), sizeof((a)->key)
+// puts make sure that there is still a spare element after adding one, so lookups don't move a
+#define ahd__mapkey(ht,a,k,n) (ahd_maybegrow(ht,a,n), (a)[ahd__len(ht,a)].key = (k))
+#define ahd__mapspare(ht,a)   (&(a)[ahd__len(ht,a)].key)
+
+// the entry for k, adding one (zeroed apart from its key) if there isn't one
+#define ahd_map_at(ht,a,k)    (ahd__mapkey(ht,a,k,2), (a) + ahd__map_put(ahd__mapargs(ht,a)))
+#define ahd_map_put(ht,a,k,v) (ahd_map_at(ht,a,k)->value = (v))
+// index of the entry for k, or len(a) if there isn't one
+#define ahd_map_geti(ht,a,k)  ((a) ? (ahd__mapkey(ht,a,k,1), ahd__map_find(ahd__mapargs(ht,a), ahd__mapspare(ht,a))) : 0)
+#define ahd_map_getp(ht,a,kp) ahd__map_find(ahd__mapargs(ht,a), kp)
+// the entry for k (as a void *), or 0
+#define ahd_map_get(ht,a,k)   ((a) ? (ahd__mapkey(ht,a,k,1), ahd__map_get(ahd__mapargs(ht,a), ahd__mapspare(ht,a))) : (void *)0)
+// removes the entry for k, returning whether there was one
+#define ahd_map_del(ht,a,k)   ((a) ? (ahd__mapkey(ht,a,k,1), ahd__map_del(ahd__mapargs(ht,a), ahd__mapspare(ht,a))) : 0)
+
+// removes all entries, keeping the memory of both the array and its index
+#define ahd_map_clear(ht,a)   (ahd__map_clear(ahd_if(a, ahd_hdr(ht,a)), offsetof(ht, map)), ahd_clear(ht,a))
+#define ahd_map_free(ht,a)    (ahd__map_freeidx(ahd_if(a, ahd_hdr(ht,a)), offsetof(ht, map)), ahd_free(ht,a))
+#define ahd_map_dup(ht,a)     ahd__map_dup(ahd__mapargs(ht,a))
+// as ahd_release/ahd_cow, for maps with an ahd_t(rc)
+#define ahd_map_release(ht,a) (ahd__map_release(ahd_if(a, ahd_hdr(ht,a)), sizeof(ht), offsetof(ht, rc), offsetof(ht, map)), (a) = 0)
+#define ahd_map_cow(ht,a)     (*(void **)&(a) = ahd__map_cow(ahd__mapargs(ht,a), offsetof(ht, rc)))
+/* Usage:
+ * typedef struct word_map { ahd_t(arr); ahd_t(map); } word_map;
+ * typedef struct word_count { char const *key; int value; } word_count;
+ * word_count *counts = 0;
+ * ahd_map_put(word_map, counts, word, 1);
+ * ++ahd_map_at(word_map, counts, word)->value;
+ * word_count *entry = (word_count *)ahd_map_get(word_map, counts, word);
+ * for arr_each(counts, i) { printf("%s: %d\n", counts[i].key, counts[i].value); }
+ * ahd_map_free(word_map, counts);
+ */
 
-/* static ahd_int ahd_rc_dec(ahd_rc *rc, void *raw) { */
-/* 	void (*freefn)(void*) = rc->free ? rc->free : AHD_FREE; */
-/* 	if(--rc->rc == 0) */
-/* 	{ */
-/*         (rc->free */
-/*          ? rc->free(raw) */
-/*          : AHD_FREE(raw)); */
-/*     } */
-/*     return rc->rc; */
-/* } */
+typedef struct ahd__mapslot {
+	ahd_int hash; /* 0 for an empty slot (hashes have the top bit set) */
+	ahd_int i;    /* the index of the entry in the array */
+} ahd__mapslot;
+
+#define ahd__maphash(key,size)     (ahd__hashbytes(key, size) | (ahd_int)1 << 63)
+// how far the slot at `at` is from the first one that hash could have gone in
+#define ahd__mapdist(map,hash,at)  (((at) - (hash)) & (map)->mask)
+#define ahd__mapfull(map,n)        (! (map)->slots || (n) * 8 > ((map)->mask + 1) * 7)
+
+static void
+ahd__map_freeidx(void *ptr, ahd_int map_off)
+{
+	ahd_map *map = ptr ? (ahd_map *)((char *)ptr + map_off) : 0;
+	ahd_allocator const *alloc;
+	if(! map || ! map->slots)
+	{ return; }
+	alloc = ahd__allocof((ahd_arr *)ptr);
+	if(alloc) { alloc->free(alloc->data, map->slots); }
+	else      { AHD_FREE(map->slots); }
+	map->slots = 0, map->mask = 0;
+}
+
+static void
+ahd__map_clear(void *ptr, ahd_int map_off)
+{
+	ahd_map *map = ptr ? (ahd_map *)((char *)ptr + map_off) : 0;
+	ahd_int i;
+	for(i = 0; map && map->slots && i <= map->mask; ++i)
+	{ map->slots[i].hash = 0; }
+}
+
+/* Robin Hood: entries further from where their hash starts take the slots of
+ * those that are nearer, which keeps the probe lengths even */
+static void
+ahd__map_insert(ahd_map *map, ahd_int hash, ahd_int i)
+{
+	ahd_int at = hash & map->mask, dist = 0;
+	for(;; at = (at + 1) & map->mask, ++dist) {
+		ahd__mapslot *slot = &map->slots[at];
+		ahd_int slot_dist;
+		if(! slot->hash) {
+			slot->hash = hash, slot->i = i;
+			return;
+		}
+		slot_dist = ahd__mapdist(map, slot->hash, at);
+		if(slot_dist < dist) {
+			ahd__mapslot displaced = *slot;
+			slot->hash = hash, slot->i = i;
+			hash = displaced.hash, i = displaced.i, dist = slot_dist;
+		}
+	}
+}
+
+/* moves the index to a table of n_slots (a power of 2) from the array's allocator */
+static int
+ahd__map_rehash(ahd_arr *head, ahd_map *map, ahd_int n_slots)
+{
+	ahd_allocator const *alloc = ahd__allocof(head);
+	ahd__mapslot *old = map->slots;
+	ahd_int n_old = old ? map->mask + 1 : 0, i;
+	ahd__mapslot *slots = (ahd__mapslot *)ahd__allocrealloc(alloc, 0, 0, n_slots * sizeof(*slots));
+	if(! slots) {
+#ifdef AHD_BUFFER_OUT_OF_MEMORY
+		AHD_BUFFER_OUT_OF_MEMORY ;
+#endif
+		return 0;
+	}
+	for(i = 0; i < n_slots; ++i)
+	{ slots[i].hash = 0; }
+	map->slots = slots, map->mask = n_slots - 1;
+	for(i = 0; i < n_old; ++i)
+	{ if(old[i].hash) { ahd__map_insert(map, old[i].hash, old[i].i); } }
+	if(old) {
+		if(alloc) { alloc->free(alloc->data, old); }
+		else      { AHD_FREE(old); }
+	}
+	return 1;
+}
+
+/* the slot of the entry with key, or ~0 */
+static ahd_int
+ahd__map_slot(char const *arr, ahd_int el_size, ahd_map const *map, ahd_int key_off, ahd_int key_size,
+              void const *key, ahd_int hash)
+{
+	ahd_int at, dist = 0;
+	if(! map->slots)
+	{ return ~(ahd_int)0; }
+	for(at = hash & map->mask;; at = (at + 1) & map->mask, ++dist) {
+		ahd__mapslot const *slot = &map->slots[at];
+		if(! slot->hash || ahd__mapdist(map, slot->hash, at) < dist)
+		{ return ~(ahd_int)0; } /* it would have taken this slot */
+		if(slot->hash == hash && AHD_MEMCMP(arr + slot->i * el_size + key_off, key, key_size) == 0)
+		{ return at; }
+	}
+}
+
+static ahd_int
+ahd__map_find(void *arr, ahd_int hdr_size, ahd_int el_size, ahd_int map_off, ahd_int key_off, ahd_int key_size,
+              void const *key)
+{
+	ahd_arr *head;
+	ahd_map *map;
+	ahd_int at;
+	if(! arr)
+	{ return 0; }
+	head = (ahd_arr *)((char *)arr - hdr_size);
+	map  = (ahd_map *)((char *)head + map_off);
+	at   = ahd__map_slot((char *)arr, el_size, map, key_off, key_size, key, ahd__maphash(key, key_size));
+	return ~at ? map->slots[at].i : head->len;
+}
+
+static void *
+ahd__map_get(void *arr, ahd_int hdr_size, ahd_int el_size, ahd_int map_off, ahd_int key_off, ahd_int key_size,
+             void const *key)
+{
+	ahd_int i = ahd__map_find(arr, hdr_size, el_size, map_off, key_off, key_size, key);
+	return i < ((ahd_arr *)((char *)arr - hdr_size))->len ? (char *)arr + i * el_size : 0;
+}
+
+/* for the key in the spare element past len: its entry, or that element added as a new one */
+static ahd_int
+ahd__map_put(void *arr, ahd_int hdr_size, ahd_int el_size, ahd_int map_off, ahd_int key_off, ahd_int key_size)
+{
+	ahd_arr *head = (ahd_arr *)((char *)arr - hdr_size);
+	ahd_map *map  = (ahd_map *)((char *)head + map_off);
+	char *el      = (char *)arr + head->len * el_size;
+	ahd_int hash  = ahd__maphash(el + key_off, key_size);
+	ahd_int at    = ahd__map_slot((char *)arr, el_size, map, key_off, key_size, el + key_off, hash);
+	if(~at)
+	{ return map->slots[at].i; }
+	if(ahd__mapfull(map, head->len + 1) &&
+	   ! ahd__map_rehash(head, map, map->slots ? 2 * (map->mask + 1) : 16))
+	{ return head->len; } /* out of memory: the value goes in the spare element */
+	AHD_MEMSET(el, 0, key_off);
+	AHD_MEMSET(el + key_off + key_size, 0, el_size - key_off - key_size);
+	ahd__map_insert(map, hash, head->len);
+	return head->len++;
+}
+
+static int
+ahd__map_del(void *arr, ahd_int hdr_size, ahd_int el_size, ahd_int map_off, ahd_int key_off, ahd_int key_size,
+             void const *key)
+{
+	ahd_arr *head = (ahd_arr *)((char *)arr - hdr_size);
+	ahd_map *map  = (ahd_map *)((char *)head + map_off);
+	ahd_int at    = ahd__map_slot((char *)arr, el_size, map, key_off, key_size, key, ahd__maphash(key, key_size));
+	ahd_int next, i, last;
+	if(! ~at)
+	{ return 0; }
+	i    = map->slots[at].i;
+	last = --head->len;
+	/* backward shift: the rest of the run moves one slot nearer to where it starts */
+	for(next = (at + 1) & map->mask;
+	    map->slots[next].hash && ahd__mapdist(map, map->slots[next].hash, next);
+	    at = next, next = (next + 1) & map->mask)
+	{ map->slots[at] = map->slots[next]; }
+	map->slots[at].hash = 0;
+
+	if(i != last) { /* the last entry fills the gap */
+		char *moved  = (char *)arr + last * el_size;
+		ahd_int hash = ahd__maphash(moved + key_off, key_size);
+		for(at = hash & map->mask; map->slots[at].hash != hash || map->slots[at].i != last; at = (at + 1) & map->mask) {}
+		map->slots[at].i = i;
+		AHD_MEMCPY((char *)arr + i * el_size, moved, el_size);
+	}
+	return 1;
+}
+
+/* gives arr an index of its own (e.g. as a copy, sharing the original's) */
+static void
+ahd__map_reindex(void *arr, ahd_int hdr_size, ahd_int el_size, ahd_int map_off, ahd_int key_off, ahd_int key_size)
+{
+	ahd_arr *head = (ahd_arr *)((char *)arr - hdr_size);
+	ahd_map *map  = (ahd_map *)((char *)head + map_off);
+	ahd_int n_slots = 16, i;
+	char *el = (char *)arr;
+	map->slots = 0, map->mask = 0;
+	if(! head->len)
+	{ return; }
+	while(n_slots * 7 < head->len * 8) { n_slots <<= 1; }
+	if(! ahd__map_rehash(head, map, n_slots))
+	{ return; }
+	for(i = 0; i < head->len; ++i, el += el_size)
+	{ ahd__map_insert(map, ahd__maphash(el + key_off, key_size), i); }
+}
+
+static void *
+ahd__map_dup(void *arr, ahd_int hdr_size, ahd_int el_size, ahd_int map_off, ahd_int key_off, ahd_int key_size)
+{
+	void *copy;
+	if(! arr)
+	{ return 0; }
+	copy = ahd__dup(arr, hdr_size, el_size);
+	ahd__map_reindex(copy, hdr_size, el_size, map_off, key_off, key_size);
+	return copy;
+}
+
+static void
+ahd__map_release(void *ptr, ahd_int hdr_size, ahd_int rc_off, ahd_int map_off)
+{
+	ahd_rc *rc = ptr ? (ahd_rc *)((char *)ptr + rc_off) : 0;
+	if(! rc || ahd__atomic_add(&rc->rc, (ahd_int)-1) != 0)
+	{ return; }
+	ahd__map_freeidx(ptr, map_off);
+	if(rc->free) { rc->free((char *)ptr + hdr_size); }
+	else         { ahd__free(ptr); }
+}
+
+static void *
+ahd__map_cow(void *arr, ahd_int hdr_size, ahd_int el_size, ahd_int map_off, ahd_int key_off, ahd_int key_size,
+             ahd_int rc_off)
+{
+	char *copy;
+	if(! arr || ahd__atomic_load((ahd_int *)((char *)arr - hdr_size + rc_off)) == 0)
+	{ return arr; } /* not shared */
+	copy = (char *)ahd__map_dup(arr, hdr_size, el_size, map_off, key_off, key_size);
+	((ahd_rc *)(copy - hdr_size + rc_off))->rc = 0;
+	ahd__map_release((char *)arr - hdr_size, hdr_size, rc_off, map_off);
+	return copy;
+}
 
 #ifdef AHD_IMPLEMENTATION
 #include <stdarg.h>
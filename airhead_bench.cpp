@@ -0,0 +1,1229 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdlib.h>
+#include <stdio.h>
+/* bytes asked of the allocator, for the suite's bytes/op (not atomic: only read single-threaded) */
+static unsigned long long bench_alloc_bytes;
+static void *bench_realloc(void *ptr, size_t size) { bench_alloc_bytes += size; return realloc(ptr, size); }
+#define AHD_REALLOC(ptr, size) bench_realloc(ptr, size)
+#define AHD_FREE(ptr) free(ptr)
+#define AHD_THREADS
+#define AHD_GROW_STATS
+#define AHD_IMPLEMENTATION /* arr_printf */
+#include "airhead.h"
+#include <limits.h>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <windows.h>
+static double bench_now(void) {
+	LARGE_INTEGER freq, t;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&t);
+	return (double)t.QuadPart / (double)freq.QuadPart;
+}
+#else
+#include <time.h>
+static double bench_now(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+#endif
+
+typedef struct test_t {
+	int Int;
+	float Float;
+	char *String;
+} test_t;
+
+static unsigned int bench_seed = 1;
+static unsigned int bench_rand(void) {
+	bench_seed ^= bench_seed << 13;
+	bench_seed ^= bench_seed >> 17;
+	bench_seed ^= bench_seed << 5;
+	return bench_seed;
+}
+
+
+/******************************************************************************/
+/* Sorting ********************************************************************/
+/******************************************************************************/
+typedef enum bench_order { ORDER_SORTED, ORDER_REVERSED, ORDER_RANDOM, ORDER_DUPS, ORDER_COUNT } bench_order;
+static char const *bench_order_names[ORDER_COUNT] = { "sorted", "reversed", "random", "dups" };
+
+static void bench_fill(test_t *arr, ahd_int n, bench_order order) {
+	for(ahd_int i = 0; i < n; ++i) {
+		int v = 0;
+		switch(order) {
+			case ORDER_SORTED:   v = (int)i;                  break;
+			case ORDER_REVERSED: v = (int)(n - i);            break;
+			case ORDER_RANDOM:   v = (int)bench_rand();       break;
+			case ORDER_DUPS:     v = (int)(bench_rand() % 16); break;
+			default: break;
+		}
+		arr[i].Int    = v;
+		arr[i].Float  = (float)v;
+		arr[i].String = 0;
+	}
+}
+
+/* the insertion sort that ahd__sorti used before the introsort engine */
+static void bench_insertion_sorti(test_t *arr, ahd_int len) {
+	char *base = (char *)arr, *guard = base + len * sizeof(*arr), *at, *a, *b;
+	for(at = base; at + sizeof(*arr) < guard; at += sizeof(*arr)) {
+		for(a = at; ; a -= sizeof(*arr)) {
+			b = a + sizeof(*arr);
+			if(((test_t *)a)->Int > ((test_t *)b)->Int) {
+				ahd__memswap(a, b, sizeof(*arr));
+				if(a == base) { break; }
+			} else break;
+		}
+	}
+}
+
+/* comparison sort only, bypassing the automatic switch to radix/index sort (int key at offset 0) */
+static void bench_introsort(void *arr, ahd_int len, ahd_int el_size) {
+	char tmp[AHD_STACK_BUF_SIZE];
+	int depth = 0;
+	ahd__sorter s = { tmp, el_size, 0, ahd_INT | ahd_SIGN | sizeof(int), ahd_ASC };
+	for(ahd_int n = len; n; n >>= 1) { depth += 2; }
+	ahd__sort_intro(&s, (char *)arr, len, depth);
+}
+
+/* quadratic: don't wait minutes for the baseline on large unsorted inputs */
+#define BENCH_INSERTION_MAX 10000
+
+static void bench_sort(void) {
+	ahd_int sizes[] = { 1000, 10000, 100000, 1000000, 10000000 };
+	test_t *arr = 0;
+
+	printf("%-10s %-9s %12s %12s %12s %12s\n", "n", "input", "sorti ms", "introsort ms", "radix ms", "insertion ms");
+	for(int i_size = 0; i_size < (int)(sizeof(sizes)/sizeof(*sizes)); ++i_size) {
+		ahd_int n = sizes[i_size];
+		arr_resetlen(arr, n);
+
+		for(int order = 0; order < ORDER_COUNT; ++order) {
+			double t0, t_sort, t_intro, t_radix, t_insertion = -1.0;
+
+			bench_seed = 1; bench_fill(arr, n, (bench_order)order);
+			t0 = bench_now();
+			arr_sorti(arr, &arr->Int, ahd_ASC);
+			t_sort = bench_now() - t0;
+
+			bench_seed = 1; bench_fill(arr, n, (bench_order)order);
+			t0 = bench_now();
+			bench_introsort(arr, n, sizeof(*arr));
+			t_intro = bench_now() - t0;
+
+			bench_seed = 1; bench_fill(arr, n, (bench_order)order);
+			t0 = bench_now();
+			arr_radixi(arr, &arr->Int, ahd_ASC);
+			t_radix = bench_now() - t0;
+
+			if(n <= BENCH_INSERTION_MAX || order == ORDER_SORTED) {
+				bench_seed = 1; bench_fill(arr, n, (bench_order)order);
+				t0 = bench_now();
+				bench_insertion_sorti(arr, n);
+				t_insertion = bench_now() - t0;
+			}
+
+			printf("%-10llu %-9s %12.3f %12.3f %12.3f ", n, bench_order_names[order], t_sort*1e3, t_intro*1e3, t_radix*1e3);
+			if(t_insertion >= 0.0) { printf("%12.3f\n", t_insertion*1e3); }
+			else                   { printf("%12s\n", "skipped"); }
+		}
+	}
+	arr_free(arr);
+}
+
+typedef struct bench_big { int Key; char Payload[252]; } bench_big;
+
+static void bench_sort_large(void) {
+	ahd_int sizes[] = { 10000, 100000, 1000000 };
+	bench_big *arr = 0;
+
+	printf("\n%zu-byte elements, random keys\n", sizeof(*arr));
+	printf("%-10s %12s %12s %12s\n", "n", "sorti ms", "introsort ms", "stable ms");
+	for(int i_size = 0; i_size < (int)(sizeof(sizes)/sizeof(*sizes)); ++i_size) {
+		ahd_int n = sizes[i_size];
+		double t0, t_sort, t_intro, t_stable;
+		arr_resetlen(arr, n);
+
+		bench_seed = 1;
+		for(ahd_int i = 0; i < n; ++i) { arr[i].Key = (int)bench_rand(); }
+		t0 = bench_now();
+		arr_sorti(arr, &arr->Key, ahd_ASC);
+		t_sort = bench_now() - t0;
+
+		bench_seed = 1;
+		for(ahd_int i = 0; i < n; ++i) { arr[i].Key = (int)bench_rand(); }
+		t0 = bench_now();
+		bench_introsort(arr, n, sizeof(*arr));
+		t_intro = bench_now() - t0;
+
+		bench_seed = 1;
+		for(ahd_int i = 0; i < n; ++i) { arr[i].Key = (int)bench_rand(); }
+		t0 = bench_now();
+		arr_stablesorti(arr, &arr->Key, ahd_ASC);
+		t_stable = bench_now() - t0;
+
+		printf("%-10llu %12.3f %12.3f %12.3f\n", n, t_sort*1e3, t_intro*1e3, t_stable*1e3);
+	}
+	arr_free(arr);
+}
+
+static int bench_cmp_name(void const *a, void const *b)
+{ return strcmp(((test_t const *)a)->String, ((test_t const *)b)->String); }
+
+static void bench_sort_str(void) {
+	ahd_int sizes[] = { 10000, 100000, 1000000 };
+	test_t *arr = 0;
+	char *names = 0;
+
+	printf("\nchar * member, keys \"user/profile/%%010u\"\n");
+	printf("%-10s %12s %12s\n", "n", "sortstr ms", "qsort ms");
+	for(int i_size = 0; i_size < (int)(sizeof(sizes)/sizeof(*sizes)); ++i_size) {
+		ahd_int n = sizes[i_size];
+		double t0, t_sortstr, t_qsort;
+		arr_resetlen(arr, n);
+		arr_resetlen(names, n * 32);
+
+		bench_seed = 1;
+		for(ahd_int i = 0; i < n; ++i) {
+			arr[i].String = names + i * 32;
+			sprintf(arr[i].String, "user/profile/%010u", bench_rand());
+		}
+		t0 = bench_now();
+		arr_sortstr(arr, &arr->String, ahd_ASC);
+		t_sortstr = bench_now() - t0;
+
+		bench_seed = 1;
+		for(ahd_int i = 0; i < n; ++i) {
+			arr[i].String = names + i * 32;
+			sprintf(arr[i].String, "user/profile/%010u", bench_rand());
+		}
+		t0 = bench_now();
+		qsort(arr, n, sizeof(*arr), bench_cmp_name);
+		t_qsort = bench_now() - t0;
+
+		printf("%-10llu %12.3f %12.3f\n", n, t_sortstr*1e3, t_qsort*1e3);
+	}
+	arr_free(arr);
+	arr_free(names);
+}
+
+static void bench_psort(void) {
+	ahd_int sizes[] = { 1000000, 10000000, 50000000 };
+	int n_cores = ahd_num_cores(), max_threads = ahd__max(n_cores, 4);
+	test_t *arr = 0;
+
+	printf("\npsorti, random int keys (%d cores)\n", n_cores);
+	printf("%-10s %8s %12s %10s\n", "n", "threads", "psorti ms", "speedup");
+	for(int i_size = 0; i_size < (int)(sizeof(sizes)/sizeof(*sizes)); ++i_size) {
+		ahd_int n = sizes[i_size];
+		double t_single = 0.0;
+		arr_resetlen(arr, n);
+
+		for(int n_threads = 1; n_threads <= max_threads; n_threads *= 2) {
+			double t0, t_sort;
+			bench_seed = 1; bench_fill(arr, n, ORDER_RANDOM);
+			ahd_psort_threads = n_threads;
+			t0 = bench_now();
+			arr_psorti(arr, &arr->Int, ahd_ASC);
+			t_sort = bench_now() - t0;
+			if(n_threads == 1) { t_single = t_sort; }
+
+			printf("%-10llu %8d %12.3f %9.2fx\n", n, n_threads, t_sort*1e3, t_single/t_sort);
+		}
+	}
+	ahd_psort_threads = AHD_PSORT_THREADS;
+	arr_free(arr);
+}
+
+/******************************************************************************/
+/* Growth policy **************************************************************/
+/******************************************************************************/
+typedef struct bench_grow_arr { ahd_t(arr); ahd_t(policy); } bench_grow_arr;
+typedef struct bench_el16   { char Bytes[16]; }   bench_el16;
+typedef struct bench_el4096 { char Bytes[4096]; } bench_el4096;
+
+static ahd_growth const bench_policies[] = {
+	{ 2, 1,   64,    0 },
+	{ 3, 2,   64,    0 },
+	{ 2, 1, 4096,    0 },
+	{ 2, 1,   64, 4096 },
+	{ 3, 2,   64, 4096 },
+};
+#define BENCH_GROW_BYTES (100 * 1024 * 1024)
+
+static void bench_growth_print(ahd_int el_size, ahd_growth const *g, ahd_int cap_bytes) {
+	char name[48];
+	sprintf(name, "%llu/%llu min %llu round %llu", g->num, g->den, g->min_bytes, g->round);
+	printf("%-8llu %-26s %10llu %12.2f %12.2f %9.2f%%\n", el_size, name, ahd_grow_stats.reallocs,
+	       ahd_grow_stats.bytes_moved / 1048576.0, ahd_grow_stats.bytes_spare / 1048576.0,
+	       100.0 * (double)(cap_bytes - BENCH_GROW_BYTES) / (double)cap_bytes);
+}
+
+#define BENCH_GROWTH(t) do { \
+		for(int i_policy = 0; i_policy < (int)(sizeof(bench_policies)/sizeof(*bench_policies)); ++i_policy) { \
+			t *arr = 0, el = {0}; \
+			ahd_growstats zero_stats = {0}; \
+			ahd_grow_stats = zero_stats; \
+			ahd_setgrowth(bench_grow_arr, arr, &bench_policies[i_policy]); \
+			for(ahd_int i = 0; i < BENCH_GROW_BYTES / sizeof(t); ++i) \
+			{ ahd_push(bench_grow_arr, arr, el); } \
+			bench_growth_print(sizeof(t), &bench_policies[i_policy], ahd_capsize(bench_grow_arr, arr)); \
+			ahd_free(bench_grow_arr, arr); \
+		} \
+	} while(0)
+
+static void bench_growth(void) {
+	printf("\npushing %d MB one element at a time\n", BENCH_GROW_BYTES >> 20);
+	printf("%-8s %-26s %10s %12s %12s %10s\n", "el size", "policy", "reallocs", "moved MB", "spare MB", "wasted");
+	BENCH_GROWTH(char);
+	BENCH_GROWTH(bench_el16);
+	BENCH_GROWTH(bench_el4096);
+}
+
+static void bench_reserve(void) {
+	ahd_int sizes[] = { 1000, 100000, 10000000 };
+	ahd_growstats zero_stats = {0};
+
+	printf("\nbuilding an array of test_t of known size\n");
+	printf("%-10s %12s %10s %16s %10s\n", "n", "push ms", "reallocs", "reserve+_push ms", "reallocs");
+	for(int i_size = 0; i_size < (int)(sizeof(sizes)/sizeof(*sizes)); ++i_size) {
+		ahd_int n = sizes[i_size], push_reallocs;
+		test_t *arr = 0, val = { 1, 2.f, 0 };
+		double t0, t_push, t_reserve;
+
+		ahd_grow_stats = zero_stats;
+		t0 = bench_now();
+		for(ahd_int i = 0; i < n; ++i) { arr_push(arr, val); }
+		t_push = bench_now() - t0;
+		push_reallocs = ahd_grow_stats.reallocs;
+		arr_free(arr);
+
+		ahd_grow_stats = zero_stats;
+		t0 = bench_now();
+		arr_reserve(arr, n);
+		for(ahd_int i = 0; i < n; ++i) { arr__push(arr, val); }
+		t_reserve = bench_now() - t0;
+		arr_free(arr);
+
+		printf("%-10llu %12.3f %10llu %16.3f %10llu\n", n, t_push*1e3, push_reallocs, t_reserve*1e3, ahd_grow_stats.reallocs);
+	}
+}
+
+/* per-request scratch: a few short-lived arrays built, then all dropped */
+static void bench_arena(void) {
+	enum { n_requests = 100000, n_arrays = 8 };
+	ahd_arena arena = {0};
+	double t0, t_heap, t_arena;
+
+	bench_seed = 1;
+	t0 = bench_now();
+	for(int i_req = 0; i_req < n_requests; ++i_req) {
+		int *arrs[n_arrays] = {0};
+		for(int i_arr = 0; i_arr < n_arrays; ++i_arr) {
+			for(unsigned int i = 0, n = bench_rand() % 200; i < n; ++i)
+			{ ahd_push(bench_grow_arr, arrs[i_arr], (int)i); }
+		}
+		for(int i_arr = 0; i_arr < n_arrays; ++i_arr) { ahd_free(bench_grow_arr, arrs[i_arr]); }
+	}
+	t_heap = bench_now() - t0;
+
+	bench_seed = 1;
+	t0 = bench_now();
+	for(int i_req = 0; i_req < n_requests; ++i_req) {
+		int *arrs[n_arrays] = {0};
+		for(int i_arr = 0; i_arr < n_arrays; ++i_arr) {
+			ahd_setarena(bench_grow_arr, arrs[i_arr], &arena);
+			for(unsigned int i = 0, n = bench_rand() % 200; i < n; ++i)
+			{ ahd_push(bench_grow_arr, arrs[i_arr], (int)i); }
+		}
+		ahd_arena_reset(&arena);
+	}
+	t_arena = bench_now() - t0;
+	ahd_arena_free(&arena);
+
+	printf("\n%d requests of %d scratch int arrays (0-200 pushes each)\n", n_requests, n_arrays);
+	printf("%12s %12s\n", "heap ms", "arena ms");
+	printf("%12.3f %12.3f\n", t_heap*1e3, t_arena*1e3);
+}
+
+/******************************************************************************/
+/* Aligned data ***************************************************************/
+/******************************************************************************/
+typedef struct bench_simd_arr { AHD_ALIGNAS(64) ahd_t(arr); } bench_simd_arr;
+
+#ifdef __AVX__
+#include <immintrin.h>
+/* 4 independent sums, so that the loop is bound by loads rather than add latency */
+#define BENCH_SUM(name, load) \
+	static float name(float const *xs, ahd_int n) { \
+		__m256 s0 = _mm256_setzero_ps(), s1 = s0, s2 = s0, s3 = s0; \
+		float lanes[8], sum = 0.f; \
+		for(ahd_int i = 0; i + 32 <= n; i += 32) { \
+			s0 = _mm256_add_ps(s0, load(xs + i)); \
+			s1 = _mm256_add_ps(s1, load(xs + i + 8)); \
+			s2 = _mm256_add_ps(s2, load(xs + i + 16)); \
+			s3 = _mm256_add_ps(s3, load(xs + i + 24)); \
+		} \
+		_mm256_storeu_ps(lanes, _mm256_add_ps(_mm256_add_ps(s0, s1), _mm256_add_ps(s2, s3))); \
+		for(int i = 0; i < 8; ++i) { sum += lanes[i]; } \
+		return sum; \
+	}
+BENCH_SUM(bench_sum_aligned,   _mm256_load_ps)
+BENCH_SUM(bench_sum_unaligned, _mm256_loadu_ps)
+#else
+/* no AVX: leave the vectorising to the compiler */
+static float bench_sum_aligned(float const *xs, ahd_int n) {
+	float sum[8] = {0};
+	for(ahd_int i = 0; i + 8 <= n; i += 8) { for(int j = 0; j < 8; ++j) { sum[j] += xs[i + j]; } }
+	return sum[0] + sum[1] + sum[2] + sum[3] + sum[4] + sum[5] + sum[6] + sum[7];
+}
+#define bench_sum_unaligned bench_sum_aligned
+#endif
+
+static void bench_aligned(void) {
+	ahd_int sizes[] = { 4096, 262144, 16777216 };
+	float *unaligned = 0, *aligned = 0;
+
+	printf("\nsumming floats (%s), total over the same number of floats per size\n",
+#ifdef __AVX__
+	       "AVX"
+#else
+	       "scalar, no AVX"
+#endif
+	      );
+	printf("%-10s %14s %18s %16s\n", "n", "default ms", "64-aligned loadu", "64-aligned load");
+	for(int i_size = 0; i_size < (int)(sizeof(sizes)/sizeof(*sizes)); ++i_size) {
+		ahd_int n = sizes[i_size], reps = (ahd_int)1 << 28;
+		double t0, t_unaligned, t_aligned_u, t_aligned;
+		volatile float sink = 0.f;
+		reps /= n;
+		arr_resetlen(unaligned, n);
+		ahd_resetlen(bench_simd_arr, aligned, n);
+		for(ahd_int i = 0; i < n; ++i) { unaligned[i] = aligned[i] = (float)(i & 7); }
+
+		t_unaligned = t_aligned_u = t_aligned = 1e9;
+		for(int attempt = 0; attempt < 3; ++attempt) { /* best of 3 */
+			t0 = bench_now();
+			for(ahd_int r = 0; r < reps; ++r) { sink += bench_sum_unaligned(unaligned, n); }
+			t_unaligned = ahd__min(t_unaligned, bench_now() - t0);
+
+			t0 = bench_now();
+			for(ahd_int r = 0; r < reps; ++r) { sink += bench_sum_unaligned(aligned, n); }
+			t_aligned_u = ahd__min(t_aligned_u, bench_now() - t0);
+
+			t0 = bench_now();
+			for(ahd_int r = 0; r < reps; ++r) { sink += bench_sum_aligned(aligned, n); }
+			t_aligned = ahd__min(t_aligned, bench_now() - t0);
+		}
+
+		printf("%-10llu %14.3f %18.3f %16.3f\n", n, t_unaligned*1e3, t_aligned_u*1e3, t_aligned*1e3);
+	}
+	arr_free(unaligned);
+	ahd_free(bench_simd_arr, aligned);
+}
+
+/******************************************************************************/
+/* Slices *********************************************************************/
+/******************************************************************************/
+/* windows onto one big array, each summed: copied with arr_sub vs viewed with arr_slice */
+static void bench_slice(void) {
+	ahd_int windows[] = { 64, 4096, 262144 };
+	int *arr = 0;
+	ahd_int n = 1 << 24;
+
+	arr_reserve(arr, n);
+	for(ahd_int i = 0; i < n; ++i) { arr__push(arr, (int)(i & 1023)); }
+
+	printf("\nsumming windows of a %llu int array (%d ints in total per size)\n", n, 1 << 27);
+	printf("%-10s %12s %12s\n", "window", "sub ms", "slice ms");
+	for(int i_size = 0; i_size < (int)(sizeof(windows)/sizeof(*windows)); ++i_size) {
+		ahd_int window = windows[i_size], n_windows = ((ahd_int)1 << 27) / window;
+		long long sum_sub = 0, sum_slice = 0;
+		double t0, t_sub, t_slice;
+
+		bench_seed = 1;
+		t0 = bench_now();
+		for(ahd_int i_win = 0; i_win < n_windows; ++i_win) {
+			int *sub = (int *)arr_sub(arr, bench_rand() % (n - window), window);
+			for(ahd_int i = 0; i < window; ++i) { sum_sub += sub[i]; }
+			arr_free(sub);
+		}
+		t_sub = bench_now() - t0;
+
+		bench_seed = 1;
+		t0 = bench_now();
+		for(ahd_int i_win = 0; i_win < n_windows; ++i_win) {
+			ahd_slice s = arr_slice(arr, bench_rand() % (n - window), window);
+			for ahd_slice_each_v(s, i, int, v) { sum_slice += v; }
+		}
+		t_slice = bench_now() - t0;
+
+		printf("%-10llu %12.3f %12.3f%s\n", window, t_sub*1e3, t_slice*1e3, sum_sub == sum_slice ? "" : " (sums differ!)");
+	}
+	arr_free(arr);
+}
+
+/******************************************************************************/
+/* Set operations *************************************************************/
+/******************************************************************************/
+static int bench_cmp_u32(void const *a, void const *b)
+{ unsigned int x = *(unsigned int const *)a, y = *(unsigned int const *)b; return (x > y) - (x < y); }
+
+/* deduplicating ID arrays: hashed arr_unique against sort + scan */
+static void bench_unique(void) {
+	ahd_int sizes[] = { 10000, 1000000, 10000000 };
+
+	printf("\nunique of N random u32 ids (about half repeated)\n");
+	printf("%-10s %12s %12s %12s %12s\n", "n", "qsort+scan", "sortu+adj", "unique", "unique sorted");
+	for(int i_size = 0; i_size < (int)(sizeof(sizes)/sizeof(*sizes)); ++i_size) {
+		ahd_int n = sizes[i_size], n_qsort = 0;
+		unsigned int *ids = 0, *copy, *u_sort, *u_hash, *u_sorted;
+		double t0, t_qsort, t_sort, t_hash, t_sorted;
+
+		bench_seed = 1;
+		for(ahd_int i = 0; i < n; ++i) { arr_push(ids, bench_rand() % (unsigned int)n); }
+
+		copy = (unsigned int *)arr_dup(ids);
+		t0 = bench_now();
+		qsort(copy, n, sizeof(*copy), bench_cmp_u32);
+		for(ahd_int i = 0; i < n; ++i) { if(! i || copy[i] != copy[n_qsort-1]) { copy[n_qsort++] = copy[i]; } }
+		t_qsort = bench_now() - t0;
+		arr_free(copy);
+
+		copy = (unsigned int *)arr_dup(ids);
+		t0 = bench_now();
+		arr_sortu(copy, copy, ahd_ASC);
+		u_sort = (unsigned int *)arr_uniqueadj(copy);
+		t_sort = bench_now() - t0;
+
+		t0 = bench_now();
+		u_hash = (unsigned int *)arr_unique(ids);
+		t_hash = bench_now() - t0;
+
+		t0 = bench_now();
+		u_sorted = (unsigned int *)arr_unique(copy); /* already sorted: merged */
+		t_sorted = bench_now() - t0;
+
+		printf("%-10llu %12.3f %12.3f %12.3f %12.3f%s\n", n, t_qsort*1e3, t_sort*1e3, t_hash*1e3, t_sorted*1e3,
+		       arr_len(u_hash) == n_qsort && arr_len(u_sort) == n_qsort && arr_len(u_sorted) == n_qsort ? "" : " (counts differ!)");
+		arr_free(copy);
+		arr_free(u_sort);
+		arr_free(u_hash);
+		arr_free(u_sorted);
+		arr_free(ids);
+	}
+}
+
+/******************************************************************************/
+/* Hash maps ******************************************************************/
+/******************************************************************************/
+typedef struct bench_map_arr { ahd_t(arr); ahd_t(map); } bench_map_arr;
+typedef struct bench_record { unsigned int key; float value; int pad[6]; } bench_record;
+
+/* records indexed by id: ahd_map against an array plus a separate std::unordered_map of indices */
+static void bench_map(void) {
+	ahd_int sizes[] = { 10000, 1000000, 4000000 };
+
+	printf("\nmap of N records by random u32 id, then N lookups (ms)\n");
+	printf("%-10s %14s %14s %14s %14s\n", "n", "separate put", "separate get", "ahd_map put", "ahd_map get");
+	for(int i_size = 0; i_size < (int)(sizeof(sizes)/sizeof(*sizes)); ++i_size) {
+		ahd_int n = sizes[i_size];
+		bench_record *records = 0, *map = 0;
+		std::unordered_map<unsigned int, ahd_int> index;
+		double t0, t_sep_put, t_sep_get, t_put, t_get;
+		float sum_sep = 0, sum = 0;
+
+		bench_seed = 1;
+		t0 = bench_now();
+		for(ahd_int i = 0; i < n; ++i) {
+			unsigned int key = bench_rand();
+			auto found = index.find(key);
+			if(found == index.end()) {
+				bench_record record = { key, (float)i };
+				index[key] = arr_push(records, record);
+			}
+			else { records[found->second].value = (float)i; }
+		}
+		t_sep_put = bench_now() - t0;
+
+		bench_seed = 1;
+		t0 = bench_now();
+		for(ahd_int i = 0; i < n; ++i) { ahd_map_put(bench_map_arr, map, bench_rand(), (float)i); }
+		t_put = bench_now() - t0;
+
+		bench_seed = 7;
+		t0 = bench_now();
+		for(ahd_int i = 0; i < n; ++i) { sum_sep += records[index[records[bench_rand() % n].key]].value; }
+		t_sep_get = bench_now() - t0;
+
+		bench_seed = 7;
+		t0 = bench_now();
+		for(ahd_int i = 0; i < n; ++i) { sum += map[ahd_map_geti(bench_map_arr, map, map[bench_rand() % n].key)].value; }
+		t_get = bench_now() - t0;
+
+		printf("%-10llu %14.3f %14.3f %14.3f %14.3f%s\n", n, t_sep_put*1e3, t_sep_get*1e3, t_put*1e3, t_get*1e3,
+		       arr_len(records) == ahd_len(bench_map_arr, map) ? "" : " (counts differ!)");
+		(void)sum_sep, (void)sum;
+		arr_free(records);
+		ahd_map_free(bench_map_arr, map);
+	}
+}
+
+/******************************************************************************/
+/* Scanning by value **********************************************************/
+/******************************************************************************/
+/* typed find/count (a vector at a time) against the loops they replace */
+static void bench_scan(void) {
+	ahd_int n = 100000000, at_loop = 0, n_loop = 0, n_range_loop = 0;
+	int *ints = 0;
+	float *floats = 0;
+	unsigned char *bytes = 0;
+	double t0, t_find_loop, t_find, t_count_loop, t_count, t_range_loop, t_range, t_bytes_loop, t_bytes, t_flt_loop, t_flt;
+	ahd_int at, count, range, count_bytes, count_bytes_loop = 0, count_flt, count_flt_loop = 0;
+
+	arr_reserve(ints, n);
+	arr_reserve(floats, n);
+	arr_reserve(bytes, n);
+	bench_seed = 1;
+	for(ahd_int i = 0; i < n; ++i) {
+		unsigned int r = bench_rand();
+		arr__push(ints, (int)(r % 1000000));
+		arr__push(floats, (float)(r % 1000));
+		arr__push(bytes, (unsigned char)r);
+	}
+	ints[n - 1] = -1; /* found only at the end */
+
+	t0 = bench_now();
+	for(at_loop = 0; at_loop < n && ints[at_loop] != -1; ++at_loop) {}
+	t_find_loop = bench_now() - t0;
+	t0 = bench_now();
+	at = arr_findeqi(ints, -1);
+	t_find = bench_now() - t0;
+
+	t0 = bench_now();
+	arr_countx(ints, i, n_loop, ints[i] == 12345) {}
+	t_count_loop = bench_now() - t0;
+	t0 = bench_now();
+	count = arr_counteqi(ints, 12345);
+	t_count = bench_now() - t0;
+
+	t0 = bench_now();
+	arr_countx(ints, i, n_range_loop, ints[i] >= 1000 && ints[i] <= 200000) {}
+	t_range_loop = bench_now() - t0;
+	t0 = bench_now();
+	range = arr_countrangei(ints, 1000, 200000);
+	t_range = bench_now() - t0;
+
+	t0 = bench_now();
+	arr_countx(bytes, i, count_bytes_loop, bytes[i] == 7) {}
+	t_bytes_loop = bench_now() - t0;
+	t0 = bench_now();
+	count_bytes = arr_countequ(bytes, 7);
+	t_bytes = bench_now() - t0;
+
+	t0 = bench_now();
+	arr_countx(floats, i, count_flt_loop, floats[i] > 990.f) {}
+	t_flt_loop = bench_now() - t0;
+	t0 = bench_now();
+	count_flt = arr_countrangef(floats, 990.5f, 1e9f);
+	t_flt = bench_now() - t0;
+
+	printf("\nscan %llu elements (ms)  vectors of %d bytes\n", n, AHD__VBYTES);
+	printf("%-28s %10s %10s\n", "", "loop", "typed");
+	printf("%-28s %10.2f %10.2f%s\n", "find int (at end)",   t_find_loop*1e3,  t_find*1e3,  at == at_loop ? "" : " (differ!)");
+	printf("%-28s %10.2f %10.2f%s\n", "count int ==",        t_count_loop*1e3, t_count*1e3, count == n_loop ? "" : " (differ!)");
+	printf("%-28s %10.2f %10.2f%s\n", "count int in range",  t_range_loop*1e3, t_range*1e3, range == n_range_loop ? "" : " (differ!)");
+	printf("%-28s %10.2f %10.2f%s\n", "count u8 ==",         t_bytes_loop*1e3, t_bytes*1e3, count_bytes == count_bytes_loop ? "" : " (differ!)");
+	printf("%-28s %10.2f %10.2f%s\n", "count float >",       t_flt_loop*1e3,   t_flt*1e3,   count_flt == count_flt_loop ? "" : " (differ!)");
+	arr_free(ints);
+	arr_free(floats);
+	arr_free(bytes);
+}
+
+/******************************************************************************/
+/* Reductions *****************************************************************/
+/******************************************************************************/
+/* typed reductions against arr_reducefn (a call per element) and plain loops */
+static int bench_reduce_sumf(ahd_loop_info *info, void *acc, void *val)
+{ (void)info; *(double *)acc += *(float *)val; return 0; }
+static int bench_reduce_mini(ahd_loop_info *info, void *acc, void *val)
+{ (void)info; int *m = (int *)acc, v = *(int *)val; if(v < *m) { *m = v; } return 0; }
+
+typedef struct bench_body { float x, y, z, mass; } bench_body;
+
+static void bench_reduce(void) {
+	ahd_int n = 20000000, at_loop = 0;
+	int *ints = 0;
+	float *floats = 0;
+	bench_body *bodies = 0;
+	double t0, t_sum_fn, t_sum_loop, t_sum, t_ksum, t_min_fn, t_min_loop, t_min, t_arg_loop, t_arg,
+	       t_mass_loop, t_mass, t_dot_loop, t_dot;
+	double sum_fn = 0, sum_loop = 0, sum, ksum, mass_loop = 0, mass, dot_loop = 0, dot;
+	int min_fn = INT_MAX, min_loop = INT_MAX;
+	long long min;
+	ahd_int at;
+
+	arr_reserve(ints, n);
+	arr_reserve(floats, n);
+	arr_reserve(bodies, n);
+	bench_seed = 1;
+	for(ahd_int i = 0; i < n; ++i) {
+		unsigned int r = bench_rand();
+		bench_body b = { (float)(r & 0xff), 0, 0, (float)(r % 1000) * 0.01f };
+		arr__push(ints, (int)(r % 100000000));
+		arr__push(floats, (float)(r % 1000) * 0.01f);
+		arr__push(bodies, b);
+	}
+
+	t0 = bench_now();
+	arr_reducefn(bench_reduce_sumf, floats, &sum_fn, 0);
+	t_sum_fn = bench_now() - t0;
+	t0 = bench_now();
+	for(ahd_int i = 0; i < n; ++i) { sum_loop += floats[i]; }
+	t_sum_loop = bench_now() - t0;
+	t0 = bench_now();
+	sum = arr_sumf(floats, floats);
+	t_sum = bench_now() - t0;
+	t0 = bench_now();
+	ksum = arr_ksumf(floats, floats);
+	t_ksum = bench_now() - t0;
+
+	t0 = bench_now();
+	arr_reducefn(bench_reduce_mini, ints, &min_fn, 0);
+	t_min_fn = bench_now() - t0;
+	t0 = bench_now();
+	for(ahd_int i = 0; i < n; ++i) { min_loop = ints[i] < min_loop ? ints[i] : min_loop; }
+	t_min_loop = bench_now() - t0;
+	t0 = bench_now();
+	min = arr_mini(ints, ints);
+	t_min = bench_now() - t0;
+
+	t0 = bench_now();
+	for(ahd_int i = 1; i < n; ++i) { if(floats[i] > floats[at_loop]) { at_loop = i; } }
+	t_arg_loop = bench_now() - t0;
+	t0 = bench_now();
+	at = arr_argmaxf(floats, floats);
+	t_arg = bench_now() - t0;
+
+	t0 = bench_now();
+	for(ahd_int i = 0; i < n; ++i) { mass_loop += bodies[i].mass; }
+	t_mass_loop = bench_now() - t0;
+	t0 = bench_now();
+	mass = arr_sumf(bodies, &bodies->mass);
+	t_mass = bench_now() - t0;
+
+	t0 = bench_now();
+	for(ahd_int i = 0; i < n; ++i) { dot_loop += (double)floats[i] * bodies[i].x; }
+	t_dot_loop = bench_now() - t0;
+	t0 = bench_now();
+	dot = arr_dotf(floats, floats, bodies, &bodies->x);
+	t_dot = bench_now() - t0;
+
+	printf("\nreduce %llu elements (ms)\n", n);
+	printf("%-24s %10s %10s %10s\n", "", "reducefn", "loop", "typed");
+	printf("%-24s %10.2f %10.2f %10.2f  (kahan %.2f, sums %.6g %.6g %.6g)\n", "sum float",
+	       t_sum_fn*1e3, t_sum_loop*1e3, t_sum*1e3, t_ksum*1e3, sum_loop, sum, ksum);
+	printf("%-24s %10.2f %10.2f %10.2f%s\n", "min int", t_min_fn*1e3, t_min_loop*1e3, t_min*1e3,
+	       min == min_loop && min == min_fn ? "" : " (differ!)");
+	printf("%-24s %10s %10.2f %10.2f%s\n", "argmax float", "", t_arg_loop*1e3, t_arg*1e3, at == at_loop ? "" : " (differ!)");
+	printf("%-24s %10s %10.2f %10.2f  (%.6g %.6g)\n", "sum float member", "", t_mass_loop*1e3, t_mass*1e3, mass_loop, mass);
+	printf("%-24s %10s %10.2f %10.2f  (%.6g %.6g)\n", "dot float (1 strided)", "", t_dot_loop*1e3, t_dot*1e3, dot_loop, dot);
+	(void)sum_fn;
+	arr_free(ints);
+	arr_free(floats);
+	arr_free(bodies);
+}
+
+/******************************************************************************/
+/* Filter *********************************************************************/
+/******************************************************************************/
+/* arr_filterfn (branchless, into a presized output) against pushing the kept
+ * elements in a loop, with a random half kept (the worst case for a branch) */
+typedef struct bench_row { unsigned int key; int value; float score; int flags; } bench_row;
+static unsigned int bench_filter_mod;
+static int bench_filter_keep(ahd_loop_info *info, void *a, void *b)
+{ (void)info, (void)b; return ((bench_row *)a)->key % bench_filter_mod == 0; }
+
+static void bench_filter(void) {
+	ahd_int n = 20000000;
+	unsigned int mods[] = { 2, 20 };
+	bench_row *records = 0, *kept = 0, *kept_loop = 0;
+
+	arr_reserve(records, n);
+	bench_seed = 1;
+	for(ahd_int i = 0; i < n; ++i) {
+		bench_row r = { bench_rand(), (int)i, 0.5f, 0 };
+		arr__push(records, r);
+	}
+
+	printf("\nfilter %llu 16-byte records (ms)\n", n);
+	printf("%-10s %12s %12s\n", "kept", "push loop", "filterfn");
+	for(int i_mod = 0; i_mod < 2; ++i_mod) {
+		double t0, t_loop, t_fn;
+		ahd_int n_kept;
+		bench_filter_mod = mods[i_mod];
+		arr_free(kept_loop);
+		arr_free(kept);
+
+		t0 = bench_now();
+		for(ahd_int i = 0; i < n; ++i)
+		{ if(bench_filter_keep(0, &records[i], 0)) { arr_push(kept_loop, records[i]); } }
+		t_loop = bench_now() - t0;
+		t0 = bench_now();
+		n_kept = arr_filterfn(bench_filter_keep, records, kept, 0);
+		t_fn = bench_now() - t0;
+
+		printf("1/%-8u %12.2f %12.2f%s\n", mods[i_mod], t_loop*1e3, t_fn*1e3,
+		       n_kept == arr_len(kept_loop) ? "" : " (counts differ!)");
+	}
+	arr_free(records);
+	arr_free(kept);
+	arr_free(kept_loop);
+}
+
+/******************************************************************************/
+/* Parallel map/reduce/filter *************************************************/
+/******************************************************************************/
+/* a CPU-bound transform: a few rounds of an integer hash per element */
+static unsigned int bench_ploop_hash(unsigned int x) {
+	for(int i = 0; i < 16; ++i) { x ^= x >> 16; x *= 0x7feb352du; x ^= x >> 15; x *= 0x846ca68bu; }
+	return x;
+}
+static int bench_ploop_map(ahd_loop_info *info, void *a, void *b)
+{ (void)info; *(unsigned int *)b = bench_ploop_hash(*(unsigned int *)a); return 0; }
+static int bench_ploop_sum(ahd_loop_info *info, void *acc, void *val)
+{ (void)info; *(unsigned long long *)acc += bench_ploop_hash(*(unsigned int *)val); return 0; }
+static int bench_ploop_add(ahd_loop_info *info, void *acc, void *partial)
+{ (void)info; *(unsigned long long *)acc += *(unsigned long long *)partial; return 0; }
+static int bench_ploop_keep(ahd_loop_info *info, void *a, void *b)
+{ (void)info, (void)b; return (bench_ploop_hash(*(unsigned int *)a) & 3) == 0; }
+
+static void bench_ploop(void) {
+	ahd_int n = 10000000;
+	int n_cores = ahd_num_cores(), max_threads = ahd__max(n_cores, 4);
+	unsigned int *in = 0, *out = 0;
+	double t_single[3] = { 0 };
+
+	arr_reserve(in, n);
+	bench_seed = 1;
+	for(ahd_int i = 0; i < n; ++i) { arr__push(in, bench_rand()); }
+
+	printf("\npmapfn/preducefn/pfilterfn, %llu elements, 16 hash rounds each (%d cores)\n", n, n_cores);
+	printf("%8s %12s %12s %12s %9s %9s %9s\n", "threads", "map ms", "reduce ms", "filter ms", "map x", "reduce x", "filter x");
+	for(int n_threads = 1; n_threads <= max_threads; n_threads *= 2) {
+		double t0, t[3];
+		unsigned long long sum = 0;
+		ahd_int kept;
+		ahd_ploop_threads = n_threads;
+
+		t0 = bench_now();
+		arr_pmapfn(bench_ploop_map, in, out, 0);
+		t[0] = bench_now() - t0;
+		t0 = bench_now();
+		arr_preducefn(bench_ploop_sum, bench_ploop_add, in, &sum, 0);
+		t[1] = bench_now() - t0;
+		t0 = bench_now();
+		kept = arr_pfilterfn(bench_ploop_keep, in, out, 0);
+		t[2] = bench_now() - t0;
+		if(n_threads == 1) { t_single[0] = t[0], t_single[1] = t[1], t_single[2] = t[2]; }
+
+		printf("%8d %12.2f %12.2f %12.2f %8.2fx %8.2fx %8.2fx  (sum %llx, kept %llu)\n", n_threads,
+		       t[0]*1e3, t[1]*1e3, t[2]*1e3, t_single[0]/t[0], t_single[1]/t[1], t_single[2]/t[2], sum, kept);
+	}
+	ahd_ploop_threads = AHD_PLOOP_THREADS;
+	arr_free(in);
+	arr_free(out);
+}
+
+/******************************************************************************/
+/* Spill to file **************************************************************/
+/******************************************************************************/
+typedef struct bench_log_arr { ahd_t(arr); ahd_t(policy); } bench_log_arr;
+typedef struct bench_log { unsigned long long t; unsigned int id, value; } bench_log;
+
+static void bench_spill(void) {
+	ahd_int n = 20000000, threshold = 1 << 20;
+	char const *modes[] = { "push (no spill)", "push + hand flush", "spill", "spill (background)" };
+
+	printf("\nsustained push of %llu %d-byte records, spilling every %lluKB to a temporary file\n",
+	       n, (int)sizeof(bench_log), threshold >> 10);
+	printf("%-20s %10s %12s %10s %14s\n", "mode", "ms", "Mpushes/s", "MB/s", "peak bytes");
+	for(int mode = 0; mode < 4; ++mode) {
+		FILE *f = tmpfile();
+		ahd_spill spill = { f, threshold, mode == 3 };
+		bench_log *logs = 0;
+		ahd_int peak = 0;
+		double t0 = bench_now(), t;
+
+		if(mode >= 2) { ahd_setspill(bench_log_arr, logs, &spill); }
+		for(ahd_int i = 0; i < n; ++i) {
+			bench_log rec = { i, (unsigned int)i & 0xff, (unsigned int)i * 7 };
+			if(mode == 1 && ahd_len(bench_log_arr, logs) * sizeof(*logs) >= (ahd_int)threshold) {
+				fwrite(logs, sizeof(*logs), ahd_len(bench_log_arr, logs), f);
+				ahd_clear(bench_log_arr, logs);
+			}
+			ahd_push(bench_log_arr, logs, rec);
+		}
+		if(mode >= 2)      { ahd_setspill(bench_log_arr, logs, 0); }
+		else if(mode == 1) { fwrite(logs, sizeof(*logs), ahd_len(bench_log_arr, logs), f); }
+		fflush(f);
+		t = bench_now() - t0;
+		peak = ahd_cap(bench_log_arr, logs) * sizeof(*logs) * (mode == 3 ? 2 : 1); /* double-buffered */
+
+		printf("%-20s %10.1f %12.1f %10.1f %14llu%s\n", modes[mode], t * 1e3, n / t / 1e6,
+		       n * sizeof(bench_log) / t / 1048576.0, peak, spill.error ? " (write failed)" : "");
+		ahd_free(bench_log_arr, logs);
+		fclose(f);
+	}
+}
+
+/******************************************************************************/
+/* Thread-safe push ***********************************************************/
+/******************************************************************************/
+typedef struct bench_ts_arr { ahd_t(arr); ahd_t(ts); } bench_ts_arr;
+
+#ifdef _WIN32
+typedef CRITICAL_SECTION bench_mutex;
+# define bench_mutex_init(m)   InitializeCriticalSection(m)
+# define bench_mutex_lock(m)   EnterCriticalSection(m)
+# define bench_mutex_unlock(m) LeaveCriticalSection(m)
+# define bench_mutex_free(m)   DeleteCriticalSection(m)
+#else
+typedef pthread_mutex_t bench_mutex;
+# define bench_mutex_init(m)   pthread_mutex_init(m, 0)
+# define bench_mutex_lock(m)   pthread_mutex_lock(m)
+# define bench_mutex_unlock(m) pthread_mutex_unlock(m)
+# define bench_mutex_free(m)   pthread_mutex_destroy(m)
+#endif
+
+typedef struct bench_producers {
+	int *arr;
+	bench_mutex mutex;
+	ahd_int n_per_thread;
+} bench_producers;
+
+static void bench_push_mutex(void *data, int i_task, int n_tasks) {
+	bench_producers *p = (bench_producers *)data;
+	(void)n_tasks;
+	for(ahd_int i = 0; i < p->n_per_thread; ++i) {
+		bench_mutex_lock(&p->mutex);
+		arr_push(p->arr, i_task);
+		bench_mutex_unlock(&p->mutex);
+	}
+}
+
+static void bench_push_ts(void *data, int i_task, int n_tasks) {
+	bench_producers *p = (bench_producers *)data;
+	(void)n_tasks;
+	for(ahd_int i = 0; i < p->n_per_thread; ++i)
+	{ ahd_push_ts(bench_ts_arr, p->arr, i_task); }
+}
+
+/* N producers pushing to 1 shared array */
+static void bench_contention(void) {
+	int thread_counts[] = { 1, 2, 4, 8, 16, 32 };
+	ahd_int n = 1 << 23;
+
+	printf("\npushing %llu ints to one array from N threads (%d cores)\n", n, ahd_num_cores());
+	printf("%-8s %12s %12s\n", "threads", "mutex ms", "push_ts ms");
+	for(int i_count = 0; i_count < (int)(sizeof(thread_counts)/sizeof(*thread_counts)); ++i_count) {
+		int n_threads = thread_counts[i_count];
+		bench_producers p = {0};
+		double t0, t_mutex, t_ts;
+		p.n_per_thread = n / n_threads;
+		bench_mutex_init(&p.mutex);
+
+		t0 = bench_now();
+		ahd__parallel(bench_push_mutex, &p, n_threads);
+		t_mutex = bench_now() - t0;
+		arr_free(p.arr);
+
+		t0 = bench_now();
+		ahd__parallel(bench_push_ts, &p, n_threads);
+		t_ts = bench_now() - t0;
+		ahd_free_ts(bench_ts_arr, p.arr);
+
+		bench_mutex_free(&p.mutex);
+		printf("%-8d %12.3f %12.3f\n", n_threads, t_mutex*1e3, t_ts*1e3);
+	}
+}
+
+/******************************************************************************/
+/* Regression suite ***********************************************************/
+/******************************************************************************/
+/* `airhead_bench suite [op] [max-len]` prints one CSV line per operation, element
+ * size (1 to 256 bytes) and length (10 to 10M), for tracking regressions:
+ *     op,el_size,len,ops,ns_per_op,bytes_per_op
+ * An op is one call for push/add/insert/remove/pop/printf, and one element for
+ * the operations over the whole array. The string sorts run on pointers to
+ * strings (sortstr) and 16-byte buffers (sortchr), so their el_size is 8 or 16. bytes_per_op is what was asked of the
+ * allocator. Short arrays are run in batches of copies, and each case is
+ * repeated for at least BENCH_SUITE_MIN_SECONDS, so the clock's overhead stays
+ * out of the numbers. Cases over BENCH_SUITE_MAX_BYTES are skipped; `op`
+ * picks the ops whose names start with it. */
+#ifndef  BENCH_SUITE_MIN_SECONDS
+# define BENCH_SUITE_MIN_SECONDS 0.02
+#endif
+#ifndef  BENCH_SUITE_MAX_BYTES
+# define BENCH_SUITE_MAX_BYTES (128 * 1024 * 1024)
+#endif
+#define BENCH_SUITE_BATCH_ELS 4096 /* arrays shorter than this are copied to make a batch this long */
+
+/* key first; floats alias it (kept finite by the fill) for the float sorts.
+ * A 1-byte key is signed: ahd_is_signed can't tell unsigned char from int */
+typedef union bench_keyed1   { signed char        key; } bench_keyed1;
+typedef union bench_keyed4   { unsigned int       key; float  f; } bench_keyed4;
+typedef union bench_keyed8   { unsigned long long key; double f; } bench_keyed8;
+typedef union bench_keyed16  { unsigned int       key; float  f; unsigned char bytes[16];  } bench_keyed16;
+typedef union bench_keyed64  { unsigned int       key; float  f; unsigned char bytes[64];  } bench_keyed64;
+typedef union bench_keyed256 { unsigned int       key; float  f; unsigned char bytes[256]; } bench_keyed256;
+typedef struct bench_strptr  { char const *str; } bench_strptr;
+typedef struct bench_strbuf  { char str[16]; } bench_strbuf;
+
+typedef enum bench_setup { SETUP_NONE, SETUP_FREE, SETUP_COPY } bench_setup;
+
+typedef struct bench_suite {
+	char const *filter;
+	ahd_int max_len;
+	ahd_int len, batch;  /* batch: the number of work arrays */
+} bench_suite;
+
+static int bench_suite_wants(bench_suite const *suite, char const *op)
+{ return ! suite->filter || strncmp(op, suite->filter, strlen(suite->filter)) == 0; }
+
+static void bench_suite_report(char const *op, ahd_int el_size, ahd_int len, ahd_int ops, double t, unsigned long long bytes)
+{ printf("%s,%llu,%llu,%llu,%.3f,%.3f\n", op, el_size, len, ops, t * 1e9 / (double)ops, (double)bytes / (double)ops); fflush(stdout); }
+
+/* Runs `body` on each work array w (prepared as `setup` says, untimed) until
+ * enough time has passed; n_ops is the number of ops in one body. */
+#define BENCH_SUITE_CASE(name, setup, n_ops, body) do { \
+		if(bench_suite_wants(suite, name)) { \
+			ahd_int reps = 0, n_ops_ = (n_ops); \
+			unsigned long long bytes = 0; \
+			double t = 0; \
+			do { \
+				double t0; \
+				unsigned long long bytes0; \
+				for(ahd_int j = 0; j < suite->batch; ++j) { \
+					switch(setup) { \
+						case SETUP_FREE: arr_free(work[j]); break; \
+						case SETUP_COPY: arr_resetlen(work[j], n); memcpy(work[j], src, n * sizeof(T)); break; \
+						default: break; \
+					} \
+				} \
+				bytes0 = bench_alloc_bytes; \
+				t0 = bench_now(); \
+				for(ahd_int j = 0; j < suite->batch; ++j) { T *&w = work[j]; (void)w; body; } \
+				t += bench_now() - t0; \
+				bytes += bench_alloc_bytes - bytes0; \
+				++reps; \
+			} while(t < BENCH_SUITE_MIN_SECONDS); \
+			bench_suite_report(name, sizeof(T), n, reps * suite->batch * n_ops_, t, bytes); \
+		} \
+	} while(0)
+
+static volatile unsigned long long bench_suite_sink;
+
+template<typename T> static int bench_suite_inc(ahd_loop_info *info, void *a, void *b)
+{ (void)info; ((T *)b)->key = (((T *)a)->key + 1) & 0x7f; return 0; }
+template<typename T> static int bench_suite_sum(ahd_loop_info *info, void *acc, void *val)
+{ (void)info; *(unsigned long long *)acc += ((T *)val)->key; return 0; }
+template<typename T> static int bench_suite_even(ahd_loop_info *info, void *a, void *b)
+{ (void)info, (void)b; return ! (((T *)a)->key & 1); }
+static int bench_suite_add(ahd_loop_info *info, void *acc, void *partial)
+{ (void)info; *(unsigned long long *)acc += *(unsigned long long *)partial; return 0; }
+
+/* a bit never set in a key: keeps the aliased floats finite, and gives find a value to look for */
+#define bench_suite_absent(key) (sizeof(key) == 8 ? 1ull << 62 : sizeof(key) == 1 ? 1ull << 6 : 1ull << 30)
+
+template<typename T> static T *bench_suite_src(ahd_int n) {
+	T *src = 0;
+	unsigned long long mask = ~bench_suite_absent(src->key);
+	arr_resetlen(src, n);
+	memset(src, 0, n * sizeof(T));
+	bench_seed = 1;
+	for(ahd_int i = 0; i < n; ++i) {
+		unsigned long long r = (unsigned long long)bench_rand() << 32 | bench_rand();
+		src[i].key = (decltype(src[i].key))(r & mask);
+	}
+	return src;
+}
+
+template<typename T> static void bench_suite_ops(bench_suite const *suite, T *src, T **work) {
+	typedef decltype(src->key) K;
+	ahd_int n = suite->len, k = ahd__min(n, (ahd_int)100), sum_n = 0;
+	unsigned long long sum = 0;
+
+	BENCH_SUITE_CASE("push",    SETUP_FREE, n, for(ahd_int i = 0; i < n; ++i) { arr_push(w, src[i]); });
+	BENCH_SUITE_CASE("add",     SETUP_FREE, n, for(ahd_int i = 0; i < n; ++i) { arr_add(w, 1); });
+	BENCH_SUITE_CASE("insert",  SETUP_COPY, k, for(ahd_int i = 0; i < k; ++i) { ahd_int at = arr_len(w) / 2; (void)arr_insert(w, at, src[i]); });
+	BENCH_SUITE_CASE("remove",  SETUP_COPY, k, for(ahd_int i = 0; i < k; ++i) { ahd_int at = arr_len(w) / 2; arr_remove(w, at, 1); });
+	BENCH_SUITE_CASE("pop",     SETUP_COPY, n, for(ahd_int i = 0; i < n; ++i) { sum += arr_pop(w).key; });
+	BENCH_SUITE_CASE("concat",  SETUP_FREE, n, arr_concat(w, src));
+	BENCH_SUITE_CASE("pusharr", SETUP_FREE, n, arr_pusharr(w, src, n));
+	BENCH_SUITE_CASE("dup",     SETUP_NONE, n, T *d = (T *)arr_dup(src); arr_free(d));
+	BENCH_SUITE_CASE("sub",     SETUP_NONE, ahd__max(n / 2, (ahd_int)1), T *d = (T *)arr_sub(src, n / 4, ahd__max(n / 2, (ahd_int)1)); arr_free(d));
+	BENCH_SUITE_CASE("reverse", SETUP_COPY, n, arr_reverse(w));
+	BENCH_SUITE_CASE("rotr",    SETUP_COPY, n, arr_rotr(w, n / 3));
+
+	BENCH_SUITE_CASE("sorti",        SETUP_COPY, n, arr_sorti(w, &w->key, ahd_ASC));
+	BENCH_SUITE_CASE("sortu",        SETUP_COPY, n, arr_sortu(w, &w->key, ahd_ASC));
+	BENCH_SUITE_CASE("sortint",      SETUP_COPY, n, arr_sortint(w, &w->key, ahd_ASC));
+	BENCH_SUITE_CASE("radixi",       SETUP_COPY, n, arr_radixi(w, &w->key, ahd_ASC));
+	BENCH_SUITE_CASE("radixu",       SETUP_COPY, n, arr_radixu(w, &w->key, ahd_ASC));
+	BENCH_SUITE_CASE("radixint",     SETUP_COPY, n, arr_radixint(w, &w->key, ahd_ASC));
+	BENCH_SUITE_CASE("stablesorti",  SETUP_COPY, n, arr_stablesorti(w, &w->key, ahd_ASC));
+	BENCH_SUITE_CASE("stablesortu",  SETUP_COPY, n, arr_stablesortu(w, &w->key, ahd_ASC));
+	BENCH_SUITE_CASE("stablesortint",SETUP_COPY, n, arr_stablesortint(w, &w->key, ahd_ASC));
+	BENCH_SUITE_CASE("psorti",       SETUP_COPY, n, arr_psorti(w, &w->key, ahd_ASC));
+	BENCH_SUITE_CASE("psortu",       SETUP_COPY, n, arr_psortu(w, &w->key, ahd_ASC));
+	BENCH_SUITE_CASE("psortint",     SETUP_COPY, n, arr_psortint(w, &w->key, ahd_ASC));
+	BENCH_SUITE_CASE("sortidxu",     SETUP_NONE, n, ahd_int *perm = arr_sortidxu(src, &src->key, ahd_ASC); arr_free(perm));
+
+	/* read-only cases scan the per-batch copies so the loop can't be hoisted out on an invariant src */
+	BENCH_SUITE_CASE("countx",    SETUP_COPY, n, arr_countx(w, i, sum_n, w[i].key == 3) {});
+	BENCH_SUITE_CASE("countrangeu", SETUP_COPY, n, sum_n += arr_countrangeu(w, 1, 100));
+	if(sizeof(T) == sizeof(K)) { /* the element is just its key, so can be scanned as a number */
+		BENCH_SUITE_CASE("findeqint", SETUP_COPY, n, sum_n += arr_findeqint((K *)w, (K)bench_suite_absent(K)));
+	}
+	BENCH_SUITE_CASE("mapfn",     SETUP_NONE, n, arr_mapfn(bench_suite_inc<T>, src, w, 0));
+	BENCH_SUITE_CASE("pmapfn",    SETUP_NONE, n, arr_pmapfn(bench_suite_inc<T>, src, w, 0));
+	BENCH_SUITE_CASE("reducefn",  SETUP_COPY, n, arr_reducefn(bench_suite_sum<T>, w, &sum, 0));
+	BENCH_SUITE_CASE("preducefn", SETUP_COPY, n, arr_preducefn(bench_suite_sum<T>, bench_suite_add, w, &sum, 0));
+	BENCH_SUITE_CASE("sumu",      SETUP_COPY, n, sum += arr_sumu(w, &w->key));
+	BENCH_SUITE_CASE("filterfn",  SETUP_NONE, n, sum_n += arr_filterfn(bench_suite_even<T>, src, w, 0));
+	BENCH_SUITE_CASE("pfilterfn", SETUP_NONE, n, sum_n += arr_pfilterfn(bench_suite_even<T>, src, w, 0));
+	bench_suite_sink += sum + sum_n; /* keeps the results (and the work) alive */
+}
+
+/* for the types with a float member */
+template<typename T> static void bench_suite_fops(bench_suite const *suite, T *src, T **work) {
+	ahd_int n = suite->len;
+	BENCH_SUITE_CASE("sortf",       SETUP_COPY, n, arr_sortf(w, &w->f, ahd_ASC));
+	BENCH_SUITE_CASE("radixf",      SETUP_COPY, n, arr_radixf(w, &w->f, ahd_ASC));
+	BENCH_SUITE_CASE("stablesortf", SETUP_COPY, n, arr_stablesortf(w, &w->f, ahd_ASC));
+	BENCH_SUITE_CASE("psortf",      SETUP_COPY, n, arr_psortf(w, &w->f, ahd_ASC));
+	BENCH_SUITE_CASE("sortidxf",    SETUP_NONE, n, ahd_int *perm = arr_sortidxf(src, &src->f, ahd_ASC); arr_free(perm));
+}
+
+template<typename T> static void bench_suite_floats(bench_suite const *suite, T *src, T **work)
+{ bench_suite_fops(suite, src, work); }
+static void bench_suite_floats(bench_suite const *suite, bench_keyed1 *src, bench_keyed1 **work)
+{ (void)suite, (void)src, (void)work; } /* no float in a byte */
+
+/* the string builder: one number per call */
+static void bench_suite_printf(bench_suite const *suite, char *src, char **work) {
+	typedef char T;
+	ahd_int n = suite->len;
+	(void)src;
+	BENCH_SUITE_CASE("printf", SETUP_FREE, n, for(ahd_int i = 0; i < n; ++i) { arr_printf(&w, "%d,", (int)i); });
+}
+
+/* the string sorts, on random hex strings of up to 15 digits */
+static void bench_suite_sortstr(bench_suite const *suite, bench_strptr *src, bench_strptr **work) {
+	typedef bench_strptr T;
+	ahd_int n = suite->len;
+	BENCH_SUITE_CASE("sortstr", SETUP_COPY, n, arr_sortstr(w, &w->str, ahd_ASC));
+}
+
+static void bench_suite_sortchr(bench_suite const *suite, bench_strbuf *src, bench_strbuf **work) {
+	typedef bench_strbuf T;
+	ahd_int n = suite->len;
+	BENCH_SUITE_CASE("sortchr", SETUP_COPY, n, arr_sortchr(w, &w->str, ahd_ASC));
+}
+
+static void bench_suite_strings(bench_suite *suite) {
+	for(suite->len = 10; suite->len <= suite->max_len; suite->len *= 10) {
+		bench_strbuf *bufs = 0, **buf_work;
+		bench_strptr *ptrs = 0, **ptr_work;
+		if(suite->len * sizeof(*bufs) > BENCH_SUITE_MAX_BYTES) { break; }
+		suite->batch = ahd__max((ahd_int)1, BENCH_SUITE_BATCH_ELS / suite->len);
+		arr_resetlen(bufs, suite->len);
+		arr_resetlen(ptrs, suite->len);
+		bench_seed = 1;
+		for(ahd_int i = 0; i < suite->len; ++i) {
+			unsigned long long r = (unsigned long long)bench_rand() << 32 | bench_rand();
+			sprintf(bufs[i].str, "%llx", r >> 4);
+			ptrs[i].str = bufs[i].str;
+		}
+		buf_work = (bench_strbuf **)calloc(suite->batch, sizeof(*buf_work));
+		ptr_work = (bench_strptr **)calloc(suite->batch, sizeof(*ptr_work));
+		bench_suite_sortstr(suite, ptrs, ptr_work);
+		bench_suite_sortchr(suite, bufs, buf_work);
+		for(ahd_int j = 0; j < suite->batch; ++j) { arr_free(buf_work[j]); arr_free(ptr_work[j]); }
+		free(buf_work);
+		free(ptr_work);
+		arr_free(bufs);
+		arr_free(ptrs);
+	}
+}
+
+template<typename T> static void bench_suite_size(bench_suite *suite) {
+	for(suite->len = 10; suite->len <= suite->max_len; suite->len *= 10) {
+		T *src, **work;
+		if(suite->len * sizeof(T) > BENCH_SUITE_MAX_BYTES) { break; }
+		suite->batch = ahd__max((ahd_int)1, BENCH_SUITE_BATCH_ELS / suite->len);
+		src  = bench_suite_src<T>(suite->len);
+		work = (T **)calloc(suite->batch, sizeof(*work));
+		bench_suite_ops(suite, src, work);
+		bench_suite_floats(suite, src, work);
+		for(ahd_int j = 0; j < suite->batch; ++j) { arr_free(work[j]); }
+		free(work);
+		arr_free(src);
+	}
+}
+
+static void bench_suite_run(char const *filter, ahd_int max_len) {
+	bench_suite suite;
+	suite.filter  = filter;
+	suite.max_len = max_len;
+	suite.len     = suite.batch = 0;
+	printf("op,el_size,len,ops,ns_per_op,bytes_per_op\n");
+	bench_suite_size<bench_keyed1>  (&suite);
+	bench_suite_size<bench_keyed4>  (&suite);
+	bench_suite_size<bench_keyed8>  (&suite);
+	bench_suite_size<bench_keyed16> (&suite);
+	bench_suite_size<bench_keyed64> (&suite);
+	bench_suite_size<bench_keyed256>(&suite);
+	bench_suite_strings(&suite);
+
+	for(suite.len = 10; suite.len <= max_len; suite.len *= 10) {
+		char **work;
+		suite.batch = ahd__max((ahd_int)1, BENCH_SUITE_BATCH_ELS / suite.len);
+		work = (char **)calloc(suite.batch, sizeof(*work));
+		bench_suite_printf(&suite, 0, work);
+		for(ahd_int j = 0; j < suite.batch; ++j) { arr_free(work[j]); }
+		free(work);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	if(argc > 1 && strcmp(argv[1], "suite") == 0) {
+		bench_suite_run(argc > 2 && *argv[2] ? argv[2] : 0, argc > 3 ? (ahd_int)strtoull(argv[3], 0, 10) : 10000000);
+		return 0;
+	}
+
+	bench_sort();
+	bench_sort_large();
+	bench_sort_str();
+	bench_psort();
+	bench_growth();
+	bench_reserve();
+	bench_arena();
+	bench_aligned();
+	bench_slice();
+	bench_unique();
+	bench_map();
+	bench_scan();
+	bench_reduce();
+	bench_filter();
+	bench_ploop();
+	bench_spill();
+	bench_contention();
+	return 0;
+}
@@ -1,8 +1,9 @@
 #define _CRT_SECURE_NO_WARNINGS
+#define AHD_MMAP
 #include "airhead.h"
 #include "airhead.h"
 #include <stdio.h>
-#define SWEET_NUM_TESTS 512
+#define SWEET_NUM_TESTS 1024
 #include "../sweet/sweet.h"
 
 typedef struct test_t {
@@ -25,6 +26,38 @@ test_t *InitVals() {
 	return Result;
 }
 
+int SquareInt(ahd_loop_info *info, void *a, void *b) {
+	(void)info;
+	*(long long *)b = (long long)*(int *)a * *(int *)a;
+	return 0;
+}
+int SumInt(ahd_loop_info *info, void *acc, void *val) {
+	(void)info;
+	*(long long *)acc += *(int *)val;
+	return 0;
+}
+int AddSums(ahd_loop_info *info, void *acc, void *partial) {
+	*(long long *)acc += *(long long *)partial;
+	return info->chunk == (int)info->i ? 0 : (*(long long *)acc = -1); /* chunk order */
+}
+int IsOdd(ahd_loop_info *info, void *a, void *b) {
+	(void)info, (void)b;
+	return *(int *)a & 1;
+}
+int IsPositive(ahd_loop_info *info, void *a, void *b) {
+	(void)info, (void)b;
+	return ((test_t *)a)->Int > 0;
+}
+typedef struct big_t { int Int; char Bytes[100]; } big_t;
+int IsBigOdd(ahd_loop_info *info, void *a, void *b) {
+	(void)info, (void)b;
+	return ((big_t *)a)->Int & 1;
+}
+int IsUpper(ahd_loop_info *info, void *a, void *b) {
+	(void)info, (void)b;
+	return *(char *)a >= 'A' && *(char *)a <= 'Z';
+}
+
 int main()
 {
 	ahd_int i = 0;
@@ -106,6 +139,575 @@ int main()
 			TestVEq(arr__cap(arr), 8, "%d");
 		}
 
+		TestGroup("Growth policy") {
+			typedef struct policy_arr { ahd_t(arr); ahd_t(policy); } policy_arr;
+			static ahd_growth const growth = { 3, 2, 256, 0 }, paged = { 2, 1, 0, 4096 };
+			int *nums = 0;
+
+			ahd_setgrowth(policy_arr, nums, &growth);
+			TestVEq(ahd_cap(policy_arr, nums), 64, "%d");
+			for(i = 0; i < 65; ++i) { ahd_push(policy_arr, nums, (int)i); }
+			TestVEq(ahd_cap(policy_arr, nums), 96, "%d");
+			TestVEq(ahd_len(policy_arr, nums), 65, "%d");
+			TestVEq(nums[64], 64, "%d");
+
+			ahd_setgrowth(policy_arr, nums, &paged);
+			for(; i < 3000; ++i) { ahd_push(policy_arr, nums, (int)i); }
+			TestVEq(ahd_totalcapsize(policy_arr, nums) % 4096, 0, "%d");
+			Test(ahd_cap(policy_arr, nums) >= 3000);
+			ahd_free(policy_arr, nums);
+
+			ahd_growth old_default = ahd_growth_default;
+			ahd_growth_default.min_bytes = 1024;
+			arr_push(nums, 1);
+			TestVEq(arr_cap(nums), 256, "%d");
+			arr_free(nums);
+			ahd_growth_default = old_default;
+		}
+
+#if AHD_DEBUG
+		TestGroup("Callsite profiling") {
+			struct sites { static ahd_callsite *at(int line) {
+			                   for(int k = 0; k < AHD_DEBUG_SITES; ++k)
+			                   { if(ahd_debug_sites[k].line == line) { return &ahd_debug_sites[k]; } }
+			                   return 0;
+			               } };
+			int *nums = 0, *copy, push_line, dup_line;
+			ahd_callsite *pushes, *dups;
+
+			push_line = __LINE__; for(i = 0; i < 1000; ++i) { arr_push(nums, (int)i); }
+			dup_line  = __LINE__; copy = (int *)arr_dup(nums);
+			pushes = sites::at(push_line), dups = sites::at(dup_line);
+			Test(pushes && dups);
+			Test(pushes->allocs > 1);
+			Test(pushes->bytes_alloc >= 1000 * sizeof(int));
+			Test(pushes->peak_cap >= 1000 * sizeof(int));
+			Test(pushes->bytes_moved <= pushes->bytes_alloc);
+			TestVEq(pushes->live, 1, "%d");
+			TestVEq(dups->allocs, 1, "%d");
+			TestVEq(dups->live, 1, "%d");
+
+			arr_free(nums);
+			TestVEq(pushes->live, 0, "%d");
+			TestVEq(pushes->peak_live, 1, "%d");
+			arr_free(copy);
+			TestVEq(dups->live, 0, "%d");
+
+			ahd_debug_reset();
+			TestVEq(pushes->allocs, 0, "%d");
+		}
+#endif//AHD_DEBUG
+
+		TestGroup("Arena") {
+			typedef struct policy_arr { ahd_t(arr); ahd_t(policy); } policy_arr;
+			ahd_arena arena = {0};
+			int *a = 0, *b = 0, *heap = 0, *first;
+			int same = 1;
+
+			ahd_setarena(policy_arr, a, &arena);
+			Test(a != 0);
+			TestVEq(ahd_len(policy_arr, a), 0, "%d");
+			first = a;
+			for(i = 0; i < 1000; ++i) { ahd_push(policy_arr, a, (int)i); }
+			Test(a == first); /* grew in place */
+
+			ahd_setarena(policy_arr, b, &arena);
+			for(i = 0; i < 1000; ++i) {
+				ahd_push(policy_arr, b, (int)i * 2);
+				ahd_push(policy_arr, heap, (int)i * 3);
+			}
+			for(i = 1000; i < 2000; ++i) { ahd_push(policy_arr, a, (int)i); } /* no longer last: moves */
+			Test(a != first);
+			for(i = 0; i < 1000; ++i) { same &= a[i] == (int)i && b[i] == (int)i * 2 && heap[i] == (int)i * 3; }
+			Test(same);
+			TestVEq(a[1999], 1999, "%d");
+
+			int *c = (int *)ahd_dup(policy_arr, b);
+			Test(ahd_hdr(policy_arr, c)->policy.alloc == &arena.alloc);
+			TestVEq(c[999], 1998, "%d");
+
+			int *d = 0, *c_was = c;
+			ahd_free(policy_arr, c); /* last allocation: space is reused */
+			ahd_setarena(policy_arr, d, &arena);
+			Test(d == c_was);
+
+			ahd_setarena(policy_arr, b, 0); /* back to the heap */
+			Test(ahd_hdr(policy_arr, b)->policy.alloc == 0);
+			TestVEq(b[999], 1998, "%d");
+			ahd_push(policy_arr, b, 5);
+			ahd_free(policy_arr, b);
+			ahd_free(policy_arr, heap);
+
+			ahd_arena_reset(&arena);
+			a = d = 0;
+			ahd_setarena(policy_arr, a, &arena);
+			Test(arena.block->next == 0);
+			Test((char *)ahd_hdr(policy_arr, a) == (char *)(arena.block + 1));
+			ahd_arena_free(&arena);
+			Test(arena.block == 0);
+		}
+
+		TestGroup("Allocator") {
+			typedef struct policy_arr { ahd_t(arr); ahd_t(policy); } policy_arr;
+			struct counting { static void *realloc(void *data, void *ptr, ahd_int old_size, ahd_int size)
+			                  { (void)old_size; ++((int *)data)[0]; return ::realloc(ptr, size); }
+			                  static void free(void *data, void *ptr) { ++((int *)data)[1]; ::free(ptr); } };
+			int counts[2] = {0};
+			ahd_allocator const alloc = { counting::realloc, counting::free, counts };
+			int *a = 0, *b, *c;
+
+			ahd_setalloc(policy_arr, a, &alloc);
+			for(i = 0; i < 100; ++i) { ahd_push(policy_arr, a, (int)i); }
+			TestVEq(counts[0], 5, "%d"); /* create, 16, 32, 64, 128 */
+			b = (int *)ahd_dup(policy_arr, a);
+			c = (int *)ahd_sub(policy_arr, a, 10, 20);
+			TestVEq(counts[0], 8, "%d"); /* dup; sub: create, 20 */
+			Test(ahd_hdr(policy_arr, c)->policy.alloc == &alloc);
+			TestVEq(c[0], 10, "%d");
+			TestVEq(ahd_len(policy_arr, c), 20, "%d");
+			ahd_free(policy_arr, a);
+			ahd_free(policy_arr, b);
+			ahd_free(policy_arr, c);
+			TestVEq(counts[1], 3, "%d");
+		}
+
+		TestGroup("File-backed") {
+			typedef struct file_arr { ahd_t(arr); ahd_t(policy); } file_arr;
+			typedef struct simd_file { AHD_ALIGNAS(64) ahd_t(arr); ahd_t(policy); } simd_file;
+			char const *path = "airhead_test_map.bin";
+			ahd_mapfile mf;
+			int *nums, same = 1;
+			ahd_int cap;
+
+			remove(path);
+			Test(ahd_mapopen(file_arr, nums, &mf, path));
+			TestVEq(ahd_len(file_arr, nums), 0, "%d");
+			for(i = 0; i < 100000; ++i) { ahd_push(file_arr, nums, (int)i * 3); }
+			cap = ahd_cap(file_arr, nums);
+			Test(ahd_mapsync(&mf));
+			ahd_mapclose(file_arr, nums, &mf);
+			Test(nums == 0);
+
+			Test(ahd_mapopen(file_arr, nums, &mf, path)); /* everything is still there */
+			TestVEq(ahd_len(file_arr, nums), 100000, "%d");
+			TestVEq(ahd_cap(file_arr, nums), cap, "%d");
+			for(i = 0; i < 100000; ++i) { same &= nums[i] == (int)i * 3; }
+			Test(same);
+			Test(ahd_hdr(file_arr, nums)->policy.alloc == &mf.alloc);
+			ahd_shrink(file_arr, nums);
+			ahd_push(file_arr, nums, 7);
+			TestVEq(nums[100000], 7, "%d");
+			TestVEq(nums[99999], 299997, "%d");
+
+			int *copy = (int *)ahd_dup(file_arr, nums), *part = (int *)ahd_sub(file_arr, nums, 99990, 11);
+			Test(ahd_hdr(file_arr, copy)->policy.alloc == 0); /* copies go on the heap */
+			TestVEq(ahd_len(file_arr, copy), 100001, "%d");
+			Test(memcmp(copy, nums, 100001 * sizeof(*nums)) == 0);
+			Test(ahd_hdr(file_arr, part)->policy.alloc == 0);
+			TestVEq(part[0], 299970, "%d");
+			TestVEq(part[10], 7, "%d");
+			ahd_push(file_arr, copy, 8);
+			TestVEq(ahd_len(file_arr, nums), 100001, "file untouched: %d");
+			ahd_free(file_arr, copy);
+			ahd_free(file_arr, part);
+			ahd_free(file_arr, nums); /* closes the file, as ahd_mapclose does */
+			Test(nums == 0);
+
+			Test(ahd_mapopen(file_arr, nums, &mf, path));
+			TestVEq(ahd_len(file_arr, nums), 100001, "%d");
+			ahd_clear(file_arr, nums);
+			ahd_shrink(file_arr, nums); /* empties the file */
+			ahd_mapclose(file_arr, nums, &mf);
+
+			Test(ahd_mapopen(file_arr, nums, &mf, path));
+			TestVEq(ahd_len(file_arr, nums), 0, "%d");
+			TestVEq(ahd_cap(file_arr, nums), 0, "%d");
+			ahd_mapclose(file_arr, nums, &mf);
+
+			float *xs;
+			remove(path);
+			Test(ahd_mapopen(simd_file, xs, &mf, path));
+			for(i = 0; i < 1000; ++i) { ahd_push(simd_file, xs, (float)i); }
+			ahd_mapclose(simd_file, xs, &mf);
+			Test(! ahd_mapopen(file_arr, nums, &mf, path)); /* wrong header type */
+			Test(ahd_mapopen(simd_file, xs, &mf, path));
+			TestVEq((uintptr_t)xs % 64, 0, "%d");
+			TestVEq(xs[999], 999.f, "%f");
+			ahd_mapclose(simd_file, xs, &mf);
+			remove(path);
+		}
+
+		TestGroup("Small buffer") {
+			typedef struct node { struct node **children; arr_inline(struct node *, 4) children_buf; } node;
+			typedef struct simd_arr { AHD_ALIGNAS(64) ahd_t(arr); } simd_arr;
+			node parent, kids[6];
+			arr_inline(int, 8) buf;
+			ahd_inline(simd_arr, float, 4) simd_buf;
+			int *nums, *copy;
+			float *xs;
+
+			arr_inlineinit(nums, &buf);
+			TestVEq(arr_len(nums), 0, "%d");
+			TestVEq(arr_cap(nums), 8, "%d");
+			for(i = 0; i < 8; ++i) { arr_push(nums, (int)i); }
+			Test(nums == buf.ahd_inline_els); /* still inline */
+			copy = (int *)arr_dup(nums);
+			Test(! (ahd_hdr(ahd_arr, copy)->cap & ahd__flag(ahd_INLINE)));
+			arr_free(copy);
+			arr_push(nums, 8);
+			Test(nums != buf.ahd_inline_els); /* moved to the heap */
+			Test(! (ahd_hdr(ahd_arr, nums)->cap & ahd__flag(ahd_INLINE)));
+			TestVEq(arr_len(nums), 9, "%d");
+			TestVEq(nums[0] + nums[7] + nums[8], 15, "%d");
+			arr_free(nums);
+
+			arr_inlineinit(nums, &buf);
+			arr_push(nums, 1);
+			arr_free(nums); /* nothing to free */
+			Test(nums == 0);
+
+			arr_inlineinit(parent.children, &parent.children_buf);
+			for(i = 0; i < 6; ++i) { arr_push(parent.children, &kids[i]); }
+			TestVEq(arr_len(parent.children), 6, "%d");
+			Test(parent.children[5] == &kids[5]);
+			arr_free(parent.children);
+
+			ahd_inlineinit(simd_arr, xs, &simd_buf);
+			for(i = 0; i < 5; ++i) { ahd_push(simd_arr, xs, (float)i); }
+			TestVEq((uintptr_t)xs % 64, 0, "%d");
+			TestVEq(xs[4], 4.f, "%f");
+			ahd_free(simd_arr, xs);
+
+			ahd_inlineinit(simd_arr, xs, &simd_buf);
+			ahd_push(simd_arr, xs, 1.f);
+			float *xs_copy = (float *)ahd_dup(simd_arr, xs);
+			TestVEq(ahd__alignof(ahd__arr(simd_arr, xs_copy)->cap), 64, "copy stays aligned: %d");
+			ahd_free(simd_arr, xs_copy);
+
+			typedef struct policy_arr { ahd_t(arr); ahd_t(policy); } policy_arr;
+			static ahd_growth const growth = { 3, 2, 0, 0 };
+			ahd_inline(policy_arr, int, 4) policy_buf;
+			ahd_inlineinit(policy_arr, nums, &policy_buf);
+			ahd_setgrowth(policy_arr, nums, &growth);
+			for(i = 0; i < 5; ++i) { ahd_push(policy_arr, nums, (int)i); }
+			Test(nums != policy_buf.ahd_inline_els);
+			Test(ahd__arr(policy_arr, nums)->cap & ahd__flag(ahd_POLICY)); /* the policy moves with it */
+			Test(ahd_hdr(policy_arr, nums)->policy.growth == &growth);
+			TestVEq(ahd_cap(policy_arr, nums), 6, "%d");
+			for(; i < 7; ++i) { ahd_push(policy_arr, nums, (int)i); }
+			TestVEq(ahd_cap(policy_arr, nums), 9, "and keeps growing by it: %d");
+			TestVEq(nums[6], 6, "%d");
+			ahd_free(policy_arr, nums);
+		}
+
+		TestGroup("Spill to file") {
+			typedef struct log_arr { ahd_t(arr); ahd_t(policy); } log_arr;
+			for(int background = 0; background < 2; ++background) {
+				FILE *f = tmpfile();
+				ahd_spill spill = { f, 1000, background };
+				int *logs = 0, most = 0, same = 1, *back = 0;
+
+				ahd_setspill(log_arr, logs, &spill);
+				TestVEq(ahd_cap(log_arr, logs), 250, "%d");
+				for(i = 0; i < 100000; ++i) {
+					ahd_push(log_arr, logs, (int)i);
+					most = ahd__max(most, (int)ahd_len(log_arr, logs));
+				}
+				TestVEq(most, 250, "%d");
+				TestVEq(ahd_cap(log_arr, logs), 250, "%d");
+				ahd_add(log_arr, logs, 300); /* more than fits: grows instead */
+				for(i = 0; i < 300; ++i) { logs[ahd_len(log_arr, logs) - 300 + i] = 100000 + (int)i; }
+				Test(ahd_flush(log_arr, logs));
+				TestVEq(ahd_len(log_arr, logs), 0, "%d");
+				ahd_push(log_arr, logs, -1);
+				ahd_setspill(log_arr, logs, 0); /* flushes */
+				TestVEq(spill.written, 100301 * sizeof(int), "%d");
+				Test(! spill.error);
+				ahd_push(log_arr, logs, 5); /* back to growing */
+				TestVEq(ahd_len(log_arr, logs), 1, "%d");
+
+				rewind(f);
+				arr_add(back, 100301);
+				Test(fread(back, sizeof(int), 100301, f) == 100301);
+				for(i = 0; i < 100300; ++i) { same &= back[i] == (int)i; }
+				Test(same);
+				TestVEq(back[100300], -1, "%d");
+				arr_free(back);
+				ahd_free(log_arr, logs);
+				fclose(f);
+			}
+
+			/* only appends spill: inserting and reserving grow the array as usual */
+			FILE *f = tmpfile();
+			ahd_spill spill = { f, 4 * sizeof(int) };
+			int *logs = 0, *back = 0, same = 1;
+			ahd_int cap;
+			Test(ahd_setspill(log_arr, logs, &spill));
+			for(i = 0; i < 4; ++i) { ahd_push(log_arr, logs, (int)i); }
+			ahd_insert(log_arr, logs, 1, 100); /* full, but keeps its place */
+			TestVEq(ahd_len(log_arr, logs), 5, "%d");
+			TestVEq(logs[1], 100, "%d");
+			TestVEq(logs[4], 3, "%d");
+			ahd_reserve(log_arr, logs, 40);
+			cap = ahd_cap(log_arr, logs);
+			Test(cap >= 40);
+			TestVEq(spill.written, 0, "%d");
+			for(i = 5; i <= cap; ++i) { ahd_push(log_arr, logs, (int)i); } /* the last finds it full */
+			TestVEq(spill.written, cap * sizeof(int), "%d");
+			TestVEq(ahd_len(log_arr, logs), 1, "%d");
+			ahd_setspill(log_arr, logs, 0);
+
+			rewind(f);
+			arr_add(back, cap + 1);
+			Test(fread(back, sizeof(int), cap + 1, f) == cap + 1);
+			TestVEq(back[1], 100, "%d");
+			TestVEq(back[4], 3, "%d");
+			for(i = 5; i <= cap; ++i) { same &= back[i] == (int)i; }
+			Test(same);
+			arr_free(back);
+			ahd_free(log_arr, logs);
+			fclose(f);
+		}
+
+		TestGroup("Save/Load") {
+			typedef struct wide_arr { ahd_t(arr); ahd_t(rc); int extra; } wide_arr;
+			FILE *f = tmpfile();
+			int *nums = 0, *back = 0, **rows = 0, **rows_back = 0, same = 1;
+			char bad[sizeof(ahd_blob)] = "not an array";
+
+			for(i = 0; i < 1000; ++i) { arr_push(nums, (int)i * 7); }
+			for(i = 0; i < 5; ++i) {
+				int *row = 0;
+				for(int k = 0; k < (int)i * 3; ++k) { arr_push(row, (int)(i * 100) + k); }
+				arr_push(rows, row);
+			}
+			Test(arr_save(nums, f));
+			Test(arr_save(back, f)); /* empty */
+			Test(arr_save2d(rows, f));
+			Test(ahd_save2dt(ahd_arr, wide_arr, (int **)0, f));
+			fwrite(bad, sizeof(bad), 1, f);
+
+			rewind(f);
+			arr_push(back, -1);
+			Test(arr_load(back, f)); /* appends */
+			TestVEq(arr_len(back), 1001, "%d");
+			TestVEq(back[0], -1, "%d");
+			for(i = 0; i < 1000; ++i) { same &= back[i + 1] == (int)i * 7; }
+			Test(same);
+			Test(arr_load(back, f));
+			TestVEq(arr_len(back), 1001, "%d");
+
+			Test(arr_load2d(rows_back, f));
+			TestVEq(arr_len(rows_back), 5, "%d");
+			for(i = 0; i < 5; ++i) {
+				same &= arr_len(rows_back[i]) == i * 3;
+				for(int k = 0; k < (int)i * 3; ++k) { same &= rows_back[i][k] == rows[i][k]; }
+				same &= (uintptr_t)rows_back[i] % 16 == 0;
+			}
+			Test(same);
+			Test(ahd_hdr(ahd_arr, rows_back[4])->cap & ahd__flag(ahd_PACKED));
+			for(i = 0; i < 100; ++i) { arr_push(rows_back[2], (int)i); } /* copied out of the block */
+			Test(! (ahd_hdr(ahd_arr, rows_back[2])->cap & ahd__flag(ahd_PACKED)));
+			TestVEq(rows_back[2][5], 205, "%d");
+			TestVEq(rows_back[2][105], 99, "%d");
+			int *copy = (int *)arr_dup(rows_back[3]);
+			Test(! (ahd_hdr(ahd_arr, copy)->cap & ahd__flag(ahd_PACKED)));
+			arr_free(copy);
+			arr_free2d(rows_back);
+
+			Test(ahd_load2dt(ahd_arr, wide_arr, rows_back, f));
+			TestVEq(arr_len(rows_back), 0, "%d");
+			Test(! arr_load(nums, f)); /* not a blob */
+			Test(! arr_load(nums, f)); /* end of file */
+			TestVEq(arr_len(nums), 1000, "%d");
+
+			rewind(f);
+			Test(! arr_load2d(rows_back, f)); /* a flat array */
+			short *shorts = 0;
+			rewind(f);
+			Test(! arr_load(shorts, f)); /* element size differs */
+
+			arr_free(rows_back);
+			arr_free2d(rows);
+			arr_free(back);
+			arr_free(nums);
+			fclose(f);
+
+			typedef struct simd_arr { AHD_ALIGNAS(64) ahd_t(arr); } simd_arr;
+			float **simd_rows = 0, **simd_back = 0, *simd_copy;
+			f = tmpfile();
+			for(i = 0; i < 3; ++i) {
+				float *row = 0;
+				for(int k = 0; k < 10; ++k) { ahd_push(simd_arr, row, (float)k); }
+				arr_push(simd_rows, row);
+			}
+			Test(ahd_save2dt(ahd_arr, simd_arr, simd_rows, f));
+			rewind(f);
+			Test(ahd_load2dt(ahd_arr, simd_arr, simd_back, f));
+			TestVEq((uintptr_t)simd_back[1] % 64, 0, "%d");
+			simd_copy = (float *)ahd_dup(simd_arr, simd_back[1]); /* keeps the alignment */
+			TestVEq((uintptr_t)simd_copy % 64, 0, "%d");
+			TestVEq(ahd__alignof(ahd__arr(simd_arr, simd_copy)->cap), 64, "as will its reallocs: %d");
+			TestVEq(simd_copy[9], 9.f, "%f");
+			ahd_free(simd_arr, simd_copy);
+			ahd_free2dt(ahd_arr, simd_arr, simd_back);
+			ahd_free2dt(ahd_arr, simd_arr, simd_rows);
+			fclose(f);
+
+			typedef struct policy_arr { ahd_t(arr); ahd_t(policy); } policy_arr;
+			static ahd_growth const growth = { 3, 2, 0, 0 };
+			int **policy_rows = 0, **policy_back = 0;
+			f = tmpfile();
+			for(i = 0; i < 3; ++i) {
+				int *row = 0;
+				for(int k = 0; k < 4; ++k) { ahd_push(policy_arr, row, k); }
+				arr_push(policy_rows, row);
+			}
+			Test(ahd_save2dt(ahd_arr, policy_arr, policy_rows, f));
+			rewind(f);
+			Test(ahd_load2dt(ahd_arr, policy_arr, policy_back, f));
+			ahd_setgrowth(policy_arr, policy_back[1], &growth);
+			ahd_push(policy_arr, policy_back[1], 4); /* copied out of the block */
+			Test(! (ahd__arr(policy_arr, policy_back[1])->cap & ahd__flag(ahd_PACKED)));
+			Test(ahd__arr(policy_arr, policy_back[1])->cap & ahd__flag(ahd_POLICY));
+			Test(ahd_hdr(policy_arr, policy_back[1])->policy.growth == &growth);
+			TestVEq(ahd_cap(policy_arr, policy_back[1]), 6, "%d");
+			TestVEq(policy_back[1][4], 4, "%d");
+			ahd_free2dt(ahd_arr, policy_arr, policy_back);
+			ahd_free2dt(ahd_arr, policy_arr, policy_rows);
+			fclose(f);
+		}
+
+		TestGroup("Aligned") {
+			typedef struct simd_arr { AHD_ALIGNAS(64) ahd_t(arr); ahd_t(policy); } simd_arr;
+			float *xs = 0, *ys, *zs;
+			ahd_arena arena = {0};
+			int aligned = 1, same = 1;
+
+			for(i = 0; i < 5000; ++i) {
+				ahd_push(simd_arr, xs, (float)i);
+				aligned &= ((uintptr_t)xs & 63) == 0;
+			}
+			Test(aligned);
+			ys = (float *)ahd_dup(simd_arr, xs);
+			zs = (float *)ahd_sub(simd_arr, xs, 3, 100);
+			Test(((uintptr_t)ys & 63) == 0);
+			Test(((uintptr_t)zs & 63) == 0);
+			TestVEq(zs[0], 3.f, "%f");
+
+			ahd_changecap(simd_arr, xs, 7000);
+			Test(((uintptr_t)xs & 63) == 0);
+			ahd_shrink(simd_arr, xs);
+			Test(((uintptr_t)xs & 63) == 0);
+			ahd_setarena(simd_arr, ys, &arena);
+			Test(((uintptr_t)ys & 63) == 0);
+			ahd_push(simd_arr, ys, 1.f);
+			Test(((uintptr_t)ys & 63) == 0);
+			for(i = 0; i < 5000; ++i) { same &= xs[i] == (float)i && ys[i] == (float)i; }
+			Test(same);
+
+			ahd_free(simd_arr, xs);
+			ahd_free(simd_arr, ys);
+			ahd_free(simd_arr, zs);
+			ahd_arena_free(&arena);
+		}
+
+		TestGroup("Capacity") {
+			int *nums = 0;
+			arr_reserve(nums, 10);
+			TestVEq(arr_cap(nums), 10, "%d");
+			TestVEq(arr_len(nums), 0, "%d");
+
+			arr_reserve(nums, 5);
+			TestVEq(arr_cap(nums), 10, "%d");
+
+			for(i = 0; i < 10; ++i) { TestVEq(arr__push(nums, (int)i), i, "%d"); }
+			TestVEq(arr_cap(nums), 10, "%d");
+
+			arr_expand(nums, 3);
+			TestVEq(arr_cap(nums), 13, "%d");
+			TestVEq(arr_len(nums), 10, "%d");
+
+			arr_push(nums, 10);
+			arr_changecap(nums, 100);
+			TestVEq(arr_cap(nums), 100, "%d");
+			TestVEq(nums[10], 10, "%d");
+
+			arr_shrink(nums);
+			TestVEq(arr_cap(nums), 11, "%d");
+			TestVEq(arr_len(nums), 11, "%d");
+
+			arr_changecap(nums, 4);
+			TestVEq(arr_cap(nums), 4, "%d");
+			TestVEq(arr_len(nums), 4, "%d");
+			TestVEq(nums[3], 3, "%d");
+
+			arr_free(nums);
+			arr_shrink(nums);
+			Test(nums == 0);
+		}
+
+		TestGroup("Thread-safe") {
+			typedef struct ts_arr { ahd_t(arr); ahd_t(ts); } ts_arr;
+			struct pushers { static void push(void *data, int i_task, int n_tasks) {
+			                     (void)n_tasks;
+			                     for(int k = 0; k < 10000; ++k) { ahd_push_ts(ts_arr, *(int **)data, i_task * 10000 + k); }
+			                 } };
+			int *nums = 0, popped = 0, n_popped = 0, all_once = 1;
+			char *seen = (char *)calloc(40000, 1);
+
+			ahd__parallel(pushers::push, &nums, 4);
+			TestVEq(ahd_len(ts_arr, nums), 40000, "%d");
+			for(i = 0; i < 40000; ++i) { seen[nums[i]] += 1; }
+			for(i = 0; i < 40000; ++i) { all_once &= seen[i] == 1; }
+			Test(all_once);
+
+			while(ahd_pop_ts(ts_arr, nums, &popped)) { ++n_popped; }
+			TestVEq(n_popped, 40000, "%d");
+			TestVEq(popped, nums[0], "%d");
+			ahd_free_ts(ts_arr, nums);
+			Test(nums == 0);
+			free(seen);
+		}
+
+		TestGroup("Refcount") {
+			typedef struct rc_arr { ahd_t(arr); ahd_t(rc); } rc_arr;
+			static int freed = 0;
+			struct holders { static void retain_release(void *data, int i_task, int n_tasks) {
+			                     (void)i_task, (void)n_tasks;
+			                     for(int k = 0; k < 1000; ++k) { int *held = ahd_retain(rc_arr, *(int **)data); ahd_release(rc_arr, held); }
+			                 }
+			                 static void free(void *arr) { ++freed; int *a = (int *)arr; ahd_free(rc_arr, a); } };
+			int *a = 0, *b, *c;
+			for(i = 0; i < 10; ++i) { ahd_push(rc_arr, a, (int)i); }
+			TestVEq(ahd_refs(rc_arr, a), 1, "%d");
+
+			b = ahd_retain(rc_arr, a);
+			Test(b == a);
+			TestVEq(ahd_refs(rc_arr, a), 2, "%d");
+			ahd__parallel(holders::retain_release, &a, 4);
+			TestVEq(ahd_refs(rc_arr, a), 2, "%d");
+
+			ahd_cow(rc_arr, b); /* shared: b gets its own copy */
+			Test(b != a);
+			TestVEq(ahd_refs(rc_arr, a), 1, "%d");
+			TestVEq(ahd_refs(rc_arr, b), 1, "%d");
+			b[0] = 100;
+			TestVEq(a[0], 0, "%d");
+			c = b;
+			ahd_cow(rc_arr, b); /* not shared: no copy */
+			Test(b == c);
+			ahd_release(rc_arr, b);
+			Test(b == 0);
+
+			ahd_hdr(rc_arr, a)->rc.free = holders::free;
+			c = ahd_retain(rc_arr, a);
+			ahd_release(rc_arr, a);
+			TestVEq(freed, 0, "%d");
+			ahd_release(rc_arr, c);
+			TestVEq(freed, 1, "%d");
+		}
+
 		TestGroup("Insert/Remove") arr_scoped(test_t, arr) {
 			arr_pusharray(arr, vals);
 
@@ -221,6 +823,163 @@ int main()
 			TestVEq(arr[1].Float,    vals[2].Float, "%f");
 			TestStrEq(arr[1].String, vals[2].String);
 		}
+
+		TestGroup("Slice") arr_scoped_init(test_t, arr, (test_t*)arr_dup(base_arr)) {
+			ahd_slice s = arr_slice(arr, 1, 3), clamped = arr_slice(arr, 2, 100);
+			ahd_int i_neg;
+			int sum = 0, neg;
+			TestVEq(s.len, 3, "%d");
+			TestVEq(clamped.len, 2, "%d");
+			Test(ahd_slicep(test_t, s) == &arr[1]);
+
+			for ahd_slice_each_v(s, i_el, test_t, el) { sum += el.Int; }
+			TestVEq(sum, vals[1].Int + vals[2].Int + vals[3].Int, "%d");
+			ahd_slice_find(s, i_neg, test_t, el, neg) { neg = el.Int < 0; }
+			Test(neg);
+			TestVEq(i_neg, 1, "%d");
+			Test(ahd_slice_eq(ahd_slice_sub(s, 1, 2), clamped));
+
+			ahd_slice_sorti(s, &ahd_slicep(test_t, s)->Int, ahd_DESC);
+			TestVEq(arr[0].Int, vals[0].Int, "%d"); /* outside the slice: untouched */
+			TestVEq(arr[1].Int, 0xFF, "%d");
+			TestVEq(arr[3].Int, -12,  "%d");
+
+			arr_scoped_init(test_t, copy, (test_t*)arr_slicedup(s)) {
+				TestVEq(arr_len(copy), 3, "%d");
+				copy[0].Int = 7;
+				TestVEq(arr[1].Int, 0xFF, "%d");
+			}
+		}
+
+#define TEST_SET(result, ...) do { \
+		int expected[] = { __VA_ARGS__ }, *r = (int *)(result); \
+		TestVEq(arr_len(r), sizeof(expected)/sizeof(*expected), "%d"); \
+		Test(arr_len(r) == sizeof(expected)/sizeof(*expected) && ! memcmp(r, expected, sizeof(expected))); \
+		arr_free(r); \
+	} while(0)
+		TestGroup("Set operations") {
+			int a_vals[] = { 5, 3, 5, 1, 3, 3, 9 }, b_vals[] = { 3, 7, 9, 7, 2 };
+			int *a = 0, *b = 0, *empty = 0;
+			arr_pusharray(a, a_vals);
+			arr_pusharray(b, b_vals);
+
+			TestGroup("Hashed") {
+				TEST_SET(arr_unique(a),          5, 3, 1, 9);
+				TEST_SET(arr_uniqueadj(a),       5, 3, 5, 1, 3, 9);
+				TEST_SET(arr_union(a, b),        5, 3, 1, 9, 7, 2);
+				TEST_SET(arr_intersection(a, b), 3, 9);
+				TEST_SET(arr_difference(a, b),   5, 1);
+				TEST_SET(arr_symdiff(a, b),      5, 1, 7, 2);
+				Test(arr_intersection(a, empty) == 0);
+				TEST_SET(arr_union(empty, b),    3, 7, 9, 2);
+			}
+
+			arr_sortint(a, a, ahd_ASC);
+			arr_sortint(b, b, ahd_ASC);
+			TestGroup("Sorted (merged)") {
+				TEST_SET(arr_unique(a),          1, 3, 5, 9);
+				TEST_SET(arr_union(a, b),        1, 2, 3, 5, 7, 9);
+				TEST_SET(arr_intersection(a, b), 3, 9);
+				TEST_SET(arr_difference(a, b),   1, 5);
+				TEST_SET(arr_symdiff(a, b),      1, 2, 5, 7);
+			}
+
+			TestGroup("By member") arr_scoped(test_t, objs) {
+				test_t objs_vals[] = { { 1, 1.f, "a" }, { 2, 2.f, "b" }, { 1, 3.f, "c" }, { 3, 4.f, "d" }, { 2, 5.f, "e" } };
+				arr_pusharray(objs, objs_vals);
+				test_t *distinct = (test_t *)arr_uniqueby(objs, &objs->Int);
+				TestVEq(arr_len(distinct), 3, "%d");
+				TestStrEq(distinct[0].String, "a");
+				TestStrEq(distinct[1].String, "b");
+				TestStrEq(distinct[2].String, "d");
+				arr_free(distinct);
+			}
+
+			TestGroup("Large") {
+				int *big = 0, *u;
+				for(i = 0; i < 100000; ++i) { arr_push(big, (int)((i * 7919) % 30011)); }
+				u = (int *)arr_unique(big);
+				TestVEq(arr_len(u), 30011, "%d");
+				arr_free(u);
+				arr_free(big);
+			}
+			arr_free(a);
+			arr_free(b);
+		}
+	}
+
+	TestGroup("Hash maps") {
+		typedef struct map_arr { ahd_t(arr); ahd_t(map); } map_arr;
+		typedef struct int_kv { int key; float value; } int_kv;
+		typedef struct str_kv { char const *key; int value; } str_kv;
+
+		TestGroup("Put/Get/Del") {
+			int_kv *m = 0, *entry;
+			int all_found = 1;
+			TestVEq(ahd_map_geti(map_arr, m, 3), 0, "%d");
+			Test(ahd_map_get(map_arr, m, 3) == 0);
+
+			for(i = 0; i < 1000; ++i) { ahd_map_put(map_arr, m, (int)(i * 37), (float)i); }
+			TestVEq(ahd_len(map_arr, m), 1000, "%d");
+			ahd_map_put(map_arr, m, 37, -1.f); /* replaces */
+			TestVEq(ahd_len(map_arr, m), 1000, "%d");
+			entry = (int_kv *)ahd_map_get(map_arr, m, 37);
+			Test(entry && entry->value == -1.f);
+			Test(ahd_map_get(map_arr, m, 38) == 0);
+			TestVEq(ahd_map_geti(map_arr, m, 38), ahd_len(map_arr, m), "%d");
+
+			for(i = 0; i < 1000; i += 2) { ahd_map_del(map_arr, m, (int)(i * 37)); }
+			TestVEq(ahd_len(map_arr, m), 500, "%d");
+			Test(! ahd_map_del(map_arr, m, 0));
+			for(i = 0; i < 1000; ++i) {
+				int key = (int)(i * 37);
+				ahd_int at = ahd_map_getp(map_arr, m, &key);
+				all_found &= (i % 2) ? at < ahd_len(map_arr, m) && m[at].key == key : at == ahd_len(map_arr, m);
+			}
+			Test(all_found);
+
+			++ahd_map_at(map_arr, m, 5)->value; /* new entries are zeroed */
+			TestVEq(((int_kv *)ahd_map_get(map_arr, m, 5))->value, 1.f, "%f");
+
+			ahd_map_clear(map_arr, m);
+			TestVEq(ahd_len(map_arr, m), 0, "%d");
+			Test(ahd_map_get(map_arr, m, 37) == 0);
+			ahd_map_free(map_arr, m);
+			Test(m == 0);
+		}
+
+		TestGroup("String keys (by address)") {
+			char const *the = "the", *words[] = { the, "cat", "sat", "on", the, "mat", the };
+			str_kv *counts = 0;
+			for(i = 0; i < sizeof(words)/sizeof(*words); ++i)
+			{ ++ahd_map_at(map_arr, counts, words[i])->value; }
+			TestVEq(ahd_len(map_arr, counts), 5, "%d");
+			TestVEq(((str_kv *)ahd_map_get(map_arr, counts, words[0]))->value, 3, "%d");
+			ahd_map_free(map_arr, counts);
+		}
+
+		TestGroup("Dup/Refcount") {
+			typedef struct rc_map { ahd_t(arr); ahd_t(rc); ahd_t(map); } rc_map;
+			int_kv *a = 0, *b, *c;
+			for(i = 0; i < 100; ++i) { ahd_map_put(rc_map, a, (int)i, (float)i); }
+
+			c = (int_kv *)ahd_map_dup(rc_map, a);
+			Test(ahd_hdr(rc_map, c)->map.slots != ahd_hdr(rc_map, a)->map.slots);
+			ahd_map_del(rc_map, c, 10);
+			Test(ahd_map_get(rc_map, c, 10) == 0);
+			Test(ahd_map_get(rc_map, a, 10) != 0);
+			ahd_map_free(rc_map, c);
+
+			b = ahd_retain(rc_map, a);
+			ahd_map_cow(rc_map, b);
+			Test(b != a);
+			ahd_map_put(rc_map, b, 1000, 1.f);
+			Test(ahd_map_get(rc_map, b, 1000) != 0);
+			Test(ahd_map_get(rc_map, a, 1000) == 0);
+			ahd_map_release(rc_map, a);
+			ahd_map_release(rc_map, b);
+			Test(a == 0 && b == 0);
+		}
 	}
 
 #define TEST_VALX(arr, vals, x) do { \
@@ -259,6 +1018,15 @@ int main()
 				arr_rotr(arr, 2);
 				TEST_VALS(arr, rot2_vals);
 			}
+
+			TestGroup("rot larger than stack buffer") {
+				int *arr = 0, i, n = 1000, rot = 300, ok = 1;
+				for (i = 0; i < n; ++i) { arr_push(arr, i); }
+				arr_rotr(arr, rot);
+				for (i = 0; i < n; ++i) { ok &= arr[i] == (i + n - rot) % n; }
+				TestEq(ok, 1);
+				arr_free(arr);
+			}
 		}
 
 		TestGroup("Sort")    arr_scoped_init(test_t, arr, InitVals()) {
@@ -311,6 +1079,227 @@ int main()
 			TestGroup("Sort by (unsigned) Int ascending") TEST_VALS(arr, sort_uint_vals);
 		}
 
+		TestGroup("Sort (large)") arr_scoped(test_t, arr) {
+			unsigned int seed = 12345;
+			long long sum = 0, sorted_sum = 0;
+			int in_order = 1;
+			for(i = 0; i < 5000; ++i) {
+				test_t val = { 0 };
+				seed = seed * 1103515245u + 12345u;
+				val.Int   = (int)(seed >> 8) % 1000 - 500; /* plenty of duplicates */
+				val.Float = (float)val.Int * 0.5f;
+				sum += val.Int;
+				arr_push(arr, val);
+			}
+
+			arr_sorti(arr, &arr->Int, ahd_ASC);
+			for(i = 1; i < arr_len(arr); ++i)
+			{ in_order &= arr[i-1].Int <= arr[i].Int; }
+			for(i = 0; i < arr_len(arr); ++i)
+			{ sorted_sum += arr[i].Int; }
+			Test(in_order);
+			TestVEq(sorted_sum, sum, "%lld");
+
+			arr_sortf(arr, &arr->Float, ahd_DESC);
+			for(i = 1; i < arr_len(arr); ++i)
+			{ in_order &= arr[i-1].Float >= arr[i].Float; }
+			Test(in_order);
+
+			TestNote("Already sorted");
+			arr_sortf(arr, &arr->Float, ahd_DESC);
+			for(i = 1; i < arr_len(arr); ++i)
+			{ in_order &= arr[i-1].Float >= arr[i].Float; }
+			Test(in_order);
+		}
+
+		TestGroup("Radix sort") arr_scoped(test_t, arr) {
+			unsigned int seed = 54321;
+			int in_order = 1, stable = 1;
+			for(i = 0; i < 3000; ++i) {
+				test_t val = { 0 };
+				seed = seed * 1103515245u + 12345u;
+				val.Int   = (int)(seed >> 4) - (1 << 26);
+				val.Float = (float)((int)(seed >> 20) % 64 - 32) * 0.25f;
+				arr_push(arr, val);
+			}
+
+			arr_radixi(arr, &arr->Int, ahd_ASC);
+			for(i = 1; i < arr_len(arr); ++i)
+			{ in_order &= arr[i-1].Int <= arr[i].Int; }
+			Test("signed" && in_order);
+
+			arr_radixu(arr, &arr->Int, ahd_DESC);
+			for(i = 1; i < arr_len(arr); ++i)
+			{ in_order &= (unsigned)arr[i-1].Int >= (unsigned)arr[i].Int; }
+			Test("unsigned descending" && in_order);
+
+			arr_radixint(arr, &arr->Int, ahd_ASC);
+			arr_radixf(arr, &arr->Float, ahd_ASC);
+			for(i = 1; i < arr_len(arr); ++i) {
+				in_order &= arr[i-1].Float <= arr[i].Float;
+				stable   &= arr[i-1].Float <  arr[i].Float || arr[i-1].Int <= arr[i].Int;
+			}
+			Test("float" && in_order);
+			Test(stable);
+
+			TestNote("Automatic from sortf");
+			arr_sortf(arr, &arr->Float, ahd_DESC);
+			for(i = 1; i < arr_len(arr); ++i)
+			{ in_order &= arr[i-1].Float >= arr[i].Float; }
+			Test(in_order);
+		}
+
+		TestGroup("Index sort/permute") arr_scoped_init(test_t, arr, InitVals()) {
+			ahd_int *perm = arr_sortidxi(arr, &arr->Int, ahd_ASC);
+			TestVEq(arr_len(perm), arr_len(arr), "%d");
+			TestVEq(perm[0], 2, "%d");
+			TestVEq(perm[1], 1, "%d");
+			TestVEq(perm[2], 0, "stable: %d");
+			TestVEq(perm[3], 3, "stable: %d");
+			TEST_VALS(arr, vals); /* untouched */
+
+			arr_permute(arr, perm);
+			TestVEq(arr[0].Int, -12, "%d");
+			TestVEq(arr[1].Int, 0x00, "%d");
+			TestVEq(arr[3].Int, 0xFF, "%d");
+			TestVEq(perm[2], 0, "perm unchanged: %d");
+			arr_free(perm);
+
+			arr_stablesortf(arr, &arr->Float, ahd_DESC);
+			TestVEq(arr[0].Float, 482.f, "%f");
+			TestVEq(arr[1].Float, 74.f, "%f");
+			TestVEq(arr[2].Float, -0.2f, "%f");
+		}
+
+		TestGroup("String sort") arr_scoped_init(test_t, arr, InitVals()) {
+			test_t sort_str_vals[] = {
+				{ 0xFF,  -0.2f, "I, Andrew" },
+				{ 0xFF,  -0.2f, "I, Andrew" },
+				{ 0x00, 482.f,  "am the creator" },
+				{ -12,   74.f,  "of this library" },
+			};
+			arr_sortstr(arr, &arr->String, ahd_ASC);
+			TEST_VALS(arr, sort_str_vals);
+
+			arr_sortstr(arr, &arr->String, ahd_DESC);
+			TestStrEq(arr[0].String, "of this library");
+			TestStrEq(arr[3].String, "I, Andrew");
+		}
+
+		TestGroup("String sort (large)") {
+			typedef struct named_t { char *Name; int Order; char Tag[12]; } named_t;
+			static char names[3000][24];
+			arr_scoped(named_t, arr) {
+				unsigned int seed = 7;
+				int in_order = 1, stable = 1;
+				for(i = 0; i < 3000; ++i) {
+					named_t val = { names[i], (int)i };
+					seed = seed * 1103515245u + 12345u;
+					/* long shared prefixes, varying lengths and duplicates */
+					sprintf(names[i], "common_prefix_%u", (seed >> 16) % 700);
+					sprintf(val.Tag, "%.11u", (seed >> 8) % 97 * 1001);
+					arr_push(arr, val);
+				}
+				arr[5].Name = 0; /* sorts as "" */
+
+				arr_sortstr(arr, &arr->Name, ahd_ASC);
+				Test(arr[0].Name == 0);
+				for(i = 2; i < arr_len(arr); ++i) {
+					int cmp = strcmp(arr[i-1].Name, arr[i].Name);
+					in_order &= cmp <= 0;
+					stable   &= cmp < 0 || arr[i-1].Order < arr[i].Order;
+				}
+				Test(in_order);
+				Test(stable);
+				arr[0].Name = (char *)"";
+
+				arr_sortchr(arr, &arr->Tag, ahd_DESC);
+				for(i = 1; i < arr_len(arr); ++i) {
+					int cmp = strcmp(arr[i-1].Tag, arr[i].Tag);
+					in_order &= cmp >= 0;
+					stable   &= cmp > 0 || strcmp(arr[i-1].Name, arr[i].Name) <= 0;
+				}
+				Test(in_order);
+				Test("sortchr stable (previously sorted by name)" && stable);
+			}
+		}
+
+		TestGroup("String sort (long shared prefix, reversed)") {
+			static char names[2000][160];
+			arr_scoped(char *, arr) {
+				int in_order = 1;
+				for(i = 0; i < 2000; ++i) {
+					memset(names[i], 'x', 140);
+					sprintf(names[i] + 140, "%.6u", (unsigned)(2000 - i) / 3);
+					arr_push(arr, names[i]);
+				}
+
+				arr_sortstr(arr, arr, ahd_ASC);
+				for(i = 1; i < arr_len(arr); ++i)
+				{ in_order &= strcmp(arr[i-1], arr[i]) <= 0; }
+				Test(in_order);
+				TestStrEq(arr[0] + 140, "000000");
+			}
+		}
+
+		TestGroup("Stable sort (large elements)") {
+			typedef struct big_t { int Key; int Order; char Payload[248]; } big_t;
+			arr_scoped(big_t, arr) {
+				unsigned int seed = 99;
+				int in_order = 1, stable = 1, payload_ok = 1;
+				for(i = 0; i < 4000; ++i) {
+					ahd_int i_new = arr_add(arr, 1);
+					big_t *val = &arr[i_new];
+					seed = seed * 1103515245u + 12345u;
+					val->Key   = (int)(seed >> 16) % 50;
+					val->Order = (int)i;
+					memset(val->Payload, (char)val->Key, sizeof(val->Payload));
+				}
+
+				arr_sorti(arr, &arr->Key, ahd_ASC);
+				for(i = 1; i < arr_len(arr); ++i) {
+					in_order &= arr[i-1].Key <= arr[i].Key;
+					stable   &= arr[i-1].Key <  arr[i].Key || arr[i-1].Order < arr[i].Order;
+				}
+				for(i = 0; i < arr_len(arr); ++i)
+				{ payload_ok &= arr[i].Payload[100] == (char)arr[i].Key; }
+				Test(in_order);
+				Test(stable);
+				Test(payload_ok);
+			}
+		}
+
+		TestGroup("Parallel sort") {
+			int thread_counts[] = { 1, 2, 3, 8 };
+			arr_scoped(test_t, arr) arr_scoped(test_t, expected) {
+				for(int i_count = 0; i_count < 4; ++i_count) {
+					unsigned int seed = 7;
+					int same = 1;
+					arr_clear(arr);
+					for(i = 0; i < AHD_PSORT_MIN * 2 + 13; ++i) {
+						ahd_int i_new = arr_add(arr, 1);
+						seed = seed * 1103515245u + 12345u;
+						arr[i_new].Int   = (int)(seed >> 8) % 100000 - 50000;
+						arr[i_new].Float = (float)arr[i_new].Int * 0.5f;
+					}
+					arr_free(expected);
+					expected = (test_t *)arr_dup(arr);
+
+					ahd_psort_threads = thread_counts[i_count];
+					arr_psorti(arr, &arr->Int, ahd_DESC);
+					arr_sorti(expected, &expected->Int, ahd_DESC);
+					for(i = 0; i < arr_len(arr); ++i) { same &= arr[i].Int == expected[i].Int; }
+					Test(same);
+
+					arr_psortf(arr, &arr->Float, ahd_ASC);
+					arr_sortf(expected, &expected->Float, ahd_ASC);
+					for(i = 0; i < arr_len(arr); ++i) { same &= arr[i].Float == expected[i].Float; }
+					Test(same);
+				}
+				ahd_psort_threads = AHD_PSORT_THREADS;
+			}
+		}
+
 		TestGroup("Reverse") {
 			TestGroup("4") arr_scoped_init(test_t, arr, InitVals()) {
 				test_t reversed_vals[] = {
@@ -341,6 +1330,226 @@ int main()
 		}
 	}
 
+	TestGroup("Array processing") {
+		TestGroup("Find/count by value") {
+			int *ints = 0;
+			float *floats = 0;
+			unsigned char *bytes = 0;
+			long long *longs = 0;
+			unsigned long long *big = 0;
+			ahd_int n_equal = 0, n_range = 0;
+			TestVEq(arr_findeqi(ints, 3), 0, "%d");
+			TestVEq(arr_countrangef(floats, 0, 1), 0, "%d");
+			for(i = 0; i < 1003; ++i) { /* not a whole number of vectors */
+				arr_push(ints,   (int)(i % 100) - 50);
+				arr_push(floats, (float)i * 0.5f);
+				arr_push(bytes,  (unsigned char)i);
+				arr_push(longs,  (long long)i - 500);
+				arr_push(big,    (unsigned long long)i << 60);
+			}
+			for(i = 0; i < 1003; ++i) { n_equal += ints[i] == -50; n_range += ints[i] >= -10 && ints[i] <= 10; }
+
+			TestVEq(arr_findeqi(ints, 7), 57, "%d");
+			TestVEq(arr_findeqi(ints, 50), arr_len(ints), "%d");
+			TestVEq(arr_findgti(ints, 48), 99, "%d");
+			TestVEq(arr_counteqi(ints, -50), n_equal, "%d");
+			TestVEq(arr_countrangei(ints, -10, 10), n_range, "%d");
+
+			TestVEq(arr_findeqf(floats, 7.5f), 15, "%d");
+			TestVEq(arr_findgtf(floats, 400.f), 801, "%d");
+			TestVEq(arr_countrangef(floats, 10, 20), 21, "%d");
+
+			TestVEq(arr_findgtu(bytes, 250), 251, "%d"); /* unsigned: above 127 */
+			TestVEq(arr_countequ(bytes, 3), 4, "%d");
+			TestVEq(arr_countrangeu(bytes, 100, 200), 404, "%d");
+
+			TestVEq(arr_findeqint(longs, 502), 1002, "%d"); /* in the tail */
+			TestVEq(arr_findgtint(longs, 400), 901, "%d");
+			TestVEq(arr_countrangeint(longs, -10, 10), 21, "%d");
+			TestVEq(arr_findgtu(big, 1ull << 63), 9, "%d");
+			TestVEq(arr_countrangeu(big, 1ull << 62, 3ull << 62), 565, "%d");
+
+			arr_free(ints);
+			arr_free(floats);
+			arr_free(bytes);
+			arr_free(longs);
+			arr_free(big);
+		}
+
+		TestGroup("Reductions") {
+			struct item { char tag; double w; int n; } *items = 0;
+			int *ints = 0;
+			float *floats = 0;
+			unsigned char *bytes = 0;
+			unsigned *words = 0;
+			double *doubles = 0;
+			long long sum = 0, dot = 0;
+			double fsum = 0, fdot = 0, wdot = 0;
+			unsigned sum_bytes = 0, max_word = 0;
+			ahd_int at_min = 0, at_max = 0;
+			TestVEq(arr_sumi(ints, ints), 0, "%d");
+			TestVEq(arr_argmaxf(floats, floats), 0, "%d");
+			for(i = 0; i < 1003; ++i) { /* not a whole number of vectors */
+				struct item it = { 0 };
+				it.tag = 'x';
+				it.w   = (double)((i * 389) % 1003) * 0.25;
+				it.n   = (int)(i % 17) - 8;
+				arr_push(items,  it);
+				arr_push(ints,   (int)((i * 7919) % 1003) - 400);
+				arr_push(floats, (float)i * 0.5f);
+				arr_push(bytes,  (unsigned char)i);
+				arr_push(words,  (unsigned)i * 4000037u); /* wraps past 2^31 and 2^32 */
+			}
+			for(i = 0; i < 1003; ++i) {
+				sum  += ints[i];
+				dot  += (long long)ints[i] * items[i].n;
+				fsum += floats[i];
+				fdot += (double)floats[i] * floats[i];
+				wdot += items[i].w * items[i].w;
+				sum_bytes += bytes[i];
+				max_word = words[i] > max_word ? words[i] : max_word;
+				if(ints[i] < ints[at_min]) { at_min = i; }
+				if(items[i].w > items[at_max].w) { at_max = i; }
+			}
+
+			TestVEq(arr_sumi(ints, ints), sum, "%lld");
+			TestVEq(arr_mini(ints, ints), -400, "%lld");
+			TestVEq(arr_maxi(ints, ints), 602, "%lld");
+			TestVEq(arr_argmini(ints, ints), at_min, "%d");
+			TestVEq(arr_sumu(bytes, bytes), sum_bytes, "%llu");
+			TestVEq(arr_maxu(bytes, bytes), 255, "%llu");
+			TestVEq(arr_argmaxu(bytes, bytes), 255, "%d");
+			TestVEq(arr_maxu(words, words), max_word, "%llu");
+			TestVEq(arr_minu(words, words), 0, "%llu");
+			TestVEq(arr_sumf(floats, floats), fsum, "%f");
+			TestVEq(arr_minf(floats, floats), 0, "%f");
+			TestVEq(arr_argmaxf(floats, floats), 1002, "%d");
+
+			/* members of a struct */
+			TestVEq(arr_sumint(items, &items->n), 0, "%lld");
+			TestVEq(arr_minint(items, &items->n), -8, "%lld");
+			TestVEq(arr_argmaxint(items, &items->n), 16, "%d");
+			TestVEq(arr_maxf(items, &items->w), 1002 * 0.25, "%f");
+			TestVEq(arr_argmaxf(items, &items->w), at_max, "%d");
+			TestVEq(arr_dotint(ints, ints, items, &items->n), dot, "%lld");
+			TestVEq(arr_dotf(floats, floats, floats, floats), fdot, "%f");
+			TestVEq(arr_dotf(items, &items->w, items, &items->w), wdot, "%f");
+
+			/* compensated sums keep what plain ones lose to rounding */
+			arr_push(doubles, 1e16);
+			for(i = 0; i < 1001; ++i) { arr_push(doubles, 1.0); }
+			TestVEq(arr_ksumf(doubles, doubles), 1e16 + 1001, "%f");
+			arr_clear(doubles);
+
+			arr_push(doubles, NAN);
+			arr_push(doubles, 3.0);
+			arr_push(doubles, NAN);
+			arr_push(doubles, -2.0);
+			arr_push(doubles, 5.0);
+			TestVEq(arr_minf(doubles, doubles), -2.0, "%f");
+			TestVEq(arr_argminf(doubles, doubles), 3, "%d");
+			TestVEq(arr_maxf(doubles, doubles), 5.0, "%f");
+			doubles[1] = doubles[3] = doubles[4] = NAN;
+			fsum = arr_minf(doubles, doubles);
+			Test(fsum != fsum); /* all NaN */
+			TestVEq(arr_argmaxf(doubles, doubles), 5, "%d");
+
+			arr_free(items);
+			arr_free(ints);
+			arr_free(floats);
+			arr_free(bytes);
+			arr_free(words);
+			arr_free(doubles);
+		}
+
+		TestGroup("Filter (function)") {
+			char *chars = 0, *upper = 0;
+			int *ints = 0, *odd = 0;
+			test_t *tests = 0, *positive = 0;
+			big_t *bigs = 0, *big_odd = 0;
+			ahd_int n_odd = 0, n_positive = 0;
+			int same = 1;
+			TestVEq(arr_filterfn(IsOdd, ints, odd, 0), 0, "%d");
+			arr_pusharr(chars, "aBcDEfghIJ", 10);
+			TestVEq(arr_filterfn(IsUpper, chars, upper, 0), 5, "%d");
+			Test(arr_len(upper) == 5 && ! memcmp(upper, "BDEIJ", 5));
+			for(i = 0; i < 1000; ++i) {
+				test_t t = { (int)((i * 7919) % 1000) - 500, 0, 0 };
+				big_t b = { (int)i, { 0 } };
+				arr_push(ints, t.Int);
+				arr_push(tests, t);
+				arr_push(bigs, b);
+				n_odd += t.Int & 1;
+				n_positive += t.Int > 0;
+			}
+
+			TestVEq(arr_filterfn(IsOdd, ints, odd, 0), n_odd, "%d");
+			TestVEq(arr_len(odd), n_odd, "%d");
+			for(i = 0, n_odd = 0; i < arr_len(ints); ++i) { if(ints[i] & 1) { same &= odd[n_odd++] == ints[i]; } }
+			Test(same);
+
+			TestVEq(arr_filterfn(IsPositive, tests, positive, 0), n_positive, "%d");
+			for(i = 0, n_positive = 0; i < arr_len(tests); ++i) { if(tests[i].Int > 0) { same &= positive[n_positive++].Int == tests[i].Int; } }
+			Test(same);
+
+			/* in place */
+			TestVEq(arr_filterfn(IsPositive, tests, tests, 0), n_positive, "%d");
+			Test(arr_len(tests) == arr_len(positive) && ! memcmp(tests, positive, arr_size(positive)));
+			TestVEq(arr_filterfn(IsBigOdd, bigs, bigs, 0), 500, "%d");
+			for(i = 0; i < arr_len(bigs); ++i) { same &= bigs[i].Int & 1; }
+			Test(same);
+			TestVEq(arr_filterfn(IsBigOdd, bigs, big_odd, 0), 500, "%d");
+
+			arr_free(chars);
+			arr_free(upper);
+			arr_free(ints);
+			arr_free(odd);
+			arr_free(tests);
+			arr_free(positive);
+			arr_free(bigs);
+			arr_free(big_odd);
+		}
+
+		TestGroup("Parallel map/reduce/filter") {
+			int thread_counts[] = { 1, 2, 3, 8 };
+			int *ints = 0, *odd = 0, *odd_expected = 0;
+			long long *squares = 0, sum_expected = 0;
+			for(i = 0; i < AHD_PLOOP_MIN * 2 + 13; ++i) {
+				arr_push(ints, (int)((i * 7919) % 1000) - 500);
+				sum_expected += ints[i];
+				if(ints[i] & 1) { arr_push(odd_expected, ints[i]); }
+			}
+			for(int i_count = 0; i_count < 4; ++i_count) {
+				long long sum = 0;
+				int same = 1;
+				ahd_ploop_threads = thread_counts[i_count];
+
+				arr_pmapfn(SquareInt, ints, squares, 0);
+				TestVEq(arr_len(squares), arr_len(ints), "%d");
+				for(i = 0; i < arr_len(ints); ++i) { same &= squares[i] == (long long)ints[i] * ints[i]; }
+				Test(same);
+
+				arr_preducefn(SumInt, AddSums, ints, &sum, 0);
+				TestVEq(sum, sum_expected, "%lld");
+
+				TestVEq(arr_pfilterfn(IsOdd, ints, odd, 0), arr_len(odd_expected), "%d");
+				Test(arr_eq(odd, odd_expected)); /* in order */
+
+				/* in place */
+				arr_free(odd);
+				odd = (int *)arr_dup(ints);
+				TestVEq(arr_pfilterfn(IsOdd, odd, odd, 0), arr_len(odd_expected), "%d");
+				Test(arr_eq(odd, odd_expected));
+			}
+			ahd_ploop_threads = AHD_PLOOP_THREADS;
+
+			arr_free(ints);
+			arr_free(odd);
+			arr_free(odd_expected);
+			arr_free(squares);
+		}
+	}
+
 	PrintTestResults(sweetCONTINUE);
 }
 
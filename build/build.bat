@@ -1,3 +1,5 @@
 cl /nologo /W4 /Z7 ..\airhead_test.cpp
 cl /nologo /EP ..\airhead_test.cpp > expanded.cpp
 cl /nologo /W4 /Z7 expanded.cpp
+cl /nologo /W4 /Z7 /DAHD_DEBUG=1 /Feairhead_test_debug.exe ..\airhead_test.cpp
+cl /nologo /W4 /O2 ..\airhead_bench.cpp